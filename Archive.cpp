@@ -0,0 +1,579 @@
+#include "Archive.h"
+#include "Batch.h"
+#include "Equilibrium.h"
+#include "Game.h"
+#include "globals.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char ARCHIVE_MAGIC[8] = { 'B', 'S', 'A', 'R', 'C', 'H', '0', '1' };
+const int LENGTH_BUCKETS = 21;   // of 10 turns each; the last is for 200 or more
+const int BUCKET_TURNS = 10;
+
+static_assert(sizeof(ArchiveGame) == 44, "archives have 44-byte games");
+
+  // followed at typesOffset by each type's name, a byte for its length and
+  // then its characters; at gamesOffset by ArchiveGame games[nGames]; and
+  // at bitmapsOffset by uint64 bitmaps[nBitmaps][words], bit k of a bitmap
+  // being bit k%64 of word k/64 and standing for game k
+struct ArchiveHeader
+{
+    char magic[8];
+    uint64_t fleet;
+    uint32_t nGames;
+    uint32_t nTypes;
+    uint32_t nShips;
+    uint32_t nBitmaps;
+    uint64_t words;
+    uint64_t typesOffset;
+    uint64_t gamesOffset;
+    uint64_t bitmapsOffset;
+};
+
+  // Where each index's bitmaps start, in an archive of nTypes types and
+  // nShips ships
+struct BitmapLayout
+{
+    int winner;     // 3 of them: player 1, player 2, no one won
+    int played;     // per type: a player was of that type
+    int won;        // per type: the winner was of that type
+    int lost;       // per type: the loser was of that type
+    int length;     // LENGTH_BUCKETS of them, by the more turns either player took
+    int firstSunk;  // per ship: the loser's ship sunk first
+    int lastSunk;   // per ship: the loser's ship sunk last
+    int total;
+
+    BitmapLayout(int nTypes, int nShips)
+    {
+        winner = 0;
+        played = winner + 3;
+        won = played + nTypes;
+        lost = won + nTypes;
+        length = lost + nTypes;
+        firstSunk = length + LENGTH_BUCKETS;
+        lastSunk = firstSunk + nShips;
+        total = lastSunk + nShips;
+    }
+};
+
+static int gameTurns(const ArchiveGame& a)
+{
+    return max(a.turns[0], a.turns[1]);
+}
+
+static int lengthBucket(int turns)
+{
+    return min(turns / BUCKET_TURNS, LENGTH_BUCKETS - 1);
+}
+
+ArchiveQuery::ArchiveQuery()
+ : winner(-1), minTurns(-1), maxTurns(-1), firstSunk(-1), lastSunk(-1)
+{}
+
+//*********************************************************************
+//  Archive
+//*********************************************************************
+
+Archive::Archive()
+ : m_data(nullptr), m_size(0)
+{}
+
+Archive::~Archive()
+{
+    close();
+}
+
+bool Archive::open(string path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ArchiveHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+    m_data = static_cast<const unsigned char*>(mem);
+    m_size = st.st_size;
+
+      // Check the layout once here so that queries needn't.  The games'
+      // columns themselves are checked only as far as indexing with them
+      // needs.
+    const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(m_data);
+    BitmapLayout layout(header->nTypes, header->nShips);
+    bool ok = memcmp(header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0 &&
+              header->nShips <= ARCHIVE_MAX_SHIPS && header->nTypes <= 256 &&
+              header->nBitmaps == uint32_t(layout.total) &&
+              header->words == (uint64_t(header->nGames) + 63) / 64 &&
+              header->gamesOffset % alignof(ArchiveGame) == 0 &&
+              header->gamesOffset <= m_size &&
+              uint64_t(header->nGames) * sizeof(ArchiveGame) <= m_size - header->gamesOffset &&
+              header->bitmapsOffset % sizeof(uint64_t) == 0 &&
+              header->bitmapsOffset <= m_size &&
+              header->words * header->nBitmaps <= (m_size - header->bitmapsOffset) / sizeof(uint64_t);
+    size_t pos = header->typesOffset;
+    for (uint32_t t = 0; ok && t < header->nTypes; t++)
+    {
+        ok = pos < m_size && pos + 1 + m_data[pos] <= m_size;
+        if (ok)
+        {
+            m_types.push_back(string(reinterpret_cast<const char*>(m_data + pos + 1), m_data[pos]));
+            pos += 1 + m_data[pos];
+        }
+    }
+    if ( ! ok)
+    {
+        close();
+    }
+    return ok;
+}
+
+void Archive::close()
+{
+    if (m_data != nullptr)
+    {
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+    m_types.clear();
+}
+
+bool Archive::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+size_t Archive::nGames() const
+{
+    return isOpen() ? reinterpret_cast<const ArchiveHeader*>(m_data)->nGames : 0;
+}
+
+uint64_t Archive::fleet() const
+{
+    return isOpen() ? reinterpret_cast<const ArchiveHeader*>(m_data)->fleet : 0;
+}
+
+int Archive::nShips() const
+{
+    return isOpen() ? reinterpret_cast<const ArchiveHeader*>(m_data)->nShips : 0;
+}
+
+const ArchiveGame& Archive::game(size_t i) const
+{
+    assert(i < nGames());
+    const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(m_data);
+    return reinterpret_cast<const ArchiveGame*>(m_data + header->gamesOffset)[i];
+}
+
+int Archive::nTypes() const
+{
+    return int(m_types.size());
+}
+
+string Archive::typeName(int t) const
+{
+    return t >= 0 && t < nTypes() ? m_types[t] : "?";
+}
+
+int Archive::typeIndex(string name) const
+{
+    for (int t = 0; t < nTypes(); t++)
+    {
+        if (m_types[t] == name)
+            return t;
+    }
+    return -1;
+}
+
+const uint64_t* Archive::bitmap(int i) const
+{
+    const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(m_data);
+    return reinterpret_cast<const uint64_t*>(m_data + header->bitmapsOffset) + size_t(i) * header->words;
+}
+
+vector<uint32_t> Archive::query(const ArchiveQuery& q) const
+{
+    vector<uint32_t> matches;
+    if ( ! isOpen())
+        return matches;
+    const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(m_data);
+    BitmapLayout layout(header->nTypes, header->nShips);
+
+      // The bitmaps to AND together.  A condition nothing can meet, like a
+      // type no game has, leaves no games at all.
+    vector<const uint64_t*> all;
+    bool none = false;
+    auto typeBitmap = [&](const string& name, int first) {
+        if (name.empty())
+            return;
+        int t = typeIndex(name);
+        if (t < 0)
+            none = true;
+        else
+            all.push_back(bitmap(first + t));
+    };
+    typeBitmap(q.player, layout.played);
+    typeBitmap(q.winnerType, layout.won);
+    typeBitmap(q.loserType, layout.lost);
+    if (q.winner >= 0)
+    {
+        if (q.winner > 2)
+            none = true;
+        else
+            all.push_back(bitmap(layout.winner + q.winner));
+    }
+    auto shipBitmap = [&](int ship, int first) {
+        if (ship < 0)
+            return;
+        if (ship >= int(header->nShips))
+            none = true;
+        else
+            all.push_back(bitmap(first + ship));
+    };
+    shipBitmap(q.firstSunk, layout.firstSunk);
+    shipBitmap(q.lastSunk, layout.lastSunk);
+
+      // A length range is the OR of the buckets it covers.  Those it covers
+      // only in part are the edge, whose games' turns must be looked at.
+    bool ranged = (q.minTurns >= 0 || q.maxTurns >= 0);
+    int lo = (q.minTurns >= 0 ? q.minTurns : 0);
+    int hi = (q.maxTurns >= 0 ? q.maxTurns : INT32_MAX);
+    if (ranged && lo > hi)
+        none = true;
+    if (none)
+        return matches;
+    int loBucket = lengthBucket(lo);
+    int hiBucket = lengthBucket(hi);
+    bool loEdge = (lo > loBucket * BUCKET_TURNS);
+    bool hiEdge = (hiBucket == LENGTH_BUCKETS - 1 ? q.maxTurns >= 0 :
+                                                    hi < (hiBucket + 1) * BUCKET_TURNS - 1);
+
+    for (uint64_t w = 0; w < header->words; w++)
+    {
+        uint64_t word = ~uint64_t(0);
+        if (w == header->words - 1 && header->nGames % 64 != 0)
+            word = (uint64_t(1) << (header->nGames % 64)) - 1;
+        for (size_t i = 0; i < all.size() && word != 0; i++)
+        {
+            word &= all[i][w];
+        }
+        uint64_t edge = 0;
+        if (ranged && word != 0)
+        {
+            uint64_t inRange = 0;
+            for (int b = loBucket; b <= hiBucket; b++)
+            {
+                inRange |= bitmap(layout.length + b)[w];
+            }
+            word &= inRange;
+            if (loEdge)
+                edge |= bitmap(layout.length + loBucket)[w];
+            if (hiEdge)
+                edge |= bitmap(layout.length + hiBucket)[w];
+        }
+        while (word != 0)
+        {
+            uint32_t k = uint32_t(w * 64 + __builtin_ctzll(word));
+            uint64_t bit = word & (~word + 1);
+            word ^= bit;
+            if ((edge & bit) != 0)
+            {
+                int turns = gameTurns(game(k));
+                if (turns < lo || turns > hi)
+                    continue;
+            }
+            matches.push_back(k);
+        }
+    }
+    return matches;
+}
+
+//*********************************************************************
+//  writeArchive
+//*********************************************************************
+
+static void setBit(vector<uint64_t>& bitmaps, uint64_t words, int i, uint32_t k)
+{
+    bitmaps[size_t(i) * words + k / 64] |= uint64_t(1) << (k % 64);
+}
+
+bool writeArchive(string path, const Game& g, const vector<string>& types,
+                  const vector<ArchiveGame>& games, bool append)
+{
+    if (g.nShips() > ARCHIVE_MAX_SHIPS)
+        return false;
+
+      // The games already there come first, keeping their type indexes;
+      // the new games' types are renumbered into the same list
+    vector<ArchiveGame> all;
+    vector<string> names;
+    Archive old;
+    if (append && old.open(path))
+    {
+        if (old.fleet() != fleetKey(g) || old.nShips() != g.nShips())
+            return false;
+        all.reserve(old.nGames() + games.size());
+        for (size_t i = 0; i < old.nGames(); i++)
+        {
+            all.push_back(old.game(i));
+        }
+        for (int t = 0; t < old.nTypes(); t++)
+        {
+            names.push_back(old.typeName(t));
+        }
+    }
+    else if (append && access(path.c_str(), F_OK) == 0)
+        return false;  // there's something there, but not an archive
+    old.close();
+    vector<uint8_t> renumber(types.size());
+    for (size_t t = 0; t < types.size(); t++)
+    {
+        size_t i = find(names.begin(), names.end(), types[t]) - names.begin();
+        if (i == names.size())
+            names.push_back(types[t]);
+        if (i > 255 || types[t].size() > 255)
+            return false;
+        renumber[t] = uint8_t(i);
+    }
+    for (size_t i = 0; i < games.size(); i++)
+    {
+        ArchiveGame a = games[i];
+        a.types[0] = renumber[a.types[0]];
+        a.types[1] = renumber[a.types[1]];
+        all.push_back(a);
+    }
+    if (all.size() > 0xFFFFFFFFULL)
+        return false;
+
+    ArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.fleet = fleetKey(g);
+    header.nGames = uint32_t(all.size());
+    header.nTypes = uint32_t(names.size());
+    header.nShips = uint32_t(g.nShips());
+    BitmapLayout layout(header.nTypes, header.nShips);
+    header.nBitmaps = layout.total;
+    header.words = (uint64_t(header.nGames) + 63) / 64;
+    string typeBytes;
+    for (size_t t = 0; t < names.size(); t++)
+    {
+        typeBytes += char(names[t].size());
+        typeBytes += names[t];
+    }
+    typeBytes.resize((typeBytes.size() + 7) / 8 * 8, '\0');
+    header.typesOffset = sizeof(header);
+    header.gamesOffset = header.typesOffset + typeBytes.size();
+    header.bitmapsOffset = header.gamesOffset + (all.size() * sizeof(ArchiveGame) + 7) / 8 * 8;
+
+    vector<uint64_t> bitmaps(size_t(header.nBitmaps) * header.words, 0);
+    for (uint32_t k = 0; k < header.nGames; k++)
+    {
+        const ArchiveGame& a = all[k];
+        int winner = min<int>(a.winner, 2);
+        setBit(bitmaps, header.words, layout.winner + winner, k);
+        setBit(bitmaps, header.words, layout.played + a.types[0], k);
+        setBit(bitmaps, header.words, layout.played + a.types[1], k);
+        setBit(bitmaps, header.words, layout.length + lengthBucket(gameTurns(a)), k);
+        if (winner == 2)
+            continue;
+        int loser = 1 - winner;
+        setBit(bitmaps, header.words, layout.won + a.types[winner], k);
+        setBit(bitmaps, header.words, layout.lost + a.types[loser], k);
+        int n = min<int>(a.nSunk[loser], header.nShips);
+        if (n > 0 && a.sunk[loser][0] < header.nShips)
+            setBit(bitmaps, header.words, layout.firstSunk + a.sunk[loser][0], k);
+        if (n > 0 && a.sunk[loser][n-1] < header.nShips)
+            setBit(bitmaps, header.words, layout.lastSunk + a.sunk[loser][n-1], k);
+    }
+
+      // Write it all beside the old archive and then put it in its place,
+      // so a reader never sees half an archive
+    string temp = path + ".tmp";
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+    static const char zeros[8] = { 0 };
+    size_t gameBytes = all.size() * sizeof(ArchiveGame);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(typeBytes.data(), 1, typeBytes.size(), f) == typeBytes.size() &&
+              fwrite(all.data(), 1, gameBytes, f) == gameBytes &&
+              fwrite(zeros, 1, header.bitmapsOffset - header.gamesOffset - gameBytes, f) ==
+                    header.bitmapsOffset - header.gamesOffset - gameBytes &&
+              fwrite(bitmaps.data(), sizeof(uint64_t), bitmaps.size(), f) == bitmaps.size();
+    ok = (fclose(f) == 0) && ok;
+    if (ok)
+        ok = (rename(temp.c_str(), path.c_str()) == 0);
+    if ( ! ok)
+        remove(temp.c_str());
+    return ok;
+}
+
+//*********************************************************************
+//  The --query command
+//*********************************************************************
+
+bool parseQueryArgs(int argc, char* argv[], string& path, ArchiveQuery& q,
+                    bool& countOnly, long long& limit, string& error)
+{
+    q = ArchiveQuery();
+    countOnly = false;
+    limit = -1;
+    if (argc < 1)
+    {
+        error = "missing the archive";
+        return false;
+    }
+    path = argv[0];
+    for (int i = 1; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--count")
+        {
+            countOnly = true;
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            error = "missing a value for " + opt;
+            return false;
+        }
+        const char* value = argv[++i];
+        long long n;
+        bool ok = true;
+        if (opt == "--player")
+            q.player = value;
+        else if (opt == "--winner-type")
+            q.winnerType = value;
+        else if (opt == "--loser-type")
+            q.loserType = value;
+        else if (opt == "--winner")
+        {
+            ok = toInt(value, 0, 2, n);
+            q.winner = (n == 0 ? 2 : int(n) - 1);
+        }
+        else if (opt == "--min-turns")
+        {
+            ok = toInt(value, 0, 0xFFFF, n);
+            q.minTurns = int(n);
+        }
+        else if (opt == "--max-turns")
+        {
+            ok = toInt(value, 0, 0xFFFF, n);
+            q.maxTurns = int(n);
+        }
+        else if (opt == "--first-sunk")
+        {
+            ok = toInt(value, 1, ARCHIVE_MAX_SHIPS, n);
+            q.firstSunk = int(n) - 1;
+        }
+        else if (opt == "--last-sunk")
+        {
+            ok = toInt(value, 1, ARCHIVE_MAX_SHIPS, n);
+            q.lastSunk = int(n) - 1;
+        }
+        else if (opt == "--limit")
+            ok = toInt(value, 0, 0x7FFFFFFFFFFFFFFFLL, limit);
+        else
+        {
+            error = "unknown option " + opt;
+            return false;
+        }
+        if ( ! ok)
+        {
+            error = "bad value " + string(value) + " for " + opt;
+            return false;
+        }
+    }
+    return true;
+}
+
+string queryUsage()
+{
+    return
+        "  --player TYPE          either player was of this type\n"
+        "  --winner-type TYPE     the winner was of this type\n"
+        "  --loser-type TYPE      the loser was of this type\n"
+        "  --winner N             player N won, or 0 for games no one won\n"
+        "  --min-turns N          the longer player's turns were at least N\n"
+        "  --max-turns N          and at most N\n"
+        "  --first-sunk N         the loser's ship N (as numbered by --batch's fleet) was sunk first\n"
+        "  --last-sunk N          the loser's ship N was sunk last\n"
+        "  --count                print only how many games match\n"
+        "  --limit N              print at most N of them (all)\n";
+}
+
+bool runQuery(string path, const ArchiveQuery& q, bool countOnly, long long limit)
+{
+    Archive archive;
+    if ( ! archive.open(path))
+    {
+        cerr << "Could not read the archive " << path << endl;
+        return false;
+    }
+    Clock::time_point start = Clock::now();
+    vector<uint32_t> matches = archive.query(q);
+    double millis = chrono::duration<double, milli>(Clock::now() - start).count();
+
+    size_t n = matches.size();
+    if (countOnly)
+        n = 0;
+    else if (limit >= 0 && size_t(limit) < n)
+        n = size_t(limit);
+    string out;
+    for (size_t i = 0; i < n; i++)
+    {
+        const ArchiveGame& a = archive.game(matches[i]);
+        out += "{\"type\":\"game\",\"game\":" + to_string(a.game) + ",\"seed\":" + to_string(a.seed) +
+               ",\"p1\":" + jsonString(archive.typeName(a.types[0])) +
+               ",\"p2\":" + jsonString(archive.typeName(a.types[1])) +
+               ",\"first\":" + to_string(a.first + 1) + ",\"winner\":" +
+               (a.winner > 1 ? string("null") : to_string(a.winner + 1)) +
+               ",\"turns\":[" + to_string(a.turns[0]) + "," + to_string(a.turns[1]) + "]" +
+               ",\"sunk\":[";
+        for (int p = 0; p < 2; p++)
+        {
+            out += (p == 0 ? "[" : ",[");
+            for (int s = 0; s < min<int>(a.nSunk[p], ARCHIVE_MAX_SHIPS); s++)
+            {
+                out += (s == 0 ? "" : ",") + to_string(a.sunk[p][s] + 1);
+            }
+            out += "]";
+        }
+        out += "]}\n";
+        if (out.size() >= 65536)
+        {
+            cout << out;
+            out.clear();
+        }
+    }
+    cout << out << fixed << setprecision(3)
+         << "{\"type\":\"summary\",\"archive\":" << jsonString(path)
+         << ",\"games\":" << archive.nGames() << ",\"matches\":" << matches.size()
+         << ",\"millis\":" << millis << "}" << endl;
+    return bool(cout);
+}
@@ -0,0 +1,100 @@
+#ifndef ARCHIVE_INCLUDED
+#define ARCHIVE_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Game;
+
+const int ARCHIVE_MAX_SHIPS = 12;
+
+  // One game's columns in an archive
+struct ArchiveGame
+{
+    std::uint32_t game;
+    std::uint32_t seed;
+    std::uint8_t types[2];      // of player 1 and player 2, indexing the
+                                // archive's type names
+    std::uint8_t winner;        // 0 for player 1, 1 for player 2, 2 if no one
+    std::uint8_t first;         // which of them fired first
+    std::uint16_t turns[2];
+    std::uint8_t nSunk[2];      // how many of each player's ships were sunk
+    std::uint8_t sunk[2][ARCHIVE_MAX_SHIPS];  // each player's ships by shipId,
+                                // in the order they were sunk
+    std::uint8_t unused[2];
+};
+
+  // What to look for in an archive.  Every condition given must hold.
+struct ArchiveQuery
+{
+    std::string player;         // a type either player was; "" for any
+    std::string winnerType;     // the winner's type
+    std::string loserType;      // the loser's type
+    int winner;                 // 0 or 1 for that player, 2 for no one, -1 for any
+    int minTurns;               // the longer player's turns; -1 for no bound
+    int maxTurns;
+    int firstSunk;              // shipId of the loser's ship sunk first; -1 for any
+    int lastSunk;               // shipId of the loser's ship sunk last, the one
+                                // that survived longest; -1 for any
+
+    ArchiveQuery();
+};
+
+  // A file of game summaries and, alongside them, bitmap indexes on the
+  // winner, the players' types, who won and lost, the game's length in
+  // buckets of 10 turns, and which of the loser's ships was sunk first
+  // and last.  A query ANDs the bitmaps for its conditions, a word of 64
+  // games at a time, and reads the columns of only the games left, so it
+  // touches little of a large archive, which is mapped rather than read.
+class Archive
+{
+  public:
+    Archive();
+    ~Archive();
+    bool open(std::string path);
+    void close();
+    bool isOpen() const;
+    std::size_t nGames() const;
+    std::uint64_t fleet() const;  // fleetKey of the games' board and fleet
+    int nShips() const;
+    const ArchiveGame& game(std::size_t i) const;
+    int nTypes() const;
+    std::string typeName(int t) const;
+      // The index of the type named name; -1 if no game has it
+    int typeIndex(std::string name) const;
+      // The indexes of the games matching q, in order
+    std::vector<std::uint32_t> query(const ArchiveQuery& q) const;
+      // We prevent an Archive object from being copied or assigned
+    Archive(const Archive&) = delete;
+    Archive& operator=(const Archive&) = delete;
+
+  private:
+    const std::uint64_t* bitmap(int i) const;
+
+    const unsigned char* m_data;  // the mapped file
+    std::size_t m_size;
+    std::vector<std::string> m_types;
+};
+
+  // Write games of g's board and fleet, whose types index types, to an
+  // archive at path with its indexes.  If append and there's an archive at
+  // path already, its games come first.  Returns false if the file can't
+  // be written, or the existing archive is for a different fleet.
+bool writeArchive(std::string path, const Game& g, const std::vector<std::string>& types,
+                  const std::vector<ArchiveGame>& games, bool append);
+
+  // Set path and q from the command-line arguments that follow --query;
+  // false, with error set, if an argument is wrong
+bool parseQueryArgs(int argc, char* argv[], std::string& path, ArchiveQuery& q,
+                    bool& countOnly, long long& limit, std::string& error);
+
+  // What parseQueryArgs accepts, for a usage message
+std::string queryUsage();
+
+  // Print the games in the archive at path matching q as JSON lines, then
+  // how many matched and how long it took
+bool runQuery(std::string path, const ArchiveQuery& q, bool countOnly, long long limit);
+
+#endif // ARCHIVE_INCLUDED
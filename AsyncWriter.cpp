@@ -0,0 +1,378 @@
+#include "AsyncWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+const int WRITER_IDLE_MS = 100;   // the writer's thread looks for work at least this often
+
+class AsyncWriterImpl
+{
+  public:
+    AsyncWriterImpl();
+    ~AsyncWriterImpl();
+    bool open(string path, size_t bufferSize);
+    bool isOpen() const;
+    AsyncProducer* producer();
+    bool close();
+    uint64_t bytesWritten() const;
+    uint64_t stalls() const;
+      // A producer has handed over a buffer
+    void wake();
+
+  private:
+      // The writer's thread: write buffers as producers hand them over
+    void run();
+      // Write out every iov, however many calls it takes; false on error
+    bool writeAll(vector<iovec>& iovs);
+
+    int m_fd;                     // -1 if not open
+    bool m_ownsFd;                // false for standard output
+    size_t m_bufferSize;
+    int m_wake;                   // eventfd producers write to
+    thread m_thread;
+    mutable mutex m_producersLock; // guards the list, not the producers
+    vector<unique_ptr<AsyncProducer> > m_producers;
+    atomic<bool> m_stopping;
+    atomic<bool> m_failed;
+    atomic<uint64_t> m_bytes;
+};
+
+//*********************************************************************
+//  AsyncProducer
+//*********************************************************************
+
+AsyncProducer::AsyncProducer(AsyncWriterImpl& writer, size_t bufferSize)
+ : m_writer(writer), m_current(0), m_nextSeq(0), m_written(0), m_stalls(0)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        m_buffers[i].data.resize(bufferSize);
+        m_buffers[i].used = 0;
+        m_buffers[i].seq = 0;
+        m_buffers[i].state.store(FREE);
+    }
+}
+
+void AsyncProducer::write(const char* p, size_t n)
+{
+    size_t size = m_buffers[0].data.size();
+    while (n > 0)
+    {
+        Buffer& b = m_buffers[m_current];
+        if (b.used + n > size && b.used > 0)
+        {
+            handOver(); //keep what fits in one buffer together
+            continue;
+        }
+        size_t k = min(n, size - b.used);
+        memcpy(b.data.data() + b.used, p, k);
+        b.used += k;
+        p += k;
+        n -= k;
+    }
+}
+
+void AsyncProducer::write(const string& s)
+{
+    write(s.data(), s.size());
+}
+
+void AsyncProducer::flush()
+{
+    handOver();
+}
+
+uint64_t AsyncProducer::stalls() const
+{
+    return m_stalls.load(memory_order_relaxed);
+}
+
+void AsyncProducer::handOver()
+{
+    Buffer& full = m_buffers[m_current];
+    if (full.used == 0)
+        return;
+    full.seq = m_nextSeq++;
+    full.state.store(READY, memory_order_release);
+    m_writer.wake();
+
+      // The other buffer is free unless the writer is a whole buffer
+      // behind; then wait, briefly spinning in case it's nearly done
+    m_current = 1 - m_current;
+    Buffer& next = m_buffers[m_current];
+    if (next.state.load(memory_order_acquire) != FREE)
+    {
+        m_stalls.fetch_add(1, memory_order_relaxed);
+        for (int spins = 0; next.state.load(memory_order_acquire) != FREE; spins++)
+        {
+            if (spins < 64)
+                this_thread::yield();
+            else
+                this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+    next.used = 0;
+}
+
+//*********************************************************************
+//  AsyncWriterImpl
+//*********************************************************************
+
+AsyncWriterImpl::AsyncWriterImpl()
+ : m_fd(-1), m_ownsFd(false), m_bufferSize(0), m_wake(-1), m_stopping(false),
+   m_failed(false), m_bytes(0)
+{}
+
+AsyncWriterImpl::~AsyncWriterImpl()
+{
+    close();
+}
+
+bool AsyncWriterImpl::open(string path, size_t bufferSize)
+{
+    if (isOpen() || bufferSize == 0)
+        return false;
+    if (path == "-")
+    {
+        m_fd = STDOUT_FILENO;
+        m_ownsFd = false;
+    }
+    else
+    {
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        m_ownsFd = true;
+        if (m_fd < 0)
+            return false;
+    }
+    m_wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wake < 0)
+    {
+        if (m_ownsFd)
+            ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_bufferSize = bufferSize;
+    m_stopping = false;
+    m_failed = false;
+    m_bytes = 0;
+    m_thread = thread(&AsyncWriterImpl::run, this);
+    return true;
+}
+
+bool AsyncWriterImpl::isOpen() const
+{
+    return m_fd >= 0;
+}
+
+AsyncProducer* AsyncWriterImpl::producer()
+{
+    if ( ! isOpen())
+        return nullptr;
+    lock_guard<mutex> lock(m_producersLock);
+    m_producers.push_back(unique_ptr<AsyncProducer>(new AsyncProducer(*this, m_bufferSize)));
+    return m_producers.back().get();
+}
+
+bool AsyncWriterImpl::close()
+{
+    if ( ! isOpen())
+        return true;
+      // Their threads are done with the producers.  Flushing may wait for
+      // the writer's thread, which takes the lock, so don't hold it.
+    vector<AsyncProducer*> producers;
+    {
+        lock_guard<mutex> lock(m_producersLock);
+        for (size_t i = 0; i < m_producers.size(); i++)
+            producers.push_back(m_producers[i].get());
+    }
+    for (size_t i = 0; i < producers.size(); i++)
+    {
+        producers[i]->flush();
+    }
+    m_stopping.store(true, memory_order_release);
+    wake();
+    m_thread.join();
+    bool ok = ! m_failed;
+    if (m_ownsFd && ::close(m_fd) != 0)
+        ok = false;
+    ::close(m_wake);
+    m_fd = -1;
+    m_wake = -1;
+    return ok;
+}
+
+uint64_t AsyncWriterImpl::bytesWritten() const
+{
+    return m_bytes.load(memory_order_relaxed);
+}
+
+uint64_t AsyncWriterImpl::stalls() const
+{
+    lock_guard<mutex> lock(m_producersLock);
+    uint64_t n = 0;
+    for (size_t i = 0; i < m_producers.size(); i++)
+    {
+        n += m_producers[i]->stalls();
+    }
+    return n;
+}
+
+void AsyncWriterImpl::wake()
+{
+    uint64_t one = 1;
+    ssize_t n = ::write(m_wake, &one, sizeof(one)); //never blocks
+    (void)n;
+}
+
+void AsyncWriterImpl::run()
+{
+    vector<AsyncProducer*> producers;
+    vector<AsyncProducer::Buffer*> taken;
+    vector<iovec> iovs;
+    while (true)
+    {
+        bool stopping = m_stopping.load(memory_order_acquire);
+        {
+            lock_guard<mutex> lock(m_producersLock);
+            producers.clear();
+            for (size_t i = 0; i < m_producers.size(); i++)
+                producers.push_back(m_producers[i].get());
+        }
+
+          // Take each producer's ready buffers in the order it filled them,
+          // as many as one writev takes
+        taken.clear();
+        iovs.clear();
+        for (size_t i = 0; i < producers.size() && iovs.size() + 2 <= IOV_MAX; i++)
+        {
+            AsyncProducer* p = producers[i];
+            for (bool found = true; found; )
+            {
+                found = false;
+                for (int k = 0; k < 2; k++)
+                {
+                    AsyncProducer::Buffer& b = p->m_buffers[k];
+                    if (b.state.load(memory_order_acquire) == AsyncProducer::READY && b.seq == p->m_written)
+                    {
+                        taken.push_back(&b);
+                        iovs.push_back(iovec{ b.data.data(), b.used });
+                        p->m_written++;
+                        found = true;
+                    }
+                }
+            }
+        }
+
+        if ( ! taken.empty())
+        {
+            if ( ! m_failed && ! writeAll(iovs))
+                m_failed = true; //what follows is dropped, so no producer waits forever
+            for (size_t i = 0; i < taken.size(); i++)
+            {
+                taken[i]->state.store(AsyncProducer::FREE, memory_order_release);
+            }
+            continue;
+        }
+        if (stopping)
+            break;
+        pollfd pfd = { m_wake, POLLIN, 0 };
+        if (poll(&pfd, 1, WRITER_IDLE_MS) > 0)
+        {
+            uint64_t n;
+            ssize_t r = ::read(m_wake, &n, sizeof(n));
+            (void)r;
+        }
+    }
+}
+
+bool AsyncWriterImpl::writeAll(vector<iovec>& iovs)
+{
+    size_t first = 0;
+    while (first < iovs.size())
+    {
+        ssize_t n = writev(m_fd, &iovs[first], int(iovs.size() - first));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        m_bytes.fetch_add(uint64_t(n), memory_order_relaxed);
+        for (size_t left = size_t(n); left > 0 && first < iovs.size(); )
+        {
+            if (left >= iovs[first].iov_len)
+            {
+                left -= iovs[first].iov_len;
+                first++;
+            }
+            else
+            {
+                iovs[first].iov_base = static_cast<char*>(iovs[first].iov_base) + left;
+                iovs[first].iov_len -= left;
+                left = 0;
+            }
+        }
+        while (first < iovs.size() && iovs[first].iov_len == 0)
+            first++;
+    }
+    return true;
+}
+
+//*********************************************************************
+//  AsyncWriter
+//*********************************************************************
+
+AsyncWriter::AsyncWriter()
+ : m_impl(new AsyncWriterImpl)
+{}
+
+AsyncWriter::~AsyncWriter()
+{
+    delete m_impl;
+}
+
+bool AsyncWriter::open(string path, size_t bufferSize)
+{
+    return m_impl->open(path, bufferSize);
+}
+
+bool AsyncWriter::isOpen() const
+{
+    return m_impl->isOpen();
+}
+
+AsyncProducer* AsyncWriter::producer()
+{
+    return m_impl->producer();
+}
+
+bool AsyncWriter::close()
+{
+    return m_impl->close();
+}
+
+uint64_t AsyncWriter::bytesWritten() const
+{
+    return m_impl->bytesWritten();
+}
+
+uint64_t AsyncWriter::stalls() const
+{
+    return m_impl->stalls();
+}
@@ -0,0 +1,86 @@
+#ifndef ASYNCWRITER_INCLUDED
+#define ASYNCWRITER_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class AsyncWriterImpl;
+
+  // One thread's way into an AsyncWriter.  It fills one of its two
+  // buffers while the writer's thread writes out the other, so writing
+  // costs the thread a copy, and a system call only to say that a buffer
+  // is full.  Only the thread it was made for may use it.
+class AsyncProducer
+{
+  public:
+      // Add n bytes, which are written out together with nothing from
+      // other producers between them as long as n is at most the buffer
+      // size.  If both buffers are still waiting to be written, this
+      // waits for one: the writer's limit on how far behind it may fall.
+    void write(const char* p, std::size_t n);
+    void write(const std::string& s);
+      // Hand over what's in the buffer now rather than when it fills
+    void flush();
+      // Times write had to wait for the writer's thread
+    std::uint64_t stalls() const;
+
+    AsyncProducer(const AsyncProducer&) = delete;
+    AsyncProducer& operator=(const AsyncProducer&) = delete;
+
+  private:
+    friend class AsyncWriterImpl;
+    enum { FREE, READY };
+    struct Buffer
+    {
+        std::vector<char> data;
+        std::size_t used;
+        std::uint64_t seq;            // order among this producer's buffers
+        std::atomic<int> state;       // FREE while the producer has it
+    };
+
+    AsyncProducer(AsyncWriterImpl& writer, std::size_t bufferSize);
+    void handOver();
+
+    AsyncWriterImpl& m_writer;
+    Buffer m_buffers[2];
+    int m_current;                    // the buffer being filled
+    std::uint64_t m_nextSeq;          // the next buffer handed over gets this
+    std::uint64_t m_written;          // the writer's thread's: the next seq to write
+    std::atomic<std::uint64_t> m_stalls;
+};
+
+  // Writes what any number of threads produce to a file or standard
+  // output from a thread of its own, gathering every full buffer into
+  // one writev, so that threads playing games never wait on a disk or a
+  // pipe unless they get two buffers ahead of it.  What each producer
+  // writes comes out in order; different producers' output is
+  // interleaved a buffer at a time.
+class AsyncWriter
+{
+  public:
+    AsyncWriter();
+    ~AsyncWriter();
+      // Start writing to path ("-" for standard output), truncating it, in
+      // buffers of bufferSize bytes per producer, two each
+    bool open(std::string path, std::size_t bufferSize = 65536);
+    bool isOpen() const;
+      // A producer for the calling thread, which the writer owns
+    AsyncProducer* producer();
+      // Once every producer's thread is done with it, write out what they
+      // left in their buffers and stop.  Returns false if any write failed.
+    bool close();
+    std::uint64_t bytesWritten() const;
+      // Times producers had to wait, over all of them
+    std::uint64_t stalls() const;
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  private:
+    AsyncWriterImpl* m_impl;
+};
+
+#endif // ASYNCWRITER_INCLUDED
@@ -0,0 +1,984 @@
+#include "Batch.h"
+#include "Archive.h"
+#include "AsyncWriter.h"
+#include "EventStream.h"
+#include "Game.h"
+#include "Player.h"
+#include "Profile.h"
+#include "Stats.h"
+#include "TranspositionTable.h"
+#include "globals.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern char** environ;
+
+const char BATCH_MAGIC[8] = { 'B', 'S', 'B', 'A', 'T', 'C', 'H', '1' };
+const char SHIP_SYMBOLS[] = "ABCDEFGHIJKLMNPQRSTUVWYZ";  // no O or X, which boards use
+
+static_assert(sizeof(BatchRecord) == 24, "binary output has 24-byte records");
+
+  // Totals over some of a batch's games
+struct Tally
+{
+    long long games;
+    long long wins[2];
+    long long winTurns[2];  // turns taken in the games won
+    long long overruns[2];
+    long long unplayed;
+    long long micros;
+
+    Tally()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+    void add(const BatchRecord& r)
+    {
+        games++;
+        micros += r.micros;
+        if (r.winner > 1)
+        {
+            unplayed++;
+            return;
+        }
+        wins[r.winner]++;
+        winTurns[r.winner] += r.turns[r.winner];
+        overruns[0] += r.overruns[0];
+        overruns[1] += r.overruns[1];
+    }
+    void merge(const Tally& t)
+    {
+        games += t.games;
+        unplayed += t.unplayed;
+        micros += t.micros;
+        for (int i = 0; i < 2; i++)
+        {
+            wins[i] += t.wins[i];
+            winTurns[i] += t.winTurns[i];
+            overruns[i] += t.overruns[i];
+        }
+    }
+};
+
+bool toInt(const char* s, long long lo, long long hi, long long& n)
+{
+    char* end;
+    errno = 0;
+    n = strtoll(s, &end, 10);
+    return errno == 0 && end != s && *end == '\0' && n >= lo && n <= hi;
+}
+
+bool parseBatchArgs(int argc, char* argv[], BatchConfig& config, string& error)
+{
+    config.rows = 10;
+    config.cols = 10;
+    config.fleet = "5,4,3,3,2";
+    config.p1 = "good";
+    config.p2 = "density";
+    config.games = 100;
+    config.first = 0;
+    config.seed = random_device()();
+    config.threads = 1;
+    config.workers = 0;
+    config.merge.clear();
+    config.output = "summary";
+    config.outPath = "-";
+    config.archive.clear();
+    config.log.clear();
+    config.progress = 0;
+    config.profile = false;
+    config.moveTimeLimit = 0;
+    config.salvo = 1;
+
+    bool seeded = false;
+    for (int i = 0; i < argc; i++)
+    {
+        string opt = argv[i];
+        if (opt == "--profile") //the one option with no value
+        {
+            config.profile = true;
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            error = "missing a value for " + opt;
+            return false;
+        }
+        const char* value = argv[++i];
+        long long n;
+        bool ok = true;
+        if (opt == "--rows")
+        {
+            ok = toInt(value, 1, MAXROWS, n);
+            config.rows = int(n);
+        }
+        else if (opt == "--cols")
+        {
+            ok = toInt(value, 1, MAXCOLS, n);
+            config.cols = int(n);
+        }
+        else if (opt == "--fleet")
+            config.fleet = value;
+        else if (opt == "--p1")
+            config.p1 = value;
+        else if (opt == "--p2")
+            config.p2 = value;
+        else if (opt == "--games")
+        {
+            ok = toInt(value, 1, 0xFFFFFFFFLL, n);
+            config.games = n;
+        }
+        else if (opt == "--seed")
+        {
+            ok = toInt(value, 0, 0xFFFFFFFFLL, n);
+            config.seed = uint32_t(n);
+            seeded = true;
+        }
+        else if (opt == "--first")
+        {
+            ok = toInt(value, 0, 0xFFFFFFFFLL, n);
+            config.first = n;
+        }
+        else if (opt == "--threads")
+        {
+            ok = toInt(value, 1, 1024, n);
+            config.threads = int(n);
+        }
+        else if (opt == "--workers")
+        {
+            ok = toInt(value, 1, 1024, n);
+            config.workers = int(n);
+        }
+        else if (opt == "--merge")
+            config.merge.push_back(value);
+        else if (opt == "--output")
+        {
+            config.output = value;
+            ok = (config.output == "summary" || config.output == "json" || config.output == "binary");
+        }
+        else if (opt == "--out")
+            config.outPath = value;
+        else if (opt == "--archive")
+            config.archive = value;
+        else if (opt == "--log")
+            config.log = value;
+        else if (opt == "--progress")
+        {
+            ok = toInt(value, 1, 86400, n);
+            config.progress = int(n);
+        }
+        else if (opt == "--time-limit")
+        {
+            ok = toInt(value, 0, 3600000, n);
+            config.moveTimeLimit = int(n);
+        }
+        else if (opt == "--salvo")
+        {
+            ok = toInt(value, SALVO_SHIPS_AFLOAT, MAXROWS*MAXCOLS, n);
+            config.salvo = int(n);
+        }
+        else
+        {
+            error = "unknown option " + opt;
+            return false;
+        }
+        if ( ! ok)
+        {
+            error = "bad value " + string(value) + " for " + opt;
+            return false;
+        }
+    }
+    if (config.p1 == "human" || config.p2 == "human")
+    {
+        error = "a batch can't wait for a human player";
+        return false;
+    }
+    if (config.first + config.games > 0x100000000LL)
+    {
+        error = "games are numbered from 0 to 4294967295";
+        return false;
+    }
+    if (config.workers > 0 && ! config.merge.empty())
+    {
+        error = "--workers and --merge don't go together";
+        return false;
+    }
+    if ( ! config.archive.empty() && (config.workers > 0 || ! config.merge.empty()))
+    {
+        error = "--archive needs the games played in this process";
+        return false;
+    }
+    if ( ! config.log.empty() && (config.workers > 0 || ! config.merge.empty()))
+    {
+        error = "--log needs the games played in this process";
+        return false;
+    }
+    if (config.progress > 0 && (config.workers > 0 || ! config.merge.empty()))
+    {
+        error = "--progress needs the games played in this process";
+        return false;
+    }
+    if (config.profile && (config.workers > 0 || ! config.merge.empty()))
+    {
+        error = "--profile needs the games played in this process";
+        return false;
+    }
+    if ( ! config.merge.empty() && ! seeded)
+    {
+        error = "--merge needs the batch's --seed";
+        return false;
+    }
+    return true;
+}
+
+string batchUsage()
+{
+    return
+        "  --rows N, --cols N     board size (10 by 10)\n"
+        "  --fleet SHIPS          lengths or shapes such as ##/#., separated by commas (5,4,3,3,2)\n"
+        "  --p1 TYPE, --p2 TYPE   player types, including pipe:COMMAND (good and density)\n"
+        "  --games N              games to play, alternating who fires first (100)\n"
+        "  --seed S               game k is seeded with S+k (random)\n"
+        "  --first K              index of the first game, to play part of a batch (0)\n"
+        "  --threads N            games played at once in each process (1)\n"
+        "  --workers N            spread the games over N processes (none)\n"
+        "  --merge PATH           instead of playing, merge the binary output of runs of\n"
+        "                         parts of the batch; give it for each part, with the\n"
+        "                         batch's --seed, --first and --games\n"
+        "  --output FORMAT        summary, json (a line per game, then the totals) or binary\n"
+        "  --out PATH             where the output goes (- for standard output)\n"
+        "  --archive PATH         add the games to the archive at PATH, for --query\n"
+        "  --log PATH             write every game's events to PATH as they're played\n"
+        "  --progress SECONDS     report on the games so far this often, on standard error\n"
+        "  --profile              count cycles, instructions, cache and branch misses for\n"
+        "                         placement, hunting and targeting moves, and attacks\n"
+        "  --time-limit MS        per computer move (none)\n"
+        "  --salvo K              shots per turn, 0 for one per ship afloat (1)\n";
+}
+
+  // Set up g as config asks; false if the fleet is no good
+static bool setUpGame(Game& g, const BatchConfig& config)
+{
+    stringstream fleet(config.fleet);
+    string ship;
+    int n = 0;
+    while (getline(fleet, ship, ','))
+    {
+        if (n + 1 >= int(sizeof(SHIP_SYMBOLS)))
+            return false;
+        long long length;
+        string name = "ship " + to_string(n + 1);
+        bool added = toInt(ship.c_str(), 1, MAXROWS*MAXCOLS, length) ?
+                        g.addShip(int(length), SHIP_SYMBOLS[n], name) :
+                        g.addShip(ship, SHIP_SYMBOLS[n], name);
+        if ( ! added)
+            return false;
+        n++;
+    }
+    g.setQuiet(true);
+    g.setMoveTimeLimit(config.moveTimeLimit);
+    g.setSalvo(config.salvo);
+    return n > 0;
+}
+
+  // A thread's statistics, and the lock a progress report takes to read them
+struct StatsShard
+{
+    mutex lock;
+    PlayStats stats;
+    Profile profile;
+
+    StatsShard(int nShips)
+     : stats(nShips)
+    {}
+};
+
+  // Play game k of config's batch, adding it to shard's statistics; if a
+  // isn't nullptr, set it to the game's columns for an archive, and if log
+  // isn't, write to it the events g publishes to events
+static BatchRecord playOne(Game& g, const BatchConfig& config, uint32_t k, StatsShard& shard,
+                           ArchiveGame* a, const EventStream* events, AsyncProducer* log)
+{
+    BatchRecord r;
+    memset(&r, 0, sizeof(r));
+    r.game = k;
+    r.seed = config.seed + k;
+    r.first = k % 2;
+    seedRandom(r.seed);
+    transpositionTable().newGeneration(); //positions from games long over go first
+
+    Clock::time_point start = Clock::now();
+    Player* p[2];
+    p[0] = createPlayer(config.p1, "Player 1", g);
+    p[1] = createPlayer(config.p2, "Player 2", g);
+    Player* winner = nullptr;
+    Spectator watcher(*events);
+    if (p[0] != nullptr && p[1] != nullptr)
+        winner = (r.first == 0 ? g.play(p[0], p[1], false) : g.play(p[1], p[0], false));
+      // One write per game keeps its lines together in the log
+    GameEvent e;
+    string lines;
+    while (log != nullptr && watcher.next(e))
+    {
+        e.game = k; //the batch's numbering, not the process's
+        lines += formatEvent(e);
+        lines += '\n';
+    }
+    if (log != nullptr)
+        log->write(lines);
+    r.winner = (winner == nullptr ? 2 : winner == p[0] ? 0 : 1);
+    for (int i = 0; i < 2 && winner != nullptr; i++)
+    {
+        r.turns[i] = g.turns(p[i]);
+        r.overruns[i] = g.overruns(p[i]);
+    }
+    if (a != nullptr)
+    {
+        memset(a, 0, sizeof(*a));
+        a->game = r.game;
+        a->seed = r.seed;
+        a->types[0] = 0;
+        a->types[1] = 1;
+        a->winner = r.winner;
+        a->first = r.first;
+        a->turns[0] = r.turns[0];
+        a->turns[1] = r.turns[1];
+        for (int i = 0; i < 2 && winner != nullptr; i++)
+        {
+              // Player i's ships are the ones the other player sank
+            const vector<int>& sunk = g.sinkOrder(p[1-i]);
+            a->nSunk[i] = uint8_t(min<size_t>(sunk.size(), ARCHIVE_MAX_SHIPS));
+            for (int s = 0; s < a->nSunk[i]; s++)
+            {
+                a->sunk[i][s] = uint8_t(sunk[s]);
+            }
+        }
+    }
+    {
+        lock_guard<mutex> lock(shard.lock);
+        shard.stats.add(g, p[0], p[1], winner);
+        shard.profile.add(0, g.phaseCounts(p[0]));
+        shard.profile.add(1, g.phaseCounts(p[1]));
+    }
+    delete p[0];
+    delete p[1];
+    r.micros = uint32_t(chrono::duration_cast<chrono::microseconds>(Clock::now() - start).count());
+    return r;
+}
+
+string jsonString(const string& s)
+{
+    string out = "\"";
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        unsigned char ch = s[i];
+        if (ch == '"' || ch == '\\')
+            out += '\\';
+        if (ch < 0x20)
+        {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", ch);
+            out += esc;
+        }
+        else
+            out += ch;
+    }
+    return out + "\"";
+}
+
+  // Gathers the records of a batch's games, which may come in any order
+  // from the processes that played parts of it, checking that every game
+  // turns up once
+struct Gather
+{
+    const BatchConfig& config;
+    vector<BatchRecord>& records;  // indexed by game - config.first; empty if not wanted
+    vector<bool> seen;
+    long long nSeen;
+    Tally total;
+
+    Gather(const BatchConfig& c, vector<BatchRecord>& r)
+     : config(c), records(r), seen(c.games, false), nSeen(0)
+    {}
+    bool add(const BatchRecord& r, string& error)
+    {
+        long long i = (long long)(r.game) - config.first;
+        if (i < 0 || i >= config.games || r.seed != uint32_t(config.seed + r.game))
+        {
+            error = "game " + to_string(r.game) + " isn't one of this batch's";
+            return false;
+        }
+        if (seen[i])
+        {
+            error = "game " + to_string(r.game) + " turns up twice";
+            return false;
+        }
+        seen[i] = true;
+        nSeen++;
+        total.add(r);
+        if ( ! records.empty())
+            records[i] = r;
+        return true;
+    }
+};
+
+  // Reads a part's binary output as it arrives
+struct PartReader
+{
+    string buf;         // arrived, not yet taken
+    bool haveHeader;
+    uint32_t left;      // records the header says are still to come
+
+    PartReader()
+     : haveHeader(false), left(0)
+    {}
+      // Take the whole records in buf
+    bool take(Gather& g, string& error)
+    {
+        size_t pos = 0;
+        if ( ! haveHeader)
+        {
+            if (buf.size() < sizeof(BatchHeader))
+                return true;
+            BatchHeader header;
+            memcpy(&header, buf.data(), sizeof(header));
+            if (memcmp(header.magic, BATCH_MAGIC, sizeof(BATCH_MAGIC)) != 0 ||
+                header.recordSize != sizeof(BatchRecord))
+            {
+                error = "not binary batch output";
+                return false;
+            }
+            haveHeader = true;
+            left = header.nRecords;
+            pos = sizeof(header);
+        }
+        for ( ; left > 0 && buf.size() - pos >= sizeof(BatchRecord); left--)
+        {
+            BatchRecord r;
+            memcpy(&r, buf.data() + pos, sizeof(r));
+            pos += sizeof(r);
+            if ( ! g.add(r, error))
+                return false;
+        }
+        buf.erase(0, pos);
+        if (left == 0 && ! buf.empty())
+        {
+            error = "more records than the header says";
+            return false;
+        }
+        return true;
+    }
+    bool finished() const
+    {
+        return haveHeader && left == 0;
+    }
+};
+
+  // Play config's games in this process, on config.threads threads, g
+  // being set up as they are
+static void playGames(const BatchConfig& config, const Game& probe, vector<BatchRecord>& records,
+                      vector<ArchiveGame>& archived, Tally& total, PlayStats& stats, Profile& profile,
+                      AsyncWriter& log)
+{
+      // Each thread takes the next game to play until there are none left.
+      // A game's seed depends only on its index, so which thread plays it
+      // doesn't matter.
+    vector<Tally> tallies(config.threads);
+    vector<unique_ptr<StatsShard>> shards;
+    for (int t = 0; t < config.threads; t++)
+    {
+        shards.push_back(unique_ptr<StatsShard>(new StatsShard(probe.nShips())));
+    }
+    atomic<long long> next(0);
+    auto worker = [&](int t) {
+        Game g(config.rows, config.cols);
+        setUpGame(g, config);
+        PerfCounters counters; //opened here, since they count for this thread
+        if (config.profile)
+        {
+            counters.open();
+            g.setCounters(&counters);
+            lock_guard<mutex> lock(shards[t]->lock);
+            shards[t]->profile.setAvailable(counters.available());
+        }
+        EventStream events; //a game's worth of events, for the log
+        AsyncProducer* out = (log.isOpen() ? log.producer() : nullptr);
+        if (out != nullptr)
+            g.setEventStream(&events);
+        long long i;
+        while ((i = next.fetch_add(1)) < config.games)
+        {
+            BatchRecord r = playOne(g, config, uint32_t(config.first + i), *shards[t],
+                                    archived.empty() ? nullptr : &archived[i], &events, out);
+            tallies[t].add(r);
+            if ( ! records.empty())
+                records[i] = r;
+        }
+    };
+    auto merged = [&]() {
+        PlayStats all(probe.nShips());
+        for (size_t t = 0; t < shards.size(); t++)
+        {
+            lock_guard<mutex> lock(shards[t]->lock);
+            all.merge(shards[t]->stats);
+        }
+        return all;
+    };
+
+      // The progress reports merge what the threads have so far, holding
+      // each one's lock only while merging its statistics
+    mutex doneLock;
+    condition_variable doneChanged;
+    bool done = false;
+    thread reporter;
+    if (config.progress > 0)
+    {
+        reporter = thread([&]() {
+            Clock::time_point start = Clock::now();
+            unique_lock<mutex> lock(doneLock);
+            while ( ! doneChanged.wait_for(lock, chrono::seconds(config.progress), [&]() { return done; }))
+            {
+                PlayStats all = merged();
+                double seconds = chrono::duration<double>(Clock::now() - start).count();
+                ostringstream report;
+                report << fixed << setprecision(1) << all.games() << " of " << config.games
+                       << " games played in " << seconds << " seconds" << endl;
+                string names[2] = { "player 1 (" + config.p1 + ")", "player 2 (" + config.p2 + ")" };
+                all.report(report, names, probe);
+                cerr << report.str() << flush;
+            }
+        });
+    }
+
+    vector<thread> workers;
+    for (int t = 1; t < config.threads; t++)
+    {
+        workers.push_back(thread(worker, t));
+    }
+    worker(0); //this thread does its share too
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+    if (reporter.joinable())
+    {
+        {
+            lock_guard<mutex> lock(doneLock);
+            done = true;
+        }
+        doneChanged.notify_one();
+        reporter.join();
+    }
+    for (size_t t = 0; t < tallies.size(); t++)
+    {
+        total.merge(tallies[t]);
+    }
+    stats = merged();
+    for (size_t t = 0; t < shards.size(); t++)
+    {
+        profile.merge(shards[t]->profile);
+    }
+}
+
+  // The arguments that make a copy of this program play the games
+  // [first, first + games) of config's batch, writing binary output to its
+  // standard output
+static vector<string> workerArgs(const BatchConfig& config, long long first, long long games)
+{
+    vector<string> args;
+    args.push_back("battleship");
+    args.push_back("--batch");
+    args.push_back("--rows");         args.push_back(to_string(config.rows));
+    args.push_back("--cols");         args.push_back(to_string(config.cols));
+    args.push_back("--fleet");        args.push_back(config.fleet);
+    args.push_back("--p1");           args.push_back(config.p1);
+    args.push_back("--p2");           args.push_back(config.p2);
+    args.push_back("--games");        args.push_back(to_string(games));
+    args.push_back("--first");        args.push_back(to_string(first));
+    args.push_back("--seed");         args.push_back(to_string(config.seed));
+    args.push_back("--threads");      args.push_back(to_string(config.threads));
+    args.push_back("--time-limit");   args.push_back(to_string(config.moveTimeLimit));
+    args.push_back("--salvo");        args.push_back(to_string(config.salvo));
+    args.push_back("--output");       args.push_back("binary");
+    args.push_back("--out");          args.push_back("-");
+    return args;
+}
+
+  // Split config's games into config.workers ranges, run a copy of this
+  // program to play each, and gather their records from pipes
+static bool runWorkers(const BatchConfig& config, Gather& g)
+{
+    struct Worker
+    {
+        pid_t pid;
+        int fd;          // the read end of its standard output; -1 once closed
+        PartReader part;
+    };
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    string program = (len > 0 ? string(self, len) : "/proc/self/exe");
+
+    vector<Worker> workers;
+    long long n = min<long long>(config.workers, config.games);
+    bool ok = true;
+    for (long long w = 0; w < n; w++)
+    {
+        long long from = config.games * w / n;
+        long long to = config.games * (w + 1) / n;
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0)
+        {
+            cerr << "Could not start a worker: " << strerror(errno) << endl;
+            ok = false;
+            break;
+        }
+        vector<string> args = workerArgs(config, config.first + from, to - from);
+        vector<char*> argv;
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            argv.push_back(const_cast<char*>(args[i].c_str()));
+        }
+        argv.push_back(nullptr);
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+        pid_t pid;
+        int err = posix_spawn(&pid, program.c_str(), &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        close(fds[1]);
+        if (err != 0)
+        {
+            close(fds[0]);
+            cerr << "Could not start a worker: " << strerror(err) << endl;
+            ok = false;
+            break;
+        }
+        Worker worker;
+        worker.pid = pid;
+        worker.fd = fds[0];
+        workers.push_back(worker);
+    }
+
+      // Take each worker's records as they come, so none of them waits on a
+      // full pipe
+    size_t nOpen = workers.size();
+    char chunk[65536];
+    while (ok && nOpen > 0)
+    {
+        vector<pollfd> pfds;
+        vector<size_t> which;
+        for (size_t w = 0; w < workers.size(); w++)
+        {
+            if (workers[w].fd < 0)
+                continue;
+            pollfd pfd = { workers[w].fd, POLLIN, 0 };
+            pfds.push_back(pfd);
+            which.push_back(w);
+        }
+        if (poll(pfds.data(), pfds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < pfds.size() && ok; i++)
+        {
+            if (pfds[i].revents == 0)
+                continue;
+            Worker& worker = workers[which[i]];
+            ssize_t got = read(worker.fd, chunk, sizeof(chunk));
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got > 0)
+            {
+                worker.part.buf.append(chunk, got);
+                string error;
+                if ( ! worker.part.take(g, error))
+                {
+                    cerr << "Worker " << which[i] + 1 << ": " << error << endl;
+                    ok = false;
+                }
+                continue;
+            }
+            close(worker.fd); //the worker is done, or has failed
+            worker.fd = -1;
+            nOpen--;
+        }
+    }
+
+      // If anything went wrong, the rest of the batch isn't worth playing
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+        if (workers[w].fd >= 0)
+        {
+            close(workers[w].fd);
+            kill(workers[w].pid, SIGTERM);
+        }
+        int status;
+        while (waitpid(workers[w].pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        if (ok && ! (WIFEXITED(status) && WEXITSTATUS(status) == 0))
+        {
+            cerr << "Worker " << w + 1 << " failed" << endl;
+            ok = false;
+        }
+        else if (ok && ! workers[w].part.finished())
+        {
+            cerr << "Worker " << w + 1 << " stopped before sending all its records" << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+  // Gather the records in the binary batch output files config.merge
+static bool mergeParts(const BatchConfig& config, Gather& g)
+{
+    char chunk[65536];
+    for (size_t p = 0; p < config.merge.size(); p++)
+    {
+        const string& path = config.merge[p];
+        ifstream in(path.c_str(), ios::binary);
+        if ( ! in)
+        {
+            cerr << "Could not read " << path << endl;
+            return false;
+        }
+        PartReader part;
+        string error;
+        while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+        {
+            part.buf.append(chunk, size_t(in.gcount()));
+            if ( ! part.take(g, error))
+            {
+                cerr << path << ": " << error << endl;
+                return false;
+            }
+        }
+        if ( ! part.finished())
+        {
+            cerr << path << ": cut short" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+  // How the batch was played, for the summary
+static string howPlayed(const BatchConfig& config)
+{
+    if ( ! config.merge.empty())
+    {
+        size_t n = config.merge.size();
+        return "merged from " + to_string(n) + " part" + (n == 1 ? "" : "s");
+    }
+    string threads = to_string(config.threads) + " thread" + (config.threads == 1 ? "" : "s");
+    if (config.workers == 0)
+        return threads;
+    return to_string(config.workers) + " worker" + (config.workers == 1 ? "" : "s") +
+           " of " + threads;
+}
+
+  // seconds is negative if the games weren't played in this run
+static void writeSummary(ostream& os, const BatchConfig& config, const Tally& t, double seconds)
+{
+    os << fixed << setprecision(2);
+    os << t.games << " games of " << config.p1 << " (player 1) against " << config.p2
+       << " (player 2), seed " << config.seed;
+    if (config.first > 0)
+        os << " from game " << config.first;
+    os << ", " << howPlayed(config) << endl;
+    for (int i = 0; i < 2; i++)
+    {
+        os << "player " << i+1 << ": " << t.wins[i] << " wins ("
+           << (t.games > 0 ? 100.0 * t.wins[i] / t.games : 0.0) << "%), "
+           << (t.wins[i] > 0 ? double(t.winTurns[i]) / t.wins[i] : 0.0) << " turns per win, "
+           << t.overruns[i] << " turns out of time" << endl;
+    }
+    if (t.unplayed > 0)
+        os << t.unplayed << " games couldn't be played" << endl;
+    if (seconds >= 0)
+        os << seconds << " seconds, " << (seconds > 0 ? t.games / seconds : 0.0) << " games per second" << endl;
+}
+
+bool runBatch(const BatchConfig& config)
+{
+    Game probe(config.rows, config.cols);
+    if ( ! setUpGame(probe, config))
+    {
+        cerr << "Bad fleet " << config.fleet << endl;
+        return false;
+    }
+    string types[2] = { config.p1, config.p2 };
+    for (int i = 0; i < 2 && config.merge.empty(); i++)
+    {
+        Player* p = createPlayer(types[i], "probe", probe);
+        if (p == nullptr)
+        {
+            cerr << "No player of type " << types[i] << endl;
+            return false;
+        }
+        delete p;
+    }
+
+    ofstream file;
+    if (config.outPath != "-")
+    {
+        file.open(config.outPath.c_str(), ios::binary | ios::trunc);
+        if ( ! file)
+        {
+            cerr << "Could not write " << config.outPath << endl;
+            return false;
+        }
+    }
+    ostream& os = (config.outPath != "-" ? file : cout);
+
+    bool keepRecords = (config.output != "summary");
+    vector<BatchRecord> records(keepRecords ? config.games : 0);
+    Tally total;
+    Clock::time_point start = Clock::now();
+    vector<ArchiveGame> archived(config.archive.empty() ? 0 : config.games);
+    PlayStats stats(probe.nShips());
+    Profile profile;
+    AsyncWriter log;
+    if ( ! config.log.empty() && ! log.open(config.log))
+    {
+        cerr << "Could not write the log " << config.log << endl;
+        return false;
+    }
+    bool played = (config.workers == 0 && config.merge.empty());
+    TranspositionTable& table = transpositionTable();
+    uint64_t probes = table.probes();
+    uint64_t hits = table.hits();
+    if (played)
+    {
+        playGames(config, probe, records, archived, total, stats, profile, log);
+        probes = table.probes() - probes;
+        hits = table.hits() - hits;
+    }
+    else
+    {
+        Gather g(config, records);
+        if ( ! (config.merge.empty() ? runWorkers(config, g) : mergeParts(config, g)))
+            return false;
+        if (g.nSeen < config.games)
+        {
+            cerr << config.games - g.nSeen << " of the batch's games are missing" << endl;
+            return false;
+        }
+        total = g.total;
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    if ( ! config.merge.empty())
+        seconds = -1;
+    if (log.isOpen() && ! log.close())
+    {
+        cerr << "Could not write the log " << config.log << endl;
+        return false;
+    }
+
+    string names[2] = { "player 1 (" + config.p1 + ")", "player 2 (" + config.p2 + ")" };
+    if (config.output == "summary")
+    {
+        writeSummary(os, config, total, seconds);
+        if (played)
+            stats.report(os, names, probe);
+        if (played && config.profile)
+            profile.report(os, names);
+        if (played && probes > 0)
+            os << "transposition table: " << probes << " probes, " << fixed << setprecision(2)
+               << 100.0 * hits / probes << "% hits" << endl;
+        if ( ! config.log.empty())
+            os << "log: " << log.bytesWritten() << " bytes to " << config.log << ", "
+               << log.stalls() << " waits for the writer" << endl;
+    }
+    else if (config.output == "json")
+    {
+        for (size_t k = 0; k < records.size(); k++)
+        {
+            const BatchRecord& r = records[k];
+            os << "{\"type\":\"game\",\"game\":" << r.game << ",\"seed\":" << r.seed
+               << ",\"first\":" << int(r.first) + 1 << ",\"winner\":";
+            if (r.winner > 1)
+                os << "null";
+            else
+                os << int(r.winner) + 1;
+            os << ",\"turns\":[" << r.turns[0] << "," << r.turns[1] << "]"
+               << ",\"overruns\":[" << r.overruns[0] << "," << r.overruns[1] << "]"
+               << ",\"micros\":" << r.micros << "}\n";
+        }
+        os << "{\"type\":\"summary\",\"p1\":" << jsonString(config.p1)
+           << ",\"p2\":" << jsonString(config.p2) << ",\"games\":" << total.games
+           << ",\"first\":" << config.first << ",\"seed\":" << config.seed
+           << ",\"threads\":" << config.threads << ",\"workers\":" << config.workers
+           << ",\"wins\":[" << total.wins[0] << "," << total.wins[1] << "]"
+           << ",\"winTurns\":[" << total.winTurns[0] << "," << total.winTurns[1] << "]"
+           << ",\"overruns\":[" << total.overruns[0] << "," << total.overruns[1] << "]"
+           << ",\"unplayed\":" << total.unplayed << ",\"seconds\":";
+        if (seconds >= 0)
+            os << seconds;
+        else
+            os << "null";
+        if (played)
+        {
+            os << ",\"stats\":";
+            stats.writeJson(os);
+        }
+        if (played && config.profile)
+        {
+            os << ",\"profile\":";
+            profile.writeJson(os);
+        }
+        if (played)
+            os << ",\"table\":{\"probes\":" << probes << ",\"hits\":" << hits << "}";
+        if ( ! config.log.empty())
+            os << ",\"log\":{\"bytes\":" << log.bytesWritten() << ",\"stalls\":" << log.stalls() << "}";
+        os << "}\n";
+    }
+    else
+    {
+        BatchHeader header;
+        memcpy(header.magic, BATCH_MAGIC, sizeof(BATCH_MAGIC));
+        header.recordSize = sizeof(BatchRecord);
+        header.nRecords = uint32_t(records.size());
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(BatchRecord));
+    }
+    os.flush();
+    if ( ! os)
+    {
+        cerr << "Could not write " << config.outPath << endl;
+        return false;
+    }
+    vector<string> archiveTypes = { config.p1, config.p2 };
+    if ( ! archived.empty() && ! writeArchive(config.archive, probe, archiveTypes, archived, true))
+    {
+        cerr << "Could not add the games to the archive " << config.archive << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef BATCH_INCLUDED
+#define BATCH_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+  // What one game of a batch came to.  Binary output is a BatchHeader
+  // followed by one of these per game, in game order.
+struct BatchRecord
+{
+    std::uint32_t game;         // its index in the batch, from 0
+    std::uint32_t seed;         // given to seedRandom just before the game
+    std::uint8_t first;         // 0 if player 1 fired first, 1 if player 2 did
+    std::uint8_t winner;        // 0 for player 1, 1 for player 2, 2 if no one
+                                // won because a fleet couldn't be placed
+    std::uint16_t turns[2];     // taken by player 1 and player 2
+    std::uint16_t overruns[2];  // turns that ran out of time
+    std::uint16_t unused;
+    std::uint32_t micros;       // how long the game took, placement included
+};
+
+struct BatchHeader
+{
+    char magic[8];              // "BSBATCH1"
+    std::uint32_t recordSize;   // sizeof(BatchRecord)
+    std::uint32_t nRecords;
+};
+
+struct BatchConfig
+{
+    int rows;
+    int cols;
+    std::string fleet;          // ship lengths or shapes, separated by commas
+    std::string p1;             // player types, as for createPlayer
+    std::string p2;
+    long long games;
+    long long first;            // the index of the first game played
+    std::uint32_t seed;         // game k is played after seedRandom(seed + k)
+    int threads;                // in each process
+    int workers;                // processes to spread the games over; 0 to
+                                // play them in this one
+    std::vector<std::string> merge;  // binary outputs of parts of the batch to
+                                // merge instead of playing anything
+    std::string output;         // "summary", "json" or "binary"
+    std::string outPath;        // "-" for standard output
+    std::string archive;        // an archive to add the games to; "" for none
+    std::string log;            // where to write every game's events as text
+                                // as they're played; "" for nowhere
+    int progress;               // seconds between reports on cerr while the
+                                // games are played; 0 for none
+    bool profile;               // whether to read hardware counters around
+                                // each phase of play
+    int moveTimeLimit;          // as for Game::setMoveTimeLimit
+    int salvo;                  // as for Game::setSalvo
+};
+
+  // Set config from the command-line arguments that follow --batch,
+  // leaving the defaults for those not given.  Returns false and sets
+  // error if an argument is wrong.
+bool parseBatchArgs(int argc, char* argv[], BatchConfig& config, std::string& error);
+
+  // What parseBatchArgs accepts, for a usage message
+std::string batchUsage();
+
+  // For parsing and output that --query shares with --batch: whether s is
+  // a whole decimal number from lo to hi, setting n to it if so, and s
+  // quoted as a JSON string
+bool toInt(const char* s, long long lo, long long hi, long long& n);
+std::string jsonString(const std::string& s);
+
+  // Play config's games, with no output but the results and no input at
+  // all.  Returns false, saying why on cerr, if the fleet or a player type
+  // is no good or the output can't be written.
+  //
+  // Since each game's seed depends only on its index, a batch can be
+  // split into ranges of games played by separate processes, here or on
+  // other machines, and their records merged.  With workers set, this
+  // process plays nothing itself: it runs that many copies of the program,
+  // each playing a range, and merges what they send back.  With merge set,
+  // it merges the binary outputs of runs of the ranges instead.  Either
+  // way, the records and totals come out as a single process playing the
+  // whole batch would give, but for the times taken.  Without a time
+  // limit every built-in player bounds its searches by work rather than
+  // the clock, the adaptive player's placement search included, so that
+  // holds for them all; with one, a search may get further on one run
+  // than another, and so may an external engine.
+  //
+  // With archive set, the games are also added to that Archive, which is
+  // made if it isn't there.  With log set, each game's events are written
+  // there, a line each as formatEvent gives them, numbered by game index,
+  // through an AsyncWriter, so the playing threads don't wait on it.
+  //
+  // Games played in this process are also summed up in PlayStats, which
+  // the summary and JSON output include, and which a report on cerr gives
+  // every config.progress seconds as the games go on.  With profile set,
+  // each thread also reads its performance counters around placements,
+  // moves and attacks, and the summary and JSON output say what each
+  // side's phases cost.
+bool runBatch(const BatchConfig& config);
+
+#endif // BATCH_INCLUDED
@@ -17,24 +17,32 @@ class BoardImpl
     void unblock();
     bool placeShip(Point topOrLeft, int shipId, Direction dir);
     bool unplaceShip(Point topOrLeft, int shipId, Direction dir);
+    bool placeShip(int shipId, int placement);
+    bool unplaceShip(int shipId, int placement);
     void display(bool shotsOnly) const;
     bool attack(Point p, bool& shotHit, bool& shipDestroyed, int& shipId);
+    bool attack(const CellSet& shots, CellSet& hits, CellSet& invalid,
+                CellSet& sinks, vector<int>& sunkShipIds);
+    bool undoAttack();
     bool allShipsDestroyed() const;
+    int nShipsAfloat() const;
+    bool isShipCell(Point p) const;
+    BoardSnapshot snapshot() const;
+    void restore(const BoardSnapshot& s);
 
   private:
-    struct ship_des
-    {
-        char symbol;
-        int timesHit;
-        int id;
-    };
-    char m_board[MAXROWS][MAXCOLS];
+    typedef BoardSnapshot::ShipStatus ship_des;
+    int orientationFor(int shipId, Direction dir) const;
+    const CellSet& shipCells(int index) const;
+    void pushUndo(Point p);
+    void removeShip(int index);
+    BoardSnapshot m_state; //all the mutable state, so snapshots are one copy
+    char (&m_board)[MAXROWS][MAXCOLS];
     const Game& m_game;
-    vector<ship_des> ship_desvect;
 };
 
 BoardImpl::BoardImpl(const Game& g)
- : m_game(g)
+ : m_board(m_state.cells), m_game(g)
 {
     clear(); //sets all positions to '.'
 }
@@ -48,6 +56,11 @@ void BoardImpl::clear()
             m_board[i][j] = '.';
         }
     }
+    m_state.occupied.reset();
+    m_state.blocked.reset();
+    m_state.hits.reset();
+    m_state.nShips = 0;
+    m_state.nUndo = 0;
 }
 
 //blocks exactly half of the positions in the board
@@ -61,6 +74,7 @@ void BoardImpl::block()
         if (m_board[rowpos][colpos] == '.')
         {
             m_board[rowpos][colpos] = '-';
+            m_state.blocked.set(cellIndex(Point(rowpos, colpos)));
             counter++;
         }
     }
@@ -80,138 +94,100 @@ void BoardImpl::unblock()
             }
         }
     }
+    m_state.blocked.reset();
+}
+
+//a shaped ship lies in its first orientation for HORIZONTAL, its second for VERTICAL
+int BoardImpl::orientationFor(int shipId, Direction dir) const
+{
+    return (dir == VERTICAL && m_game.nOrientations(shipId) > 1 ? 1 : 0);
+}
+
+const CellSet& BoardImpl::shipCells(int index) const
+{
+    return m_game.placements(m_state.ships[index].id)[m_state.ships[index].placement];
 }
 
 bool BoardImpl::placeShip(Point topOrLeft, int shipId, Direction dir)
 {
-    if (shipId > m_game.nShips())
+    if (shipId < 0 || shipId >= m_game.nShips())
+    {
+        return false;
+    }
+    return placeShip(shipId, m_game.placementAt(shipId, topOrLeft, orientationFor(shipId, dir)));
+}
+
+bool BoardImpl::placeShip(int shipId, int placement)
+{
+    if (shipId < 0 || shipId >= m_game.nShips())
     {
         return false;
     }
-    if (m_game.isValid(topOrLeft) == false)
+    if (placement < 0 || placement >= int(m_game.placements(shipId).size())) //doesn't fit on the board
     {
         return false;
     }
-    for (int i = 0; i < ship_desvect.size(); i++)
+    for (int i = 0; i < m_state.nShips; i++)
     {
-        if (ship_desvect[i].id == shipId) //checks if the id for the ship has already been placed
+        if (m_state.ships[i].id == shipId) //checks if the id for the ship has already been placed
         {
             return false;
         }
     }
+    const CellSet& cells = m_game.placements(shipId)[placement];
+    if ((cells & (m_state.occupied | m_state.blocked)).any()) //checks if any position has been taken already
+    {
+        return false;
+    }
     
     //since ship is valid, iniitialize the members of that ship
     ship_des temp;
     temp.symbol = m_game.shipSymbol(shipId);
-    temp.timesHit = 0;
     temp.id = shipId;
-    
-    
-    if (dir == HORIZONTAL)
+    temp.placement = placement;
+    for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
     {
-        if (topOrLeft.c + m_game.shipLength(shipId) > m_game.cols()) //checks if the whole ship can fit horizontally on the board
+        if (cells.test(cell))
         {
-            return false;
-        }
-        for (int i = 0; i < m_game.shipLength(shipId); i++)
-        {
-            if (m_board[topOrLeft.r][topOrLeft.c + i] != '.') //checks if position has been taken already
-            {
-                return false;
-            }
-        }
-        for (int i = 0; i < m_game.shipLength(shipId); i++)
-        {
-            m_board[topOrLeft.r][topOrLeft.c + i] = m_game.shipSymbol(shipId); //adds ship to board
+            Point p = cellPoint(cell);
+            m_board[p.r][p.c] = temp.symbol; //adds ship to board
         }
     }
-    else //dir == VERTICAL
-    {
-        if (topOrLeft.r + m_game.shipLength(shipId) > m_game.rows()) //checks if the whole ship can fit vertically on the board
-        {
-            return false;
-        }
-        for (int i = 0; i < m_game.shipLength(shipId); i++)
-        {
-            if (m_board[topOrLeft.r + i][topOrLeft.c] != '.') //checks if position has been taken already
-            {
-                return false;
-            }
-        }
-        for (int i = 0; i < m_game.shipLength(shipId); i++)
-        {
-            m_board[topOrLeft.r + i][topOrLeft.c] = m_game.shipSymbol(shipId); //adds ship to board
-        }
-    }
-    ship_desvect.push_back(temp); //adds ship to ship vector
+    m_state.occupied |= cells;
+    m_state.ships[m_state.nShips++] = temp; //adds ship to ship array
     return true;
 }
 
-
 bool BoardImpl::unplaceShip(Point topOrLeft, int shipId, Direction dir)
 {
-    if (m_game.isValid(topOrLeft) == false)
-    {
-        return false;
-    }
-    bool exists = false;
-    int index = 0;
-    for (int i = 0; i < ship_desvect.size(); i++)
-    {
-        if (ship_desvect[i].id == shipId) //checks to see if the shipId already exists in the ship vector
-        {
-            exists = true;
-            index = i;
-            
-        }
-    }
-    if (exists == false)
+    if (shipId < 0 || shipId >= m_game.nShips())
     {
         return false;
     }
-    
-    if (dir == HORIZONTAL)
-    {
-        if (topOrLeft.c + m_game.shipLength(shipId) > m_game.cols()) //check if orientation of points is valid
-        {
-            return false;
-        }
-        for (int i =0; i < m_game.shipLength(shipId); i++)
-        {
-            if (m_board[topOrLeft.r][topOrLeft.c+i] != m_game.shipSymbol(shipId)) //checks if correct ship symbol
-            {
-                return false;
-            }
-        }
-        
-        for (int i =0; i < m_game.shipLength(shipId); i++)
-        {
-            m_board[topOrLeft.r][topOrLeft.c+i] = '.'; //erases the ship from the board
-        }
-        ship_desvect.erase(ship_desvect.begin() + index); // removes ship from ship vector
-    }
-    else //dir == VERTICAL
+    return unplaceShip(shipId, m_game.placementAt(shipId, topOrLeft, orientationFor(shipId, dir)));
+}
+
+bool BoardImpl::unplaceShip(int shipId, int placement)
+{
+    for (int i = 0; i < m_state.nShips; i++)
     {
-        if (topOrLeft.r + m_game.shipLength(shipId) > m_game.rows()) //if orientation of points is valid
+        if (m_state.ships[i].id == shipId && m_state.ships[i].placement == placement) //the ship must be exactly there
         {
-            return false;
-        }
-        for (int i =0; i < m_game.shipLength(shipId); i++)
-        {
-            if (m_board[topOrLeft.r+i][topOrLeft.c] != m_game.shipSymbol(shipId))
+            const CellSet& cells = shipCells(i);
+            for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
             {
-                return false;
+                if (cells.test(cell))
+                {
+                    Point p = cellPoint(cell);
+                    m_board[p.r][p.c] = '.'; //erases the ship from the board
+                }
             }
+            m_state.occupied &= ~cells;
+            removeShip(i); // removes ship from ship array
+            return true;
         }
-        
-        for (int i =0; i < m_game.shipLength(shipId); i++)
-        {
-            m_board[topOrLeft.r+i][topOrLeft.c] = '.';
-        }
-        ship_desvect.erase(ship_desvect.begin() + index); //removes the ship from the ship vector
     }
-    
-    return true;
+    return false;
 }
 
  
@@ -258,48 +234,150 @@ bool BoardImpl::attack(Point p, bool& shotHit, bool& shipDestroyed, int& shipId)
         return false;
     }
     
-    else if (m_board[p.r][p.c] != '.') // if it is an undamaged part of a ship like 'A'
+    else if (m_state.occupied.test(cellIndex(p))) // if it is an undamaged part of a ship like 'A'
     {
         int id_index = 100;
         shotHit = true;
         
-        for (int i = 0; i < ship_desvect.size(); i++)
+        for (int i = 0; i < m_state.nShips; i++)
         {
-            if (m_game.shipSymbol(ship_desvect[i].id) == m_board[p.r][p.c]) //checks if correct ship symbol at Point p on board
+            if (m_state.ships[i].symbol == m_board[p.r][p.c]) //checks if correct ship symbol at Point p on board
             {
                 id_index = i;
                 break;
             }
         }
         
+        pushUndo(p);
         m_board[p.r][p.c] = 'X'; //set the ship point to damaged
-        ship_desvect[id_index].timesHit += 1;
+        m_state.hits.set(cellIndex(p));
         
-        if (ship_desvect[id_index].timesHit == m_game.shipLength(id_index)) //if entire ship is destroyed
+        if ((shipCells(id_index) & ~m_state.hits).none()) //if entire ship is destroyed
         {
             shipDestroyed = true;
-            shipId = ship_desvect[id_index].id; //sets shipId when ship is destroyed
+            shipId = m_state.ships[id_index].id; //sets shipId when ship is destroyed
         }
     }
     else{ //if the valid shot missed
+        pushUndo(p);
         m_board[p.r][p.c] = 'o';
     }
     
     return true;
 }
 
-bool BoardImpl::allShipsDestroyed() const
+//fires a whole salvo in one pass over the board
+bool BoardImpl::attack(const CellSet& shots, CellSet& hits, CellSet& invalid,
+                       CellSet& sinks, vector<int>& sunkShipIds)
 {
-    for (int i = 0; i < ship_desvect.size(); i++)
+    hits.reset();
+    invalid.reset();
+    sinks.reset();
+    sunkShipIds.clear();
+    
+    signed char shipIndex[256]; //ship symbol -> index into m_state.ships, looked up once
+    for (int i = 0; i < 256; i++)
+    {
+        shipIndex[i] = -1;
+    }
+    for (int i = 0; i < m_state.nShips; i++)
     {
-        if (ship_desvect[i].timesHit != m_game.shipLength(i)) //if one not sunk...
+        shipIndex[(unsigned char)m_state.ships[i].symbol] = i;
+    }
+    
+    bool anyValid = false;
+    for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+    {
+        if ( ! shots.test(cell))
+            continue;
+        Point p = cellPoint(cell);
+        if (m_game.isValid(p) == false || m_board[p.r][p.c] == 'X' || m_board[p.r][p.c] == 'o')
         {
-            return false;
+            invalid.set(cell);
+            continue;
+        }
+        anyValid = true;
+        int index = shipIndex[(unsigned char)m_board[p.r][p.c]];
+        pushUndo(p);
+        if ( ! m_state.occupied.test(cell)) //missed
+        {
+            m_board[p.r][p.c] = 'o';
+            continue;
+        }
+        hits.set(cell);
+        m_board[p.r][p.c] = 'X';
+        m_state.hits.set(cell);
+        if ((shipCells(index) & ~m_state.hits).none())
+        {
+            sinks.set(cell);
+            sunkShipIds.push_back(m_state.ships[index].id);
         }
     }
+    return anyValid;
+}
+
+//takes back the most recent valid attack; false if there is none
+bool BoardImpl::undoAttack()
+{
+    if (m_state.nUndo == 0)
+    {
+        return false;
+    }
+    const BoardSnapshot::AttackRecord& rec = m_state.undo[--m_state.nUndo];
+    m_board[rec.r][rec.c] = rec.previous;
+    m_state.hits.reset(cellIndex(Point(rec.r, rec.c)));
     return true;
 }
 
+void BoardImpl::pushUndo(Point p)
+{
+    BoardSnapshot::AttackRecord& rec = m_state.undo[m_state.nUndo++];
+    rec.r = p.r;
+    rec.c = p.c;
+    rec.previous = m_board[p.r][p.c];
+}
+
+void BoardImpl::removeShip(int index)
+{
+    for (int i = index; i + 1 < m_state.nShips; i++)
+    {
+        m_state.ships[i] = m_state.ships[i+1];
+    }
+    m_state.nShips--;
+}
+
+bool BoardImpl::allShipsDestroyed() const
+{
+    return (m_state.occupied & ~m_state.hits).none(); //no ship cell left unhit
+}
+
+int BoardImpl::nShipsAfloat() const
+{
+    int n = 0;
+    for (int i = 0; i < m_state.nShips; i++)
+    {
+        if ((shipCells(i) & ~m_state.hits).any())
+            n++;
+    }
+    return n;
+}
+
+//true if some ship occupies Point p, whether or not it has been hit there
+bool BoardImpl::isShipCell(Point p) const
+{
+    return m_game.isValid(p) && m_state.occupied.test(cellIndex(p));
+}
+
+BoardSnapshot BoardImpl::snapshot() const
+{
+    return m_state;
+}
+
+void BoardImpl::restore(const BoardSnapshot& s)
+{
+    m_state = s;
+}
+
 //******************** Board functions ********************************
 
 // These functions simply delegate to BoardImpl's functions.
@@ -350,7 +428,48 @@ bool Board::attack(Point p, bool& shotHit, bool& shipDestroyed, int& shipId)
     return m_impl->attack(p, shotHit, shipDestroyed, shipId);
 }
 
+bool Board::attack(const CellSet& shots, CellSet& hits, CellSet& invalid,
+                   CellSet& sinks, vector<int>& sunkShipIds)
+{
+    return m_impl->attack(shots, hits, invalid, sinks, sunkShipIds);
+}
+
+bool Board::placeShip(int shipId, int placement)
+{
+    return m_impl->placeShip(shipId, placement);
+}
+
+bool Board::unplaceShip(int shipId, int placement)
+{
+    return m_impl->unplaceShip(shipId, placement);
+}
+
+bool Board::undoAttack()
+{
+    return m_impl->undoAttack();
+}
+
 bool Board::allShipsDestroyed() const
 {
     return m_impl->allShipsDestroyed();
 }
+
+int Board::nShipsAfloat() const
+{
+    return m_impl->nShipsAfloat();
+}
+
+bool Board::isShipCell(Point p) const
+{
+    return m_impl->isShipCell(p);
+}
+
+BoardSnapshot Board::snapshot() const
+{
+    return m_impl->snapshot();
+}
+
+void Board::restore(const BoardSnapshot& s)
+{
+    m_impl->restore(s);
+}
@@ -2,10 +2,39 @@
 #define BOARD_INCLUDED
 
 #include "globals.h"
+#include <vector>
 
 class Game;
 class BoardImpl;
 
+const int MAXSHIPS = MAXROWS*MAXCOLS;  // every ship takes at least one cell
+
+  // Everything a Board records, including its attack undo stack.  It holds
+  // no pointers, so saving or restoring it is one fixed-size copy.
+struct BoardSnapshot
+{
+    struct ShipStatus
+    {
+        char symbol;
+        unsigned char id;
+        unsigned short placement;  // index into the game's placements of the ship
+    };
+    struct AttackRecord
+    {
+        unsigned char r;
+        unsigned char c;
+        char previous;           // what the cell held before the attack
+    };
+    char cells[MAXROWS][MAXCOLS];
+    CellSet occupied;            // cells under some ship
+    CellSet blocked;             // cells block() has set aside
+    CellSet hits;                // ship cells attacked
+    ShipStatus ships[MAXSHIPS];
+    int nShips;
+    AttackRecord undo[MAXROWS*MAXCOLS];  // each cell is validly attacked at most once
+    int nUndo;
+};
+
 class Board
 {
   public:
@@ -16,9 +45,26 @@ class Board
     void unblock();
     bool placeShip(Point topOrLeft, int shipId, Direction dir);
     bool unplaceShip(Point topOrLeft, int shipId, Direction dir);
+      // The same by index into Game::placements(shipId), for ships of any
+      // shape.  placeShip(Point, ...) puts a shaped ship in orientation 0
+      // for HORIZONTAL and 1 for VERTICAL.
+    bool placeShip(int shipId, int placement);
+    bool unplaceShip(int shipId, int placement);
     void display(bool shotsOnly) const;
     bool attack(Point p, bool& shotHit, bool& shipDestroyed, int& shipId);
+      // Fire every shot in shots at once, taking them in increasing cell
+      // index order.  invalid gets the shots off the board or at cells
+      // already attacked, hits those that hit, and sinks those that sank a
+      // ship; sunkShipIds lists the ships sunk, in the order of sinks.
+      // Returns false if no shot was valid.
+    bool attack(const CellSet& shots, CellSet& hits, CellSet& invalid,
+                CellSet& sinks, std::vector<int>& sunkShipIds);
+    bool undoAttack();
     bool allShipsDestroyed() const;
+    int nShipsAfloat() const;
+    bool isShipCell(Point p) const;
+    BoardSnapshot snapshot() const;
+    void restore(const BoardSnapshot& s);
       // We prevent a Board object from being copied or assigned
     Board(const Board&) = delete;
     Board& operator=(const Board&) = delete;
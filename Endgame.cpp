@@ -0,0 +1,484 @@
+#include "Endgame.h"
+#include "Game.h"
+#include "Knowledge.h"
+#include "globals.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+//*********************************************************************
+//  Budget
+//*********************************************************************
+
+  // What a search may still do: until the deadline, if there is one, and
+  // no more than the work limit, which with no deadline is ENDGAME_WORK
+  // unless the caller gives its own.  The clock is only read every so
+  // often.
+class Budget
+{
+  public:
+    Budget(Clock::time_point deadline, const atomic<long>* workLimit);
+      // Charge n units of work; false once the search must stop
+    bool spend(long n);
+    bool spent() const;
+
+  private:
+    Clock::time_point m_deadline;
+    const atomic<long>* m_workLimit;  // nullptr for the default
+    long m_work;        // done so far
+    long m_nextCheck;   // when to read the clock next
+    bool m_spent;
+};
+
+const long WORK_PER_CLOCK_CHECK = 256;
+
+Budget::Budget(Clock::time_point deadline, const atomic<long>* workLimit)
+ : m_deadline(deadline), m_workLimit(workLimit), m_work(0), m_nextCheck(0), m_spent(false)
+{}
+
+bool Budget::spend(long n)
+{
+    if (m_spent)
+        return false;
+    m_work += n;
+    bool timed = (m_deadline != Clock::time_point::max());
+    if (m_workLimit != nullptr)
+        m_spent = (m_work > m_workLimit->load(memory_order_relaxed));
+    else if ( ! timed)
+        m_spent = (m_work > ENDGAME_WORK);
+    if ( ! m_spent && timed && m_work >= m_nextCheck)
+    {
+        m_nextCheck = m_work + WORK_PER_CLOCK_CHECK;
+        m_spent = (Clock::now() >= m_deadline);
+    }
+    return ! m_spent;
+}
+
+bool Budget::spent() const
+{
+    return m_spent;
+}
+
+  // One consistent layout, reduced to what's left to shoot: for each ship
+  // the cells of it not yet hit.  Layouts that leave the same cells are
+  // merged, with weight counting how many there were.
+struct EndLayout
+{
+    vector<CellSet> remaining;  // per ship; empty for sunk ships
+    CellSet all;                // union of remaining
+    int weight;
+};
+
+//*********************************************************************
+//  Enumerating the consistent layouts
+//*********************************************************************
+
+class Enumerator
+{
+  public:
+    Enumerator(const Knowledge& k, const vector<int>& order,
+               const vector<vector<const Knowledge::Placement*> >& options,
+               int limit, Budget& budget);
+    void run();
+      // Whether there were more than the limit, or the budget ran out
+    bool overLimit() const;
+    vector<vector<CellSet> > layouts;  // per layout, per ship: its cells
+
+  private:
+    void place(size_t depth, const CellSet& occupied);
+
+    const Knowledge& m_k;
+    const vector<int>& m_order;
+    const vector<vector<const Knowledge::Placement*> >& m_options;
+    vector<int> m_lengthsLeft;  // total length of ships order[depth..]
+    vector<CellSet> m_chosen;   // per ship id
+    int m_limit;
+    Budget& m_budget;
+    bool m_stopped;
+};
+
+Enumerator::Enumerator(const Knowledge& k, const vector<int>& order,
+                       const vector<vector<const Knowledge::Placement*> >& options,
+                       int limit, Budget& budget)
+ : m_k(k), m_order(order), m_options(options), m_lengthsLeft(order.size() + 1, 0),
+   m_chosen(k.game().nShips()), m_limit(limit), m_budget(budget), m_stopped(false)
+{
+    for (int d = int(order.size()) - 1; d >= 0; d--)
+    {
+        m_lengthsLeft[d] = m_lengthsLeft[d+1] + k.game().shipLength(order[d]);
+    }
+}
+
+void Enumerator::run()
+{
+    if ( ! m_order.empty())
+        place(0, CellSet());
+}
+
+bool Enumerator::overLimit() const
+{
+    return m_stopped;
+}
+
+void Enumerator::place(size_t depth, const CellSet& occupied)
+{
+    if ( ! m_budget.spend(1))
+    {
+        m_stopped = true; //out of time counts as too many
+        return;
+    }
+    size_t uncovered = (m_k.hits() & ~occupied).count();
+    if (uncovered > size_t(m_lengthsLeft[depth])) //the other ships can't cover every hit
+        return;
+    if (depth == m_order.size())
+    {
+        if (uncovered == 0)
+        {
+            layouts.push_back(m_chosen);
+            if (int(layouts.size()) > m_limit)
+                m_stopped = true;
+        }
+        return;
+    }
+    const vector<const Knowledge::Placement*>& opts = m_options[depth];
+    for (size_t i = 0; i < opts.size() && !m_stopped; i++)
+    {
+        if ((opts[i]->mask & occupied).any())
+            continue;
+        m_chosen[m_order[depth]] = opts[i]->mask;
+        place(depth + 1, occupied | opts[i]->mask);
+    }
+}
+
+  // Every layout consistent with k, merged by what each leaves to shoot;
+  // false if there are more than limit or the budget runs out first
+bool enumerateLayouts(const Knowledge& k, int limit, Budget& budget,
+                      vector<EndLayout>& result)
+{
+    const Game& g = k.game();
+    CellSet misses = k.misses();
+    CellSet hits = k.hits();
+
+      // What each ship could be: a sunk ship lies wholly on hits through
+      // its sinking shot; a ship afloat avoids misses and isn't all hit
+    vector<vector<const Knowledge::Placement*> > byShip(g.nShips());
+    for (int s = 0; s < g.nShips(); s++)
+    {
+        const vector<Knowledge::Placement>& pls = k.placements(s);
+        for (size_t i = 0; i < pls.size(); i++)
+        {
+            const CellSet& m = pls[i].mask;
+            bool ok = k.isSunk(s) ? (m.test(cellIndex(k.sinkPoint(s))) && (m & ~hits).none())
+                                  : ((m & misses).none() && (m & ~hits).any());
+            if (ok)
+                byShip[s].push_back(&pls[i]);
+        }
+        if (byShip[s].empty())
+            return false; //knowledge contradicts the fleet; leave it to the heuristic
+    }
+
+      // Most constrained ships first keeps the search tree narrow
+    vector<int> order;
+    for (int s = 0; s < g.nShips(); s++)
+        order.push_back(s);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return byShip[a].size() < byShip[b].size();
+    });
+    vector<vector<const Knowledge::Placement*> > options;
+    for (size_t d = 0; d < order.size(); d++)
+        options.push_back(byShip[order[d]]);
+
+    Enumerator e(k, order, options, limit, budget);
+    e.run();
+    if (e.overLimit())
+        return false;
+
+    unordered_map<size_t, vector<int> > seen; //hash of remaining cells -> result indexes
+    for (size_t i = 0; i < e.layouts.size(); i++)
+    {
+        EndLayout el;
+        el.weight = 1;
+        size_t h = 0;
+        for (int s = 0; s < g.nShips(); s++)
+        {
+            el.remaining.push_back(e.layouts[i][s] & ~hits);
+            el.all |= el.remaining.back();
+            h = h * 31 + std::hash<CellSet>()(el.remaining.back());
+        }
+        vector<int>& bucket = seen[h];
+        bool merged = false;
+        for (size_t j = 0; j < bucket.size() && !merged; j++)
+        {
+            if (result[bucket[j]].remaining == el.remaining)
+            {
+                result[bucket[j]].weight++;
+                merged = true;
+            }
+        }
+        if ( ! merged)
+        {
+            bucket.push_back(result.size());
+            result.push_back(el);
+        }
+    }
+    return ! result.empty();
+}
+
+//*********************************************************************
+//  Expected shots to finish
+//*********************************************************************
+
+  // Positions remembered by the solver.  A fixed table, overwritten on
+  // collision, keeps the cost of a search's memory bounded and lets it be
+  // freed in one go, which matters when the move's deadline is close.
+const int MEMO_SIZE = 1 << 13;
+
+struct MemoEntry
+{
+    size_t key; //0 if empty
+    double value;
+};
+
+class Solver
+{
+  public:
+    Solver(int nShips, Budget& budget)
+     : m_nShips(nShips), m_budget(budget), m_timedOut(false), m_estimated(false),
+       m_memo(MEMO_SIZE, MemoEntry{0, 0}) {}
+      // Expected shots to sink what's left in S, looking depth shots ahead
+      // and estimating beyond that; sets bestCell at the top
+    double solve(const vector<EndLayout>& S, int depth, int* bestCell);
+    bool timedOut() const { return m_timedOut; }
+      // Whether any line was cut off by depth, so deeper could do better
+    bool estimated() const { return m_estimated; }
+
+  private:
+    static double lowerBound(const vector<EndLayout>& S);
+    int outcomeOf(const EndLayout& el, int c) const;
+    size_t key(const vector<EndLayout>& S, int depth) const;
+
+    int m_nShips;
+    Budget& m_budget;
+    bool m_timedOut;
+    bool m_estimated;
+    vector<MemoEntry> m_memo;
+};
+
+  // Every layout needs at least as many shots as it has cells left, so the
+  // weighted mean of those counts never overestimates
+double Solver::lowerBound(const vector<EndLayout>& S)
+{
+    double total = 0;
+    double weight = 0;
+    for (size_t i = 0; i < S.size(); i++)
+    {
+        total += double(S[i].weight) * S[i].all.count();
+        weight += S[i].weight;
+    }
+    return weight == 0 ? 0 : total / weight;
+}
+
+  // 0 if shooting c misses layout el, 1 if it hits, or 2+s if it sinks ship s
+int Solver::outcomeOf(const EndLayout& el, int c) const
+{
+    if ( ! el.all.test(c))
+        return 0;
+    for (int s = 0; s < m_nShips; s++)
+    {
+        if (el.remaining[s].test(c))
+            return el.remaining[s].count() == 1 ? 2 + s : 1;
+    }
+    return 1;
+}
+
+size_t Solver::key(const vector<EndLayout>& S, int depth) const
+{
+    size_t h = size_t(depth) * 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < S.size(); i++) //order doesn't matter
+    {
+        size_t hi = size_t(S[i].weight);
+        for (int s = 0; s < m_nShips; s++)
+            hi = hi * 1000003 + std::hash<CellSet>()(S[i].remaining[s]);
+        h += hi * 0xBF58476D1CE4E5B9ULL + (hi >> 29);
+    }
+    return h;
+}
+
+double Solver::solve(const vector<EndLayout>& S, int depth, int* bestCell)
+{
+    if (S.size() == 1 && bestCell == nullptr) //nothing left to learn
+        return double(S[0].all.count());
+    if (depth == 0)
+    {
+        m_estimated = true;
+        return lowerBound(S);
+    }
+    if (m_timedOut)
+        return lowerBound(S);
+
+    size_t memoKey = 0;
+    if (bestCell == nullptr)
+    {
+        memoKey = key(S, depth);
+        const MemoEntry& e = m_memo[memoKey & (MEMO_SIZE - 1)];
+        if (e.key == memoKey && memoKey != 0)
+            return e.value;
+    }
+
+      // Try the cells most likely to hit first so good answers come early
+    CellSet candidates;
+    double total = 0;
+    vector<double> hitWeight(MAXROWS*MAXCOLS, 0.0);
+    for (size_t i = 0; i < S.size(); i++)
+    {
+        candidates |= S[i].all;
+        total += S[i].weight;
+        for (int c = 0; c < MAXROWS*MAXCOLS; c++)
+        {
+            if (S[i].all.test(c))
+                hitWeight[c] += S[i].weight;
+        }
+    }
+    vector<int> cells;
+    for (int c = 0; c < MAXROWS*MAXCOLS; c++)
+    {
+        if (candidates.test(c))
+            cells.push_back(c);
+    }
+    stable_sort(cells.begin(), cells.end(), [&](int a, int b) {
+        return hitWeight[a] > hitWeight[b];
+    });
+
+    double best = 1e18;
+    vector<double> weight(2 + m_nShips);
+    vector<double> cellsLeft(2 + m_nShips);
+    vector<int> count(2 + m_nShips);
+    for (size_t ci = 0; ci < cells.size(); ci++)
+    {
+        if ( ! m_budget.spend(long(S.size()))) //each cell tried looks at every layout
+        {
+            m_timedOut = true;
+            break;
+        }
+        int c = cells[ci];
+
+          // Shooting c reveals a miss, a hit, or the sinking of a particular
+          // ship.  First bound the outcome from below without copying
+          // anything; only promising cells are worth splitting S over.
+        fill(weight.begin(), weight.end(), 0.0);
+        fill(cellsLeft.begin(), cellsLeft.end(), 0.0);
+        fill(count.begin(), count.end(), 0);
+        for (size_t i = 0; i < S.size(); i++)
+        {
+            int outcome = outcomeOf(S[i], c);
+            size_t left = S[i].all.count() - (outcome > 0 ? 1 : 0);
+            if (left > 0) //finished layouts need no more shots
+            {
+                weight[outcome] += S[i].weight;
+                cellsLeft[outcome] += double(S[i].weight) * left;
+                count[outcome]++;
+            }
+        }
+        double expected = 1;
+        bool exact = true;
+        for (size_t o = 0; o < weight.size(); o++)
+        {
+            expected += cellsLeft[o] / total;
+            if (count[o] > 1)
+                exact = false;
+        }
+        if (expected >= best) //can't beat what we have even at best
+            continue;
+
+        if ( ! exact && depth == 1)
+        {
+            m_estimated = true;
+        }
+        else if ( ! exact)
+        {
+            vector<vector<EndLayout> > outcomes(2 + m_nShips);
+            for (size_t i = 0; i < S.size(); i++)
+            {
+                int outcome = outcomeOf(S[i], c);
+                EndLayout el = S[i];
+                if (outcome > 0)
+                {
+                    el.all.reset(c);
+                    for (int s = 0; s < m_nShips; s++)
+                        el.remaining[s].reset(c);
+                }
+                if (el.all.any())
+                    outcomes[outcome].push_back(el);
+            }
+            expected = 1;
+            for (size_t o = 0; o < outcomes.size() && expected < best; o++)
+            {
+                if (weight[o] > 0)
+                    expected += weight[o] / total * solve(outcomes[o], depth - 1, nullptr);
+            }
+        }
+        if (expected < best)
+        {
+            best = expected;
+            if (bestCell != nullptr)
+                *bestCell = c;
+        }
+    }
+    if ( ! m_timedOut && bestCell == nullptr)
+        m_memo[memoKey & (MEMO_SIZE - 1)] = MemoEntry{memoKey, best};
+    return best;
+}
+
+}  // namespace
+
+bool endgameShot(const Knowledge& k, Clock::time_point deadline, Point& shot,
+                 int maxLayouts, bool* complete, const atomic<long>* workLimit)
+{
+    Budget budget(deadline, workLimit);
+    vector<EndLayout> layouts;
+    if ( ! enumerateLayouts(k, maxLayouts, budget, layouts))
+    {
+        if (complete != nullptr)
+            *complete = ! budget.spent();
+        return false;
+    }
+
+      // Until some search finishes, the answer is the cell most likely to hit
+    vector<double> hitWeight(MAXROWS*MAXCOLS, 0.0);
+    int depthLimit = 0;
+    for (size_t i = 0; i < layouts.size(); i++)
+    {
+        depthLimit = max(depthLimit, int(layouts[i].all.count()));
+        for (int c = 0; c < MAXROWS*MAXCOLS; c++)
+        {
+            if (layouts[i].all.test(c))
+                hitWeight[c] += layouts[i].weight;
+        }
+    }
+    int best = int(max_element(hitWeight.begin(), hitWeight.end()) - hitWeight.begin());
+
+      // Deepen one shot at a time; a search cut short by the budget is
+      // discarded
+    for (int depth = 1; depth <= depthLimit && ! budget.spent(); depth++)
+    {
+        Solver solver(k.game().nShips(), budget);
+        int cell = -1;
+        solver.solve(layouts, depth, &cell);
+        if (solver.timedOut() || cell < 0)
+            break;
+        best = cell;
+        if ( ! solver.estimated()) //the search was exact; deeper can't change it
+            break;
+    }
+    shot = cellPoint(best);
+    if (complete != nullptr)
+        *complete = ! budget.spent();
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef ENDGAME_INCLUDED
+#define ENDGAME_INCLUDED
+
+#include "globals.h"
+#include <atomic>
+
+class Knowledge;
+
+  // How much an endgame search may do when the game sets no deadline, in
+  // search nodes and layouts examined: a few milliseconds' worth
+const long ENDGAME_WORK = 200000;
+
+  // Exact endgame play.  If no more than maxLayouts fleet layouts agree
+  // with k, enumerate them all and set shot to the cell that minimizes the
+  // expected number of shots still needed to sink the whole fleet,
+  // searching deeper until the deadline and answering with the best shot
+  // found so far.  With no deadline (Clock::time_point::max()) the search
+  // stops after ENDGAME_WORK instead, so that the same knowledge always
+  // gets the same shot.  Returns false, leaving shot alone, if there are
+  // too many layouts to enumerate in time; the caller then keeps using
+  // its own heuristic.  If complete isn't nullptr, it's set to whether
+  // the search ran to its end rather than being cut short, in which case
+  // the outcome would be the same however long it had been given.  If
+  // workLimit isn't nullptr, it replaces ENDGAME_WORK, and another thread
+  // may change it while the search runs: pondering starts with no limit,
+  // then lowers it once the answer is wanted, or to 0 to stop at once.
+  // The search runs on the calling thread.
+bool endgameShot(const Knowledge& k, Clock::time_point deadline, Point& shot,
+                 int maxLayouts = 1000, bool* complete = nullptr,
+                 const std::atomic<long>* workLimit = nullptr);
+
+#endif // ENDGAME_INCLUDED
@@ -0,0 +1,232 @@
+#include "Engine.h"
+#include "globals.h"
+#include <cerrno>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern char** environ;
+
+const int ENGINE_START_MS = 5000;   // to answer the greeting
+const int ENGINE_HANG_MS = 60000;   // to answer anything, when there's no deadline
+
+  // The engines released and waiting for reuse.  Those still waiting when
+  // the program ends are told to quit.
+struct EnginePool
+{
+    mutex lock;
+    multimap<string, Engine*> idle;
+    ~EnginePool()
+    {
+        for (multimap<string, Engine*>::iterator p = idle.begin(); p != idle.end(); p++)
+        {
+            p->second->tell("quit");
+            p->second->flush();
+            delete p->second;
+        }
+    }
+};
+
+static EnginePool& enginePool()
+{
+    static EnginePool pool;
+    return pool;
+}
+
+Engine::Engine(string command, pid_t pid, int fd)
+ : m_command(command), m_pid(pid), m_fd(fd), m_unanswered(0), m_failed(false)
+{}
+
+Engine::~Engine()
+{
+    close(m_fd); //the engine sees end of input
+    for (int waited = 0; waited < 100; waited++)
+    {
+        if (waitpid(m_pid, nullptr, WNOHANG) != 0)
+            return;
+        usleep(1000);
+    }
+    kill(m_pid, SIGKILL); //it had its chance
+    waitpid(m_pid, nullptr, 0);
+}
+
+Engine* Engine::acquire(string command)
+{
+    EnginePool& pool = enginePool();
+    {
+        lock_guard<mutex> guard(pool.lock);
+        multimap<string, Engine*>::iterator p = pool.idle.find(command);
+        if (p != pool.idle.end())
+        {
+            Engine* e = p->second;
+            pool.idle.erase(p);
+            return e;
+        }
+    }
+
+      // A socket rather than a pair of pipes, so that writing to an engine
+      // that has died fails instead of raising SIGPIPE
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0)
+    {
+        return nullptr;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], 0);
+    posix_spawn_file_actions_adddup2(&actions, sv[1], 1);
+    const char* argv[] = { "sh", "-c", command.c_str(), nullptr };
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", &actions, nullptr,
+                          const_cast<char* const*>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(sv[1]);
+    if (err != 0)
+    {
+        close(sv[0]);
+        return nullptr;
+    }
+
+    Engine* e = new Engine(command, pid, sv[0]);
+    string reply;
+    if ( ! e->ask("battleship", Clock::now() + chrono::milliseconds(ENGINE_START_MS), reply) ||
+         reply != "ready")
+    {
+        delete e;
+        return nullptr;
+    }
+    return e;
+}
+
+void Engine::release(Engine* e)
+{
+    if (e == nullptr)
+    {
+        return;
+    }
+    if (e->m_failed)
+    {
+        delete e;
+        return;
+    }
+    e->m_out.clear(); //news of the last game is no use to the next
+    EnginePool& pool = enginePool();
+    lock_guard<mutex> guard(pool.lock);
+    pool.idle.insert(make_pair(e->m_command, e));
+}
+
+void Engine::tell(const string& line)
+{
+    m_out += line;
+    m_out += '\n';
+}
+
+bool Engine::ask(const string& line, Clock::time_point deadline, string& reply)
+{
+    if (m_failed)
+    {
+        return false;
+    }
+    tell(line);
+    if ( ! flush())
+    {
+        return false;
+    }
+
+    bool hasDeadline = (deadline != Clock::time_point::max());
+    if ( ! hasDeadline)
+        deadline = Clock::now() + chrono::milliseconds(ENGINE_HANG_MS);
+    while (readLine(deadline, reply))
+    {
+        if (reply.compare(0, 5, "info ") == 0)
+            continue;
+        if (m_unanswered > 0) //an answer to an ask that gave up on it
+        {
+            m_unanswered--;
+            continue;
+        }
+        return true;
+    }
+    if (hasDeadline && ! m_failed)
+        m_unanswered++; //it may answer yet
+    else
+        m_failed = true; //it's hung
+    return false;
+}
+
+bool Engine::failed() const
+{
+    return m_failed;
+}
+
+bool Engine::flush()
+{
+    size_t sent = 0;
+    while (sent < m_out.size())
+    {
+        ssize_t n = send(m_fd, m_out.data() + sent, m_out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            m_failed = true;
+            return false;
+        }
+        sent += n;
+    }
+    m_out.clear();
+    return true;
+}
+
+bool Engine::readLine(Clock::time_point deadline, string& line)
+{
+    while (true)
+    {
+        size_t end = m_in.find('\n');
+        if (end != string::npos)
+        {
+            line.assign(m_in, 0, end > 0 && m_in[end-1] == '\r' ? end-1 : end);
+            m_in.erase(0, end + 1);
+            return true;
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now >= deadline)
+            return false;
+        pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        long long ns = chrono::duration_cast<chrono::nanoseconds>(deadline - now).count();
+        timespec wait;
+        wait.tv_sec = ns / 1000000000;
+        wait.tv_nsec = ns % 1000000000;
+        int ready = ppoll(&pfd, 1, &wait, nullptr); //to the microsecond; poll's milliseconds are coarse
+        if (ready < 0 && errno != EINTR)
+        {
+            m_failed = true;
+            return false;
+        }
+        if (ready <= 0)
+            continue;
+
+        char buf[4096];
+        ssize_t n = recv(m_fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            m_failed = true; //the engine has exited
+            return false;
+        }
+        m_in.append(buf, n);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef ENGINE_INCLUDED
+#define ENGINE_INCLUDED
+
+#include "globals.h"
+#include <string>
+#include <sys/types.h>
+
+  // An external engine program, run by /bin/sh -c command, that talks a
+  // line of text at a time on its standard input and output.  Engines
+  // outlive the players using them: one that is released keeps running,
+  // waiting for the next player to acquire an engine with its command.
+  //
+  // On starting, an engine is sent "battleship" and must answer "ready".
+  // It may send lines beginning "info " at any time; they are ignored.
+class Engine
+{
+  public:
+      // An idle engine for command, or a new one that has answered the
+      // greeting; nullptr if it can't be started or doesn't answer
+    static Engine* acquire(std::string command);
+      // Hand e back to be reused, or end it if it has failed
+    static void release(Engine* e);
+      // Queue a line that needs no answer.  Queued lines go out with the
+      // next ask, in the same write.
+    void tell(const std::string& line);
+      // Send the queued lines and then line, and set reply to the
+      // engine's answer.  Returns false if there's no answer by deadline,
+      // or no deadline and no answer for far longer than any engine
+      // should take, or if the engine has failed.
+    bool ask(const std::string& line, Clock::time_point deadline, std::string& reply);
+    bool failed() const;
+      // We prevent an Engine object from being copied or assigned
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+  private:
+    friend struct EnginePool;
+    Engine(std::string command, pid_t pid, int fd);
+    ~Engine();
+    bool flush();
+    bool readLine(Clock::time_point deadline, std::string& line);
+
+    std::string m_command;
+    pid_t m_pid;
+    int m_fd;            // a socket joined to the engine's input and output
+    std::string m_out;   // told, not yet sent
+    std::string m_in;    // received, not yet a whole line
+    int m_unanswered;    // asks that timed out; their late answers are skipped
+    bool m_failed;
+};
+
+#endif // ENGINE_INCLUDED
@@ -0,0 +1,557 @@
+#include "Equilibrium.h"
+#include "Game.h"
+#include "Simulation.h"
+#include "globals.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+const char TABLE_MAGIC[8] = { 'B', 'S', 'P', 'L', 'A', 'C', 'E', '1' };
+
+  // followed by, for each style, uint32 accept, alias, first and count;
+  // then uint16 layouts[nLayouts][nShips]
+struct TableHeader
+{
+    char magic[8];
+    uint64_t fleet;
+    uint32_t nShips;
+    uint32_t nStyles;
+    uint32_t nLayouts;
+    uint32_t reserved;
+};
+
+uint64_t fleetKey(const Game& g)
+{
+    uint64_t h = 14695981039346656037ULL; //FNV-1a
+    auto mix = [&h](const string& s) {
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            h = (h ^ (unsigned char)(s[i])) * 1099511628211ULL;
+        }
+        h = (h ^ 0xFF) * 1099511628211ULL; //keeps "1" "23" apart from "12" "3"
+    };
+    mix(to_string(g.rows()));
+    mix(to_string(g.cols()));
+    for (int s = 0; s < g.nShips(); s++)
+    {
+        mix(g.shipShape(s));
+        mix(to_string(g.placements(s).size()));
+    }
+    return h;
+}
+
+//*********************************************************************
+//  PlacementTable
+//*********************************************************************
+
+PlacementTable::PlacementTable()
+ : m_fleet(0), m_nShips(0)
+{}
+
+bool PlacementTable::open(string path)
+{
+    close();
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr)
+    {
+        return false;
+    }
+    TableHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              memcmp(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) == 0 &&
+              header.nStyles > 0 && header.nStyles <= 0x10000 &&
+              header.nLayouts > 0 && header.nLayouts <= 0x100000 &&
+              header.nShips > 0 && header.nShips <= MAXROWS*MAXCOLS;
+    if (ok)
+    {
+        m_accept.resize(header.nStyles);
+        m_alias.resize(header.nStyles);
+        m_first.resize(header.nStyles);
+        m_count.resize(header.nStyles);
+        m_layouts.resize(size_t(header.nLayouts) * header.nShips);
+        for (uint32_t i = 0; ok && i < header.nStyles; i++)
+        {
+            uint32_t style[4];
+            ok = fread(style, sizeof(style), 1, f) == 1 &&
+                 style[1] < header.nStyles && style[3] > 0 &&
+                 style[2] < header.nLayouts && style[3] <= header.nLayouts - style[2];
+            m_accept[i] = style[0];
+            m_alias[i] = style[1];
+            m_first[i] = style[2];
+            m_count[i] = style[3];
+        }
+        ok = ok && fread(m_layouts.data(), sizeof(uint16_t), m_layouts.size(), f) == m_layouts.size();
+    }
+    fclose(f);
+    if ( ! ok)
+    {
+        close();
+        return false;
+    }
+    m_fleet = header.fleet;
+    m_nShips = header.nShips;
+    return true;
+}
+
+void PlacementTable::close()
+{
+    m_fleet = 0;
+    m_nShips = 0;
+    m_accept.clear();
+    m_alias.clear();
+    m_first.clear();
+    m_count.clear();
+    m_layouts.clear();
+}
+
+bool PlacementTable::isOpen() const
+{
+    return ! m_accept.empty();
+}
+
+bool PlacementTable::sample(const Game& g, Layout& layout) const
+{
+    if ( ! isOpen() || g.nShips() != m_nShips || fleetKey(g) != m_fleet)
+    {
+        return false;
+    }
+    int style = randInt(int(m_accept.size()));
+    if (uint32_t(randomGenerator()()) >= m_accept[style])
+        style = m_alias[style];
+    size_t i = m_first[style] + randInt(int(m_count[style]));
+
+    CellSet taken;
+    layout.assign(m_nShips, -1);
+    for (int s = 0; s < m_nShips; s++)
+    {
+        int pl = m_layouts[i * m_nShips + s];
+        if (pl >= int(g.placements(s).size()) || (g.placements(s)[pl] & taken).any())
+            return false; //not a table made for this fleet after all
+        taken |= g.placements(s)[pl];
+        layout[s] = pl;
+    }
+    return true;
+}
+
+PlacementTable& placementTable()
+{
+    static PlacementTable table;
+    return table;
+}
+
+//*********************************************************************
+//  Candidate layouts
+//*********************************************************************
+
+  // The kinds of placement the styles are made of.  In each, every ship
+  // in turn takes whichever of a few random placements that fit scores
+  // best by the kind's measure; the more it chooses among, the stronger
+  // the style.
+enum Kind { UNIFORM, EDGES, CENTER, SPREAD, TOUCHING, N_KINDS };
+const char* const KIND_NAMES[N_KINDS] = { "uniform", "edges", "center", "spread", "touching" };
+const int STRENGTHS[] = { 2, 4, 8 };  //placements a ship chooses among
+const int N_STRENGTHS = sizeof(STRENGTHS) / sizeof(STRENGTHS[0]);
+
+struct Style
+{
+    Kind kind;
+    int choices;
+
+    string name() const
+    {
+        return kind == UNIFORM ? string(KIND_NAMES[kind]) : KIND_NAMES[kind] + ("/" + to_string(choices));
+    }
+};
+
+  // Uniform once, then every other kind at every strength
+static vector<Style> allStyles()
+{
+    vector<Style> styles;
+    styles.push_back(Style{UNIFORM, 1});
+    for (int k = EDGES; k < N_KINDS; k++)
+    {
+        for (int n = 0; n < N_STRENGTHS; n++)
+        {
+            styles.push_back(Style{Kind(k), STRENGTHS[n]});
+        }
+    }
+    return styles;
+}
+
+  // How well the cells of a placement suit the style, given the cells
+  // already taken by other ships
+static int styleScore(Kind kind, const Game& g, const CellSet& cells, const CellSet& taken)
+{
+    int edge = 0;
+    int depth = 0;
+    int contacts = 0;
+    for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+    {
+        if ( ! cells.test(cell))
+            continue;
+        Point p = cellPoint(cell);
+        int d = min(min(p.r, g.rows()-1 - p.r), min(p.c, g.cols()-1 - p.c));
+        depth += d;
+        if (d == 0)
+            edge++;
+        for (int dr = -1; dr <= 1; dr++)
+        {
+            for (int dc = -1; dc <= 1; dc++)
+            {
+                Point q(p.r + dr, p.c + dc);
+                if (g.isValid(q) && taken.test(cellIndex(q)))
+                    contacts++;
+            }
+        }
+    }
+    switch (kind)
+    {
+      case EDGES:     return edge;
+      case CENTER:    return depth;
+      case SPREAD:    return -contacts;
+      case TOUCHING:  return contacts;
+      default:        return 0;
+    }
+}
+
+static bool styledLayout(const Game& g, const Style& style, Layout& layout)
+{
+    for (int attempt = 0; attempt < 50; attempt++) //start over if the fleet gets boxed in
+    {
+        CellSet taken;
+        layout.assign(g.nShips(), -1);
+        bool placedAll = true;
+        for (int s = 0; s < g.nShips() && placedAll; s++)
+        {
+            const vector<CellSet>& pls = g.placements(s);
+            int best = -1;
+            int bestScore = 0;
+            int found = 0;
+            for (int tries = 0; tries < 100 && found < style.choices && !pls.empty(); tries++)
+            {
+                int i = randInt(int(pls.size()));
+                if ((pls[i] & taken).any())
+                    continue;
+                found++;
+                int score = styleScore(style.kind, g, pls[i], taken);
+                if (best < 0 || score > bestScore)
+                {
+                    best = i;
+                    bestScore = score;
+                }
+            }
+            if (best < 0)
+                placedAll = false;
+            else
+            {
+                taken |= pls[best];
+                layout[s] = best;
+            }
+        }
+        if (placedAll)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//*********************************************************************
+//  Solver
+//*********************************************************************
+
+  // Vose's alias method: split each style's share of n, 1 on average,
+  // between itself and one other style with more than its share
+static void buildAlias(const vector<double>& prob, vector<uint32_t>& accept, vector<uint32_t>& alias)
+{
+    size_t n = prob.size();
+    vector<double> share(n);
+    vector<size_t> small;
+    vector<size_t> large;
+    for (size_t i = 0; i < n; i++)
+    {
+        share[i] = prob[i] * n;
+        (share[i] < 1 ? small : large).push_back(i);
+    }
+    accept.assign(n, 0xFFFFFFFF);
+    alias.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        alias[i] = uint32_t(i);
+    }
+    while ( ! small.empty() && ! large.empty())
+    {
+        size_t s = small.back();
+        small.pop_back();
+        size_t l = large.back();
+        accept[s] = uint32_t(share[s] * 4294967296.0);
+        alias[s] = uint32_t(l);
+        share[l] -= 1 - share[s];
+        if (share[l] < 1)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+      // Whatever is left has a share of 1, give or take rounding, and keeps
+      // the defaults: always itself
+}
+
+  // Each side's mix after regret matching: every iteration, each side
+  // plays each option in proportion to how much better it would have done
+  // playing it all along, the regrets never dropping below 0.  Their mixes
+  // averaged over the iterations approach an equilibrium.
+static void regretMatching(const vector<double>& payoff, int nRows, int nCols, int iterations,
+                           vector<double>& rowMix, vector<double>& colMix)
+{
+    vector<double> rowRegret(nRows, 0.0);
+    vector<double> colRegret(nCols, 0.0);
+    vector<double> x(nRows);
+    vector<double> y(nCols);
+    vector<double> rowValue(nRows);
+    vector<double> colValue(nCols);
+    rowMix.assign(nRows, 0.0);
+    colMix.assign(nCols, 0.0);
+
+    auto mix = [](const vector<double>& regret, vector<double>& strategy) {
+        double total = 0;
+        for (size_t i = 0; i < regret.size(); i++)
+        {
+            total += regret[i];
+        }
+        for (size_t i = 0; i < regret.size(); i++)
+        {
+            strategy[i] = (total > 0 ? regret[i] / total : 1.0 / regret.size());
+        }
+    };
+
+    for (int it = 1; it <= iterations; it++)
+    {
+        mix(rowRegret, x);
+        mix(colRegret, y);
+        double value = 0;
+        fill(colValue.begin(), colValue.end(), 0.0);
+        for (int i = 0; i < nRows; i++)
+        {
+            rowValue[i] = 0;
+            for (int j = 0; j < nCols; j++)
+            {
+                rowValue[i] += y[j] * payoff[i * nCols + j];
+                colValue[j] += x[i] * payoff[i * nCols + j];
+            }
+            value += x[i] * rowValue[i];
+        }
+          // The placer wants more shots, the attacker fewer; later
+          // iterations, nearer the equilibrium, count for more
+        for (int i = 0; i < nRows; i++)
+        {
+            rowRegret[i] = max(0.0, rowRegret[i] + rowValue[i] - value);
+            rowMix[i] += it * x[i];
+        }
+        for (int j = 0; j < nCols; j++)
+        {
+            colRegret[j] = max(0.0, colRegret[j] + value - colValue[j]);
+            colMix[j] += it * y[j];
+        }
+    }
+    double total = double(iterations) * (iterations + 1) / 2;
+    for (int i = 0; i < nRows; i++)
+        rowMix[i] /= total;
+    for (int j = 0; j < nCols; j++)
+        colMix[j] /= total;
+}
+
+  // The fewest shots, in expectation, any one attacker needs against
+  // layouts drawn as mix says, and which attacker that is
+static double worstCase(const vector<double>& payoff, int nCols, const vector<double>& mix, int& attacker)
+{
+    double worst = 1e18;
+    for (int j = 0; j < nCols; j++)
+    {
+        double v = 0;
+        for (size_t i = 0; i < mix.size(); i++)
+        {
+            v += mix[i] * payoff[i * nCols + j];
+        }
+        if (v < worst)
+        {
+            worst = v;
+            attacker = j;
+        }
+    }
+    return worst;
+}
+
+bool solvePlacement(const Game& g, const SolverConfig& config, string path, ostream& report)
+{
+    vector<Style> styles = allStyles();
+    int nStyles = int(styles.size());
+    int nAttackers = int(config.attackers.size());
+    if (nAttackers == 0 || config.trials < 1 || config.layoutsPerStyle < 1)
+    {
+        return false;
+    }
+
+      // The payoff matrix, a simulated game at a time over all threads,
+      // each against a fresh layout.  Each game is seeded by its place in
+      // the matrix, so the matrix doesn't depend on the threads.
+    int nThreads = config.threads;
+    if (nThreads < 1)
+        nThreads = max(1, int(thread::hardware_concurrency()));
+    int maxShots = 4 * g.rows() * g.cols(); //bounds attackers that never finish
+    int nJobs = nStyles * nAttackers * config.trials;
+    vector<atomic<long long> > shots(nStyles * nAttackers);
+    for (size_t i = 0; i < shots.size(); i++)
+    {
+        shots[i] = 0;
+    }
+    atomic<int> next(0);
+    atomic<bool> failed(false);
+    auto worker = [&]() {
+        int job;
+        Layout layout;
+        while ( ! failed && (job = next.fetch_add(1)) < nJobs)
+        {
+            int cell = job / config.trials;  //style * nAttackers + attacker
+            seedRandom(config.seed + 1 + unsigned(job));
+            int n = -1;
+            if (styledLayout(g, styles[cell / nAttackers], layout))
+                n = shotsToSink(g, layout, config.attackers[cell % nAttackers], maxShots);
+            if (n < 0)
+            {
+                failed = true;
+                return;
+            }
+            shots[cell] += n;
+        }
+    };
+    vector<thread> workers;
+    for (int t = 1; t < nThreads; t++)
+    {
+        workers.push_back(thread(worker));
+    }
+    worker(); //this thread does its share too
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+    if (failed)
+    {
+        return false;
+    }
+    vector<double> payoff(nStyles * nAttackers);
+    for (int i = 0; i < nStyles * nAttackers; i++)
+    {
+        payoff[i] = double(shots[i]) / config.trials;
+    }
+
+    vector<double> styleMix;
+    vector<double> attackerMix;
+    regretMatching(payoff, nStyles, nAttackers, config.iterations, styleMix, attackerMix);
+
+      // Styles played too rarely to matter only make the table bigger
+    vector<int> kept;
+    vector<double> keptMix;
+    double keptTotal = 0;
+    for (int i = 0; i < nStyles; i++)
+    {
+        if (styleMix[i] >= 0.01)
+        {
+            kept.push_back(i);
+            keptMix.push_back(styleMix[i]);
+            keptTotal += styleMix[i];
+        }
+    }
+    vector<double> prunedMix(nStyles, 0.0);
+    for (size_t k = 0; k < kept.size(); k++)
+    {
+        keptMix[k] /= keptTotal;
+        prunedMix[kept[k]] = keptMix[k];
+    }
+
+    report << fixed << setprecision(2);
+    report << "Shots needed on average, by the attacker best against each style:" << endl;
+    int worst;
+    for (int i = 0; i < nStyles; i++)
+    {
+        vector<double> pure(nStyles, 0.0);
+        pure[i] = 1;
+        double v = worstCase(payoff, nAttackers, pure, worst);
+        report << "  " << setw(12) << left << styles[i].name() << right << setw(6) << v
+               << " (" << config.attackers[worst] << ")";
+        if (prunedMix[i] > 0)
+            report << ", played " << 100 * prunedMix[i] << "%";
+        report << endl;
+    }
+    double v = worstCase(payoff, nAttackers, prunedMix, worst);
+    report << "  " << setw(12) << left << "the mix" << right << setw(6) << v
+           << " (" << config.attackers[worst] << ")" << endl;
+    double attackerBound = 0;
+    for (int i = 0; i < nStyles; i++)
+    {
+        double vi = 0;
+        for (int j = 0; j < nAttackers; j++)
+        {
+            vi += attackerMix[j] * payoff[i * nAttackers + j];
+        }
+        attackerBound = max(attackerBound, vi);
+    }
+    report << "The attackers' mix holds every style to " << attackerBound << " shots:";
+    for (int j = 0; j < nAttackers; j++)
+    {
+        report << " " << config.attackers[j] << " " << 100 * attackerMix[j] << "%";
+    }
+    report << endl;
+
+      // Each style in the mix gets a block of layouts drawn in that style
+    seedRandom(config.seed);
+    vector<uint32_t> accept;
+    vector<uint32_t> alias;
+    buildAlias(keptMix, accept, alias);
+    vector<uint32_t> blocks;
+    vector<uint16_t> layouts;
+    Layout layout;
+    for (size_t k = 0; k < kept.size(); k++)
+    {
+        blocks.push_back(accept[k]);
+        blocks.push_back(alias[k]);
+        blocks.push_back(uint32_t(k * config.layoutsPerStyle));
+        blocks.push_back(uint32_t(config.layoutsPerStyle));
+        for (int n = 0; n < config.layoutsPerStyle; n++)
+        {
+            if ( ! styledLayout(g, styles[kept[k]], layout))
+                return false;
+            for (int s = 0; s < g.nShips(); s++)
+            {
+                layouts.push_back(uint16_t(layout[s]));
+            }
+        }
+    }
+
+    TableHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    header.fleet = fleetKey(g);
+    header.nShips = g.nShips();
+    header.nStyles = kept.size();
+    header.nLayouts = kept.size() * config.layoutsPerStyle;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr)
+    {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(blocks.data(), sizeof(uint32_t), blocks.size(), f) == blocks.size() &&
+              fwrite(layouts.data(), sizeof(uint16_t), layouts.size(), f) == layouts.size();
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,68 @@
+#ifndef EQUILIBRIUM_INCLUDED
+#define EQUILIBRIUM_INCLUDED
+
+#include "Simulation.h"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class Game;
+
+  // A mixed placement strategy for one board size and fleet: a few styles
+  // of placement, each with the probability of choosing it and a block of
+  // layouts drawn in that style.  The styles are kept as an alias table,
+  // so drawing a layout takes one random index and one comparison to pick
+  // the style and one more random index to pick within its block.
+class PlacementTable
+{
+  public:
+    PlacementTable();
+    bool open(std::string path);
+    void close();
+    bool isOpen() const;
+      // Set layout to a random layout of the strategy; false if there's no
+      // table for g's board and fleet
+    bool sample(const Game& g, Layout& layout) const;
+
+  private:
+    std::uint64_t m_fleet;                 // fleetKey of the game it's for
+    int m_nShips;
+    std::vector<std::uint32_t> m_accept;   // per style: keep it if a random
+                                           // 32-bit number is below this,
+    std::vector<std::uint32_t> m_alias;    // else take this one
+    std::vector<std::uint32_t> m_first;    // its block of layouts
+    std::vector<std::uint32_t> m_count;
+    std::vector<std::uint16_t> m_layouts;  // placement indexes, nShips per layout
+};
+
+  // The table placeShips draws from when it's open
+PlacementTable& placementTable();
+
+  // Identifies g's board size and fleet
+std::uint64_t fleetKey(const Game& g);
+
+struct SolverConfig
+{
+    std::vector<std::string> attackers;  // createPlayer types
+    int trials;          // simulated games per style and attacker
+    int iterations;      // of regret matching
+    int layoutsPerStyle; // drawn for the table for each style it plays
+    int threads;         // 0 for one per hardware thread
+    unsigned seed;
+};
+
+  // Solve the zero-sum game in which one side picks a style of placement
+  // (at random, along the edges, in the middle, spread out or bunched
+  // together, each more or less strongly) and the other an attacker type,
+  // the payoff being the shots the attacker needs to sink the fleet.  The
+  // payoffs come from simulated games against fresh layouts; regret
+  // matching then finds the mix of styles that holds out longest against
+  // the best mix of attackers.  Writes the styles' mix to path as a
+  // PlacementTable, and what it found to report.  Returns false if the
+  // fleet can't be placed, an attacker type can't be simulated, or path
+  // can't be written.
+bool solvePlacement(const Game& g, const SolverConfig& config, std::string path,
+                    std::ostream& report);
+
+#endif // EQUILIBRIUM_INCLUDED
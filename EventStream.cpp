@@ -0,0 +1,150 @@
+#include "EventStream.h"
+#include <cstring>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+static_assert(sizeof(GameEvent) == 16, "a GameEvent fills a slot's two words");
+
+string formatEvent(const GameEvent& e)
+{
+    static const char* const outcomes[] = { "MISS", "HIT", "SUNK", "INVALID", "LATE" };
+    ostringstream oss;
+    oss << e.game << " ";
+    switch (e.type)
+    {
+      case GameEvent::GAME_START:
+        oss << "start";
+        break;
+      case GameEvent::SHIP_PLACED:
+        oss << "placed " << int(e.player) << " " << int(e.shipId) << " " << e.placement;
+        break;
+      case GameEvent::SHOT:
+        oss << "shot " << int(e.player) << " " << int(e.r) << " " << int(e.c) << " "
+            << (e.outcome <= GameEvent::LATE ? outcomes[e.outcome] : "?");
+        if (e.outcome == GameEvent::SUNK)
+            oss << " " << int(e.shipId);
+        break;
+      case GameEvent::GAME_OVER:
+        oss << "over " << int(e.player);
+        break;
+      default:
+        oss << "unknown";
+        break;
+    }
+    return oss.str();
+}
+
+//*********************************************************************
+//  EventStream
+//*********************************************************************
+
+  // Each slot is a seqlock: the stamp is cleared, the words written, then
+  // the stamp set to say which event they hold.  A reader that sees the
+  // same stamp before and after reading the words has read them whole.
+
+EventStream::EventStream(int capacity)
+ : m_head(0)
+{
+    uint64_t n = 1;
+    while (n < uint64_t(capacity > 1 ? capacity : 1))
+    {
+        n *= 2;
+    }
+    m_slots = new Slot[n];
+    m_mask = n - 1;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        m_slots[i].stamp.store(0, memory_order_relaxed);
+        m_slots[i].words[0].store(0, memory_order_relaxed);
+        m_slots[i].words[1].store(0, memory_order_relaxed);
+    }
+}
+
+EventStream::~EventStream()
+{
+    delete [] m_slots;
+}
+
+void EventStream::publish(const GameEvent& e)
+{
+    uint64_t seq = m_head.load(memory_order_relaxed);
+    uint64_t words[2];
+    memcpy(words, &e, sizeof(words));
+
+    Slot& slot = m_slots[seq & m_mask];
+    slot.stamp.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); //no reader sees new words under the old stamp
+    slot.words[0].store(words[0], memory_order_relaxed);
+    slot.words[1].store(words[1], memory_order_relaxed);
+    slot.stamp.store(seq + 1, memory_order_release);
+    m_head.store(seq + 1, memory_order_release);
+}
+
+uint64_t EventStream::head() const
+{
+    return m_head.load(memory_order_acquire);
+}
+
+uint64_t EventStream::capacity() const
+{
+    return m_mask + 1;
+}
+
+bool EventStream::read(uint64_t seq, GameEvent& e) const
+{
+    const Slot& slot = m_slots[seq & m_mask];
+    uint64_t before = slot.stamp.load(memory_order_acquire);
+    if (before != seq + 1)
+    {
+        return false;
+    }
+    uint64_t words[2];
+    words[0] = slot.words[0].load(memory_order_relaxed);
+    words[1] = slot.words[1].load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire); //the words are read before the stamp is checked again
+    if (slot.stamp.load(memory_order_relaxed) != before)
+    {
+        return false;
+    }
+    memcpy(&e, words, sizeof(words));
+    return true;
+}
+
+//*********************************************************************
+//  Spectator
+//*********************************************************************
+
+Spectator::Spectator(const EventStream& s)
+ : m_stream(s), m_cursor(s.head()), m_skipped(0)
+{}
+
+bool Spectator::next(GameEvent& e)
+{
+    while (true)
+    {
+        uint64_t head = m_stream.head();
+        if (m_cursor >= head)
+        {
+            return false;
+        }
+        if (head - m_cursor > m_stream.capacity()) //lapped: jump to the oldest still there
+        {
+            m_skipped += head - m_stream.capacity() - m_cursor;
+            m_cursor = head - m_stream.capacity();
+        }
+        bool ok = m_stream.read(m_cursor, e);
+        m_cursor++;
+        if (ok)
+        {
+            return true;
+        }
+        m_skipped++; //overwritten as we read it
+    }
+}
+
+uint64_t Spectator::skipped() const
+{
+    return m_skipped;
+}
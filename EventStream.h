@@ -0,0 +1,84 @@
+#ifndef EVENTSTREAM_INCLUDED
+#define EVENTSTREAM_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+  // One thing that happened in a game, as Game::play publishes it
+struct GameEvent
+{
+    enum Type { GAME_START, SHIP_PLACED, SHOT, GAME_OVER };
+    enum Outcome { MISS, HIT, SUNK, INVALID, LATE };
+
+    std::uint32_t game;       // numbers every game played in the process
+    std::uint16_t turn;       // the attacker's turn, from 1; 0 before the first shot
+    std::uint16_t placement;  // SHIP_PLACED: index into Game::placements(shipId)
+    unsigned char type;
+    unsigned char player;     // 0 or 1, in the order passed to Game::play;
+                              // for GAME_OVER, the winner
+    signed char r;            // SHOT: where
+    signed char c;
+    unsigned char outcome;    // SHOT
+    unsigned char shipId;     // SHIP_PLACED, or a SHOT that sank it
+    unsigned char unused[2];
+};
+
+  // The event as a line of text, such as "7 shot 1 3 4 SUNK 2" (game 7,
+  // player 1 at (3,4) sinking ship 2), for logs and other spectators
+std::string formatEvent(const GameEvent& e);
+
+  // A ring of the latest events, published by one thread and read by any
+  // number of spectators.  Publishing never waits for the spectators: it
+  // writes each event once, into the slot after the last, overwriting the
+  // oldest.  Every spectator reads the same slots, keeping only its own
+  // position, so adding one costs the game nothing.  A spectator that
+  // falls more than the ring's capacity behind skips what was overwritten.
+class EventStream
+{
+  public:
+      // capacity is rounded up to a power of 2
+    EventStream(int capacity = 4096);
+    ~EventStream();
+      // Only one thread at a time may publish
+    void publish(const GameEvent& e);
+      // The sequence number the next event published will get; the first
+      // one published is 0
+    std::uint64_t head() const;
+    std::uint64_t capacity() const;
+      // Set e to event number seq; false if it hasn't been published or
+      // has been overwritten, even while being read
+    bool read(std::uint64_t seq, GameEvent& e) const;
+      // We prevent an EventStream object from being copied or assigned
+    EventStream(const EventStream&) = delete;
+    EventStream& operator=(const EventStream&) = delete;
+
+  private:
+    struct Slot
+    {
+        std::atomic<std::uint64_t> stamp;  // seq+1 of the event held; 0 while being written
+        std::atomic<std::uint64_t> words[2];
+    };
+    Slot* m_slots;
+    std::uint64_t m_mask;
+    alignas(64) std::atomic<std::uint64_t> m_head;
+};
+
+  // One reader of an EventStream, starting from the next event published
+class Spectator
+{
+  public:
+    Spectator(const EventStream& s);
+      // Set e to the next event and return true, or return false if there
+      // is none yet.  It never waits.
+    bool next(GameEvent& e);
+      // How many events were overwritten before this spectator read them
+    std::uint64_t skipped() const;
+
+  private:
+    const EventStream& m_stream;
+    std::uint64_t m_cursor;
+    std::uint64_t m_skipped;
+};
+
+#endif // EVENTSTREAM_INCLUDED
@@ -1,16 +1,70 @@
 #include "Game.h"
 #include "Board.h"
+#include "EventStream.h"
 #include "Player.h"
+#include "Profile.h"
 #include "globals.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <cstdlib>
 #include <cctype>
-
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 using namespace std;
 
 
+  // The ships of a game and everywhere they can lie.  A fleet never
+  // changes once made: adding a ship to a game makes a new one, which is
+  // shared with every other game of the same size with the same ships, so
+  // that a game costs little more than its own state.
+struct Fleet
+{
+    struct ship {
+        int m_length; //number of cells
+        char m_symbol;
+        string m_name;
+        string m_shape; //orientation 0, written as for Game::addShip
+        bool m_straight;
+        int m_nOrientations; //distinct rotations and reflections, the shape as given first
+        vector<CellSet> m_placements; //every cell mask the ship can occupy
+        vector<int> m_placementAt[8]; //per orientation, top left cell index -> placement, or -1
+    };
+    vector<ship> ships;
+};
+
+  // The fleet already shared that's the same as f on a board of the given
+  // size, or f, now shared, if there's none.  Fleets are kept only while
+  // some game has them.
+static shared_ptr<const Fleet> sharedFleet(int rows, int cols, const shared_ptr<const Fleet>& f)
+{
+    static mutex registryLock;
+    static map<string, weak_ptr<const Fleet> > registry;
+    string key = to_string(rows) + "x" + to_string(cols);
+    for (size_t s = 0; s < f->ships.size(); s++)
+    {
+        const Fleet::ship& sh = f->ships[s];
+        key += " " + sh.m_shape + " " + sh.m_symbol + to_string(sh.m_name.size()) + ":" + sh.m_name;
+    }
+    lock_guard<mutex> lock(registryLock);
+    shared_ptr<const Fleet> shared = registry[key].lock();
+    if (shared)
+        return shared;
+    for (auto it = registry.begin(); it != registry.end(); )
+    {
+        if (it->second.expired() && it->first != key)
+            it = registry.erase(it);
+        else
+            ++it;
+    }
+    registry[key] = f;
+    return f;
+}
+
 class GameImpl
 {
   public:
@@ -19,22 +73,76 @@ class GameImpl
     int cols() const;
     bool isValid(Point p) const;
     Point randomPoint() const;
-    bool addShip(int length, char symbol, string name);
+    bool addShip(const vector<Point>& cells, char symbol, string name);
+    void removeLastShip();
     int nShips() const; //size of vector of ships
     int shipLength(int shipId) const;
     char shipSymbol(int shipId) const;
     string shipName(int shipId) const;
+    string shipShape(int shipId) const;
+    bool isStraight(int shipId) const;
+    int nOrientations(int shipId) const;
+    const vector<CellSet>& placements(int shipId) const;
+    int placementAt(int shipId, Point topLeft, int orientation) const;
     Player* play(Player* p1, Player* p2, Board& b1, Board& b2, bool shouldPause);
+    void setMoveTimeLimit(int ms);
+    int moveTimeLimit() const;
+    int overruns(const Player* p) const;
+    void setSalvo(int shotsPerTurn);
+    int salvo() const;
+    void setEventStream(EventStream* events);
+    void setQuiet(bool quiet);
+    int turns(const Player* p) const;
+    const vector<int>& sinkOrder(const Player* p) const;
+    int shots(const Player* p) const;
+    const vector<int>& sinkShots(const Player* p) const;
+    const vector<int>& phases(const Player* p) const;
+    void setCounters(PerfCounters* counters);
+    const PhaseCounts* phaseCounts(const Player* p) const;
     
   private:
+      // Where play reports what happens: cout, or nowhere if quiet
+    ostream& out();
+      // One move by attacker at the defender's board b, own being the
+      // attacker's; true if it won the game
+    bool takeTurn(Player* attacker, Player* defender, Board& b, const Board& own, int& overruns, bool shouldPause);
+    bool fireShot(Player* attacker, Player* defender, Board& b, bool timed, int& overruns);
+    bool fireSalvo(Player* attacker, Player* defender, Board& b, int k, bool timed, int& overruns);
+      // Publish e, if anyone is watching, stamped with this game's number
+    void publish(GameEvent e);
+    void publishShot(const Player* attacker, Point p, int outcome, int shipId);
+    void publishFleet(int player, const Board& b);
+      // Count n shots the player on side is about to fire as hunting or
+      // targeting, by whether it has hits not yet in a sunk ship
+    void countShots(int side, int n);
+      // Note what one of them did
+    void recordOutcome(int side, bool hit, bool destroyed, int shipId);
+      // Read the counters, if play is measuring, into before, and then add
+      // what they counted since to side's phase
+    void startPhase(uint64_t before[NCOUNTERS]) const;
+    void endPhase(int side, int phase, const uint64_t before[NCOUNTERS]);
+    
     int m_rows;
     int m_cols;
-    struct ship {
-        int m_length;
-        char m_symbol;
-        string m_name;
-    };
-    vector<ship> shipvect;
+    int m_moveTimeLimit; //milliseconds per computer move; 0 for no limit
+    int m_salvo; //shots per turn, or SALVO_SHIPS_AFLOAT
+    const Player* m_players[2]; //in the last game played
+    int m_overruns[2]; //moves each of them took too long over
+    int m_turns[2]; //turns each of them has taken
+    vector<int> m_sunk[2]; //the opponent's ships each of them has sunk, in order
+    vector<int> m_sinkShots[2]; //and how many shots it had fired when it sank each
+    int m_shots[2]; //shots each of them has fired, wasted ones included
+    int m_openHits[2]; //its hits not yet part of a sunk ship
+    vector<int> m_phases[2]; //the lengths in shots of its runs of hunting and
+                             //targeting, alternately, hunting first
+    EventStream* m_events; //where play publishes what happens, or nullptr
+    PerfCounters* m_counters; //what play measures its phases with, or nullptr
+    PhaseCounts m_phaseCounts[2][NPHASES]; //each side's in the last game measured
+    bool m_measured; //whether the last game played was
+    uint32_t m_gameNumber;
+    bool m_quiet;
+    ostream m_silent; //discards everything
+    shared_ptr<const Fleet> m_fleet; //never null; shared with games set up alike
 };
 
 void waitForEnter()
@@ -44,9 +152,23 @@ void waitForEnter()
 }
 
 GameImpl::GameImpl(int nRows, int nCols)
+ : m_silent(nullptr)
 {
     m_rows = nRows;
     m_cols = nCols;
+    m_moveTimeLimit = 0;
+    m_salvo = 1;
+    m_players[0] = m_players[1] = nullptr;
+    m_overruns[0] = m_overruns[1] = 0;
+    m_turns[0] = m_turns[1] = 0;
+    m_shots[0] = m_shots[1] = 0;
+    m_openHits[0] = m_openHits[1] = 0;
+    m_events = nullptr;
+    m_counters = nullptr;
+    m_measured = false;
+    m_gameNumber = 0;
+    m_quiet = false;
+    m_fleet = sharedFleet(m_rows, m_cols, make_shared<Fleet>());
 }
 
 int GameImpl::rows() const
@@ -70,157 +192,644 @@ Point GameImpl::randomPoint() const
     return Point(randInt(rows()), randInt(cols())); //returns a random valid Point
 }
 
-bool GameImpl::addShip(int length, char symbol, string name)
+bool GameImpl::addShip(const vector<Point>& cells, char symbol, string name)
 {
-    ship temp; //new ship
-    temp.m_length = length;
+    Fleet::ship temp; //new ship
+    temp.m_length = int(cells.size());
     temp.m_symbol = symbol;
     temp.m_name = name;
-    shipvect.push_back(temp); //add new ship to vector of ships
+    temp.m_nOrientations = 0;
+    
+    //a straight ship lies in one row or one column; lay it down horizontally
+    bool oneRow = true;
+    bool oneCol = true;
+    for (size_t i = 1; i < cells.size(); i++)
+    {
+        oneRow = oneRow && cells[i].r == cells[0].r;
+        oneCol = oneCol && cells[i].c == cells[0].c;
+    }
+    temp.m_straight = oneRow || oneCol;
+    vector<Point> base = cells;
+    if ( ! oneRow && oneCol)
+    {
+        for (size_t i = 0; i < base.size(); i++)
+            base[i] = Point(base[i].c, base[i].r);
+    }
+    
+    //the eight rotations and reflections, identity then a quarter turn first,
+    //so a straight ship's first two orientations are horizontal and vertical
+    vector<vector<Point> > orientations;
+    for (int t = 0; t < 8; t++)
+    {
+        vector<Point> shape;
+        int minR = MAXROWS*MAXCOLS;
+        int minC = MAXROWS*MAXCOLS;
+        for (size_t i = 0; i < base.size(); i++)
+        {
+            Point p = base[i];
+            if (t >= 4)
+                p = Point(p.r, -p.c); //reflect
+            for (int k = 0; k < t % 4; k++)
+                p = Point(p.c, -p.r); //quarter turn
+            shape.push_back(p);
+            minR = min(minR, p.r);
+            minC = min(minC, p.c);
+        }
+        for (size_t i = 0; i < shape.size(); i++) //move to the top left corner
+        {
+            shape[i].r -= minR;
+            shape[i].c -= minC;
+        }
+        sort(shape.begin(), shape.end(), [](Point a, Point b) {
+            return a.r != b.r ? a.r < b.r : a.c < b.c;
+        });
+        bool seen = false;
+        for (size_t o = 0; o < orientations.size() && !seen; o++)
+        {
+            seen = equal(shape.begin(), shape.end(), orientations[o].begin(), [](Point a, Point b) {
+                return a.r == b.r && a.c == b.c;
+            });
+        }
+        if ( ! seen)
+            orientations.push_back(shape);
+    }
+    temp.m_nOrientations = int(orientations.size());
+    
+    int height = 0;
+    int width = 0;
+    for (size_t i = 0; i < orientations[0].size(); i++)
+    {
+        height = max(height, orientations[0][i].r + 1);
+        width = max(width, orientations[0][i].c + 1);
+    }
+    for (int r = 0; r < height; r++)
+    {
+        if (r > 0)
+            temp.m_shape += '/';
+        temp.m_shape += string(width, '.');
+    }
+    for (size_t i = 0; i < orientations[0].size(); i++)
+    {
+        temp.m_shape[orientations[0][i].r * (width + 1) + orientations[0][i].c] = '#';
+    }
+    
+    for (size_t o = 0; o < orientations.size(); o++)
+    {
+        temp.m_placementAt[o].assign(MAXROWS*MAXCOLS, -1);
+        for (int r = 0; r < rows(); r++)
+        {
+            for (int c = 0; c < cols(); c++)
+            {
+                CellSet mask;
+                bool fits = true;
+                for (size_t i = 0; i < orientations[o].size() && fits; i++)
+                {
+                    Point p(r + orientations[o][i].r, c + orientations[o][i].c);
+                    fits = isValid(p);
+                    if (fits)
+                        mask.set(cellIndex(p));
+                }
+                if (fits)
+                {
+                    temp.m_placementAt[o][cellIndex(Point(r,c))] = int(temp.m_placements.size());
+                    temp.m_placements.push_back(mask);
+                }
+            }
+        }
+    }
+    shared_ptr<Fleet> f = make_shared<Fleet>(*m_fleet);
+    f->ships.push_back(temp); //add new ship to vector of ships
+    m_fleet = sharedFleet(rows(), cols(), f);
     return true;
 }
 
+void GameImpl::removeLastShip()
+{
+    shared_ptr<Fleet> f = make_shared<Fleet>(*m_fleet);
+    f->ships.pop_back();
+    m_fleet = sharedFleet(rows(), cols(), f);
+}
+
+bool GameImpl::isStraight(int shipId) const
+{
+    return m_fleet->ships[shipId].m_straight;
+}
+
+int GameImpl::nOrientations(int shipId) const
+{
+    return m_fleet->ships[shipId].m_nOrientations;
+}
+
+const vector<CellSet>& GameImpl::placements(int shipId) const
+{
+    return m_fleet->ships[shipId].m_placements;
+}
+
+int GameImpl::placementAt(int shipId, Point topLeft, int orientation) const
+{
+    if (orientation < 0 || orientation >= m_fleet->ships[shipId].m_nOrientations || ! isValid(topLeft))
+        return -1;
+    return m_fleet->ships[shipId].m_placementAt[orientation][cellIndex(topLeft)];
+}
+
 int GameImpl::nShips() const
 {
-    return int(shipvect.size()); //casted to int; returns size of ship vector
+    return int(m_fleet->ships.size()); //casted to int; returns size of ship vector
 }
 
 int GameImpl::shipLength(int shipId) const
 {
-    return shipvect[shipId].m_length;
+    return m_fleet->ships[shipId].m_length;
 }
 
 char GameImpl::shipSymbol(int shipId) const
 {
-    return shipvect[shipId].m_symbol;
+    return m_fleet->ships[shipId].m_symbol;
 }
 
 string GameImpl::shipName(int shipId) const
 {
-    return shipvect[shipId].m_name;
+    return m_fleet->ships[shipId].m_name;
+}
+
+string GameImpl::shipShape(int shipId) const
+{
+    return m_fleet->ships[shipId].m_shape;
 }
 
  
 Player* GameImpl::play(Player* p1, Player* p2, Board& b1, Board& b2, bool shouldPause)
 {
+    p1->recordOpponentName(p2->name()); //lets players draw on what they know of each other
+    p2->recordOpponentName(p1->name());
+    p1->setDeadline(Clock::time_point::max()); //no deadline outside of a timed move
+    p2->setDeadline(Clock::time_point::max());
+    p1->setPondering(p2->isHuman());
+    p2->setPondering(p1->isHuman());
+    m_players[0] = p1;
+    m_players[1] = p2;
+    m_overruns[0] = 0;
+    m_overruns[1] = 0;
+    m_turns[0] = 0;
+    m_turns[1] = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        m_sunk[i].clear();
+        m_sinkShots[i].clear();
+        m_shots[i] = 0;
+        m_openHits[i] = 0;
+        m_phases[i].clear();
+        for (int ph = 0; ph < NPHASES; ph++)
+        {
+            m_phaseCounts[i][ph] = PhaseCounts();
+        }
+    }
+    m_measured = (m_counters != nullptr);
+    uint64_t before[NCOUNTERS];
+    
+    static atomic<uint32_t> gamesStarted(0);
+    m_gameNumber = gamesStarted.fetch_add(1, memory_order_relaxed);
+    GameEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = GameEvent::GAME_START;
+    publish(e);
+    e.type = GameEvent::GAME_OVER;
+    e.player = 2; //published if the game can't be played
+    
     if (p1->isHuman())
     {
-        cout << p1->name() << " must place " << nShips() << " ships." << endl;
+        out() << p1->name() << " must place " << nShips() << " ships." << endl;
         p1->placeShips(b1); //initializes the board, assigning p1 to b1
     }
     else
     {
-        if (p1->placeShips(b1) == false) {return nullptr;} //returns nullptr if could not place the ships
+        startPhase(before);
+        bool placed = p1->placeShips(b1);
+        endPhase(0, PHASE_PLACEMENT, before);
+        if (placed == false) {publish(e); return nullptr;} //returns nullptr if could not place the ships
     }
     
     if (p2->isHuman())
     {
-        cout << p2->name() << " must place " << nShips() << " ships." << endl;
+        out() << p2->name() << " must place " << nShips() << " ships." << endl;
         p2->placeShips(b2); //initializes the board, assigning p2 to b2
     }
     else
     {
-        if (p2->placeShips(b2) == false) {return nullptr;} //returns nullptr if could not place the ships
+        startPhase(before);
+        bool placed = p2->placeShips(b2);
+        endPhase(1, PHASE_PLACEMENT, before);
+        if (placed == false) {publish(e); return nullptr;} //returns nullptr if could not place the ships
+    }
+    publishFleet(0, b1);
+    publishFleet(1, b2);
+    
+    while (true)
+    {
+        if (takeTurn(p1, p2, b2, b1, m_overruns[0], shouldPause))
+        {
+            e.player = 0;
+            publish(e);
+            p1->recordOpponentFleet(b2); //both fleets are revealed at the end
+            p2->recordOpponentFleet(b1);
+            return p1;
+        }
+        if (takeTurn(p2, p1, b1, b2, m_overruns[1], shouldPause))
+        {
+            e.player = 1;
+            publish(e);
+            p2->recordOpponentFleet(b1); //both fleets are revealed at the end
+            p1->recordOpponentFleet(b2);
+            return p2;
+        }
+    }
+}
+
+bool GameImpl::takeTurn(Player* attacker, Player* defender, Board& b, const Board& own, int& overruns, bool shouldPause)
+{
+    out() << attacker->name() << "'s turn. Board for " << defender->name() << ":" << endl;
+    if ( ! m_quiet)
+        b.display(attacker->isHuman()); //attacker needs to see the defender's board
+    
+    m_turns[attacker == m_players[0] ? 0 : 1]++;
+    bool timed = (m_moveTimeLimit > 0 && ! attacker->isHuman()); //people may take their time
+    if (timed)
+    {
+        attacker->setDeadline(Clock::now() + chrono::milliseconds(m_moveTimeLimit));
     }
     
+    bool won;
+    if (m_salvo == 1)
+    {
+        won = fireShot(attacker, defender, b, timed, overruns);
+    }
+    else
+    {
+        int k = (m_salvo == SALVO_SHIPS_AFLOAT ? own.nShipsAfloat() : m_salvo);
+        won = fireSalvo(attacker, defender, b, k, timed, overruns);
+    }
+    if (won)
+    {
+        out() << attacker->name() << " wins!" << endl;
+        return true;
+    }
+    
+    if (shouldPause == true && ! m_quiet)
+    {
+        out() << "Press enter to continue: ";
+        string s;
+        getline(cin,s);
+    }
+    return false;
+}
+
+bool GameImpl::fireShot(Player* attacker, Player* defender, Board& b, bool timed, int& overruns)
+{
     int shipId;
     bool shipDestroyed;
     bool shotHit;
-    Point attacked;
     
-    while (true)
+    int side = (attacker == m_players[0] ? 0 : 1);
+    int phase = (m_openHits[side] > 0 ? PHASE_TARGET : PHASE_HUNT);
+    uint64_t before[NCOUNTERS];
+    startPhase(before);
+    Point attacked = attacker->recommendAttack();
+    endPhase(side, phase, before);
+    countShots(side, 1);
+    
+    bool late = (timed && Clock::now() > attacker->deadline());
+    bool valid = false;
+    if ( ! late)
     {
-        cout << p1->name() << "'s turn. Board for " << p2->name() << ":" << endl;
-        b2.display(p1->isHuman()); //p1 is attacking, so they need to see p2's board
-        attacked = p1->recommendAttack();
-        if (b2.attack(attacked, shotHit, shipDestroyed, shipId) == true)
+        startPhase(before);
+        valid = b.attack(attacked, shotHit, shipDestroyed, shipId);
+        endPhase(side, PHASE_ATTACK, before);
+    }
+    if (late) //too late; the shot is lost
+    {
+        overruns++;
+        out() << attacker->name() << " ran out of time and forfeits the shot at " << "(" << attacked.r << "," << attacked.c << ")." << endl;
+        publishShot(attacker, attacked, GameEvent::LATE, 0);
+        attacker->recordAttackResult(attacked, false, false, false, 0);
+    }
+    else if (valid == true)
+    {
+        publishShot(attacker, attacked, ! shotHit ? GameEvent::MISS :
+                                        shipDestroyed ? GameEvent::SUNK : GameEvent::HIT, shipId);
+        recordOutcome(side, shotHit, shipDestroyed, shipId);
+        if (shotHit == true)
         {
-            if (shotHit == true)
+            if (shipDestroyed)
             {
-                if (shipDestroyed)
-                {
-                    cout << p1->name() << " attacked (" << attacked.r << "," << attacked.c << ") and destroyed the " << p1->game().shipName(shipId) << ", resulting in:" << endl;
-                }
-                else
-                {
-                    cout << p1->name() << " attacked " << "(" << attacked.r << "," << attacked.c << ") and hit something, resulting in:" << endl;
-                }
-                
+                out() << attacker->name() << " attacked (" << attacked.r << "," << attacked.c << ") and destroyed the " << attacker->game().shipName(shipId) << ", resulting in:" << endl;
             }
             else
             {
-                cout << p1->name() << " attacked (" << attacked.r << "," << attacked.c << ") and missed, resulting in:" << endl;
+                out() << attacker->name() << " attacked " << "(" << attacked.r << "," << attacked.c << ") and hit something, resulting in:" << endl;
             }
             
-            b2.display(p1->isHuman()); //only display after every valid attack
-            if(b2.allShipsDestroyed() == true) //if player 1 won
-            {
-                cout << p1->name() << " wins!" << endl;
-                return p1;
-            }
-            p1->recordAttackResult(attacked, true, shotHit, shipDestroyed, shipId);
         }
-        else //attacked at an already attacked or out of bounds spot
+        else
         {
-            cout << p1->name() << " wasted a shot at " << "(" << attacked.r << "," << attacked.c << ")." << endl;
-            p1->recordAttackResult(attacked, false, shotHit, shipDestroyed, shipId);
+            out() << attacker->name() << " attacked (" << attacked.r << "," << attacked.c << ") and missed, resulting in:" << endl;
         }
-        p2->recordAttackByOpponent(attacked);
         
-        if (shouldPause == true)
+        if ( ! m_quiet)
+            b.display(attacker->isHuman()); //only display after every valid attack
+        if(b.allShipsDestroyed() == true) //the attacker won
         {
-            cout << "Press enter to continue: ";
-            string s;
-            getline(cin,s);
+            return true;
         }
-        
-        
-        //player 2's turn
-        cout << p2->name() << "'s turn. Board for " << p1->name() << ":" << endl;
-        b1.display(p2->isHuman()); //p2 is attacking, so he needs to see p1's board
-        attacked = p2->recommendAttack();
-        if (b1.attack(attacked, shotHit, shipDestroyed, shipId) == true)
+        attacker->recordAttackResult(attacked, true, shotHit, shipDestroyed, shipId);
+    }
+    else //attacked at an already attacked or out of bounds spot
+    {
+        out() << attacker->name() << " wasted a shot at " << "(" << attacked.r << "," << attacked.c << ")." << endl;
+        publishShot(attacker, attacked, GameEvent::INVALID, 0);
+        attacker->recordAttackResult(attacked, false, shotHit, shipDestroyed, shipId);
+    }
+    if ( ! late) //a forfeited shot never reached the defender's board
+        defender->recordAttackByOpponent(attacked);
+    return false;
+}
+
+bool GameImpl::fireSalvo(Player* attacker, Player* defender, Board& b, int k, bool timed, int& overruns)
+{
+    int side = (attacker == m_players[0] ? 0 : 1);
+    int phase = (m_openHits[side] > 0 ? PHASE_TARGET : PHASE_HUNT);
+    uint64_t before[NCOUNTERS];
+    startPhase(before);
+    CellSet proposed = attacker->recommendAttacks(k);
+    endPhase(side, phase, before);
+    CellSet shots; //only the first k count
+    for (int cell = 0; cell < MAXROWS*MAXCOLS && int(shots.count()) < k; cell++)
+    {
+        if (proposed.test(cell))
+            shots.set(cell);
+    }
+    
+    countShots(side, int(shots.count()));
+    CellSet hits;
+    CellSet invalid;
+    CellSet sinks;
+    vector<int> sunkShipIds;
+    bool late = (timed && Clock::now() > attacker->deadline());
+    if (late) //too late; the whole salvo is lost
+    {
+        overruns++;
+        invalid = shots;
+        out() << attacker->name() << " ran out of time and forfeits a salvo of " << shots.count() << " shots." << endl;
+    }
+    else
+    {
+        startPhase(before);
+        b.attack(shots, hits, invalid, sinks, sunkShipIds);
+        endPhase(side, PHASE_ATTACK, before);
+        out() << attacker->name() << " fired a salvo of " << shots.count() << " shots:" << endl;
+    }
+    
+    size_t nextSink = 0;
+    for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+    {
+        if ( ! shots.test(cell))
+            continue;
+        Point p = cellPoint(cell);
+        int shipId = (sinks.test(cell) ? sunkShipIds[nextSink++] : 0);
+        if ( ! late)
+            recordOutcome(side, hits.test(cell), sinks.test(cell), shipId);
+        publishShot(attacker, p, late ? GameEvent::LATE : invalid.test(cell) ? GameEvent::INVALID :
+                                 sinks.test(cell) ? GameEvent::SUNK : hits.test(cell) ? GameEvent::HIT :
+                                 GameEvent::MISS, shipId);
+        if ( ! late)
         {
-            if (shotHit == true)
-            {
-                if (shipDestroyed)
-                {
-                    cout << p2->name() << " attacked (" << attacked.r << "," << attacked.c << ") and destroyed the " << p2->game().shipName(shipId) << ", resulting in:" << endl;
-                }
-                else
-                {
-                    cout << p2->name() << " attacked " << "(" << attacked.r << "," << attacked.c << ") and hit something, resulting in:" << endl;
-                }
-                
-            }
+            out() << "  (" << p.r << "," << p.c << ") ";
+            if (invalid.test(cell))
+                out() << "was wasted" << endl;
+            else if (sinks.test(cell))
+                out() << "destroyed the " << attacker->game().shipName(shipId) << endl;
+            else if (hits.test(cell))
+                out() << "hit something" << endl;
             else
-            {
-                cout << p2->name() << " attacked (" << attacked.r << "," << attacked.c << ") and missed, resulting in:" << endl;
-            }
-            
-            b1.display(p2->isHuman()); //only display after every valid attack
-            if(b1.allShipsDestroyed() == true) //player 1 won
-            {
-                cout << p2->name() << " wins!" << endl;
-                return p2;
-            }
-            p2->recordAttackResult(attacked, true, shotHit, shipDestroyed, shipId);
-        }
-        else //attacked at an already attacked or out of bounds spot
-        {
-            cout << p2->name() << " wasted a shot at " << "(" << attacked.r << "," << attacked.c << ")." << endl;
-            p2->recordAttackResult(attacked, false, shotHit, shipDestroyed, shipId);
+                out() << "missed" << endl;
         }
-        p1->recordAttackByOpponent(attacked);
-        
-        if (shouldPause == true)
-        {
-            cout << "Press enter to continue: ";
-            string s;
-            getline(cin,s);
-        }
-   
+        attacker->recordAttackResult(p, ! invalid.test(cell), hits.test(cell), sinks.test(cell), shipId);
+    }
+    if ( ! late && invalid != shots)
+    {
+        out() << "resulting in:" << endl;
+        if ( ! m_quiet)
+            b.display(attacker->isHuman()); //only display after a salvo with a valid shot
+    }
+    if (late) //a forfeited salvo never reached the defender's board
+        return false;
+    if (b.allShipsDestroyed())
+    {
+        return true;
+    }
+    for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+    {
+        if (shots.test(cell))
+            defender->recordAttackByOpponent(cellPoint(cell));
+    }
+    return false;
+}
+
+void GameImpl::publish(GameEvent e)
+{
+    if (m_events == nullptr)
+    {
+        return;
+    }
+    e.game = m_gameNumber;
+    m_events->publish(e);
+}
+
+void GameImpl::publishShot(const Player* attacker, Point p, int outcome, int shipId)
+{
+    if (m_events == nullptr)
+    {
+        return;
+    }
+    int player = (attacker == m_players[0] ? 0 : 1);
+    GameEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = GameEvent::SHOT;
+    e.turn = m_turns[player];
+    e.player = player;
+    e.r = p.r;
+    e.c = p.c;
+    e.outcome = outcome;
+    e.shipId = shipId;
+    publish(e);
+}
+
+void GameImpl::publishFleet(int player, const Board& b)
+{
+    if (m_events == nullptr)
+    {
+        return;
     }
+    BoardSnapshot s = b.snapshot();
+    GameEvent e;
+    memset(&e, 0, sizeof(e));
+    e.type = GameEvent::SHIP_PLACED;
+    e.player = player;
+    for (int i = 0; i < s.nShips; i++)
+    {
+        e.shipId = s.ships[i].id;
+        e.placement = s.ships[i].placement;
+        publish(e);
+    }
+}
+
+void GameImpl::setEventStream(EventStream* events)
+{
+    m_events = events;
+}
+
+void GameImpl::setQuiet(bool quiet)
+{
+    m_quiet = quiet;
+}
+
+ostream& GameImpl::out()
+{
+    return m_quiet ? m_silent : cout;
+}
+
+int GameImpl::turns(const Player* p) const
+{
+    if (p == m_players[0])
+        return m_turns[0];
+    if (p == m_players[1])
+        return m_turns[1];
+    return 0;
+}
+
+const vector<int>& GameImpl::sinkOrder(const Player* p) const
+{
+    static const vector<int> none;
+    if (p == m_players[0])
+        return m_sunk[0];
+    if (p == m_players[1])
+        return m_sunk[1];
+    return none;
+}
+
+int GameImpl::shots(const Player* p) const
+{
+    if (p == m_players[0])
+        return m_shots[0];
+    if (p == m_players[1])
+        return m_shots[1];
+    return 0;
+}
+
+const vector<int>& GameImpl::sinkShots(const Player* p) const
+{
+    static const vector<int> none;
+    if (p == m_players[0])
+        return m_sinkShots[0];
+    if (p == m_players[1])
+        return m_sinkShots[1];
+    return none;
+}
+
+const vector<int>& GameImpl::phases(const Player* p) const
+{
+    static const vector<int> none;
+    if (p == m_players[0])
+        return m_phases[0];
+    if (p == m_players[1])
+        return m_phases[1];
+    return none;
+}
+
+void GameImpl::countShots(int side, int n)
+{
+    if (n <= 0)
+        return;
+    m_shots[side] += n;
+    vector<int>& phases = m_phases[side];
+    size_t phase = (m_openHits[side] > 0 ? 1 : 0); //hunting phases are at even indexes
+    if ( ! phases.empty() && (phases.size() - 1) % 2 == phase)
+        phases.back() += n; //still in the same phase
+    else
+        phases.push_back(n);
+}
+
+void GameImpl::recordOutcome(int side, bool hit, bool destroyed, int shipId)
+{
+    if ( ! hit)
+        return;
+    m_openHits[side]++;
+    if (destroyed)
+    {
+        m_openHits[side] -= shipLength(shipId);
+        m_sunk[side].push_back(shipId);
+        m_sinkShots[side].push_back(m_shots[side]);
+    }
+}
+
+void GameImpl::startPhase(uint64_t before[NCOUNTERS]) const
+{
+    if (m_counters != nullptr)
+        m_counters->read(before);
+}
+
+void GameImpl::endPhase(int side, int phase, const uint64_t before[NCOUNTERS])
+{
+    if (m_counters == nullptr)
+        return;
+    uint64_t after[NCOUNTERS];
+    m_counters->read(after);
+    m_phaseCounts[side][phase].add(before, after);
+}
+
+void GameImpl::setCounters(PerfCounters* counters)
+{
+    m_counters = counters;
+}
+
+const PhaseCounts* GameImpl::phaseCounts(const Player* p) const
+{
+    if ( ! m_measured)
+        return nullptr;
+    if (p == m_players[0])
+        return m_phaseCounts[0];
+    if (p == m_players[1])
+        return m_phaseCounts[1];
+    return nullptr;
+}
+
+void GameImpl::setMoveTimeLimit(int ms)
+{
+    m_moveTimeLimit = (ms > 0 ? ms : 0);
+}
+
+int GameImpl::moveTimeLimit() const
+{
+    return m_moveTimeLimit;
+}
+
+void GameImpl::setSalvo(int shotsPerTurn)
+{
+    m_salvo = (shotsPerTurn < 0 ? 1 : shotsPerTurn);
+}
+
+int GameImpl::salvo() const
+{
+    return m_salvo;
+}
+
+int GameImpl::overruns(const Player* p) const
+{
+    for (int k = 0; k < 2; k++)
+    {
+        if (m_players[k] == p)
+            return m_overruns[k];
+    }
+    return 0;
 }
 
 //******************** Game functions *******************************
@@ -268,19 +877,9 @@ Point Game::randomPoint() const
     return m_impl->randomPoint();
 }
 
-bool Game::addShip(int length, char symbol, string name)
+  // The checks every new ship must pass, whatever its shape
+static bool checkNewShip(const Game& g, int nCells, char symbol)
 {
-    if (length < 1)
-    {
-        cout << "Bad ship length " << length << "; it must be >= 1" << endl;
-        return false;
-    }
-    if (length > rows()  &&  length > cols())
-    {
-        cout << "Bad ship length " << length << "; it won't fit on the board"
-             << endl;
-        return false;
-    }
     if (!isascii(symbol)  ||  !isprint(symbol))
     {
         cout << "Unprintable character with decimal value " << symbol
@@ -294,22 +893,110 @@ bool Game::addShip(int length, char symbol, string name)
         return false;
     }
     int totalOfLengths = 0;
-    for (int s = 0; s < nShips(); s++)
+    for (int s = 0; s < g.nShips(); s++)
     {
-        totalOfLengths += shipLength(s);
-        if (shipSymbol(s) == symbol)
+        totalOfLengths += g.shipLength(s);
+        if (g.shipSymbol(s) == symbol)
         {
             cout << "Ship symbol " << symbol
                  << " must not be used for more than one ship" << endl;
             return false;
         }
     }
-    if (totalOfLengths + length > rows() * cols())
+    if (totalOfLengths + nCells > g.rows() * g.cols())
     {
         cout << "Board is too small to fit all ships" << endl;
         return false;
     }
-    return m_impl->addShip(length, symbol, name);
+    return true;
+}
+
+bool Game::addShip(int length, char symbol, string name)
+{
+    if (length < 1)
+    {
+        cout << "Bad ship length " << length << "; it must be >= 1" << endl;
+        return false;
+    }
+    if (length > rows()  &&  length > cols())
+    {
+        cout << "Bad ship length " << length << "; it won't fit on the board"
+             << endl;
+        return false;
+    }
+    if ( ! checkNewShip(*this, length, symbol))
+        return false;
+    vector<Point> cells;
+    for (int i = 0; i < length; i++)
+        cells.push_back(Point(0, i));
+    return m_impl->addShip(cells, symbol, name);
+}
+
+bool Game::addShip(string shape, char symbol, string name)
+{
+    vector<Point> cells;
+    int r = 0;
+    int c = 0;
+    for (size_t i = 0; i < shape.size(); i++)
+    {
+        if (shape[i] == '/')
+        {
+            r++;
+            c = 0;
+            continue;
+        }
+        if (shape[i] == '#')
+            cells.push_back(Point(r, c));
+        else if (shape[i] != '.')
+        {
+            cout << "Bad ship shape " << shape << "; use # for cells, . for gaps, and / between rows"
+                 << endl;
+            return false;
+        }
+        c++;
+    }
+    if (cells.empty())
+    {
+        cout << "Bad ship shape " << shape << "; it has no cells" << endl;
+        return false;
+    }
+    
+      // The cells must form one piece, joined edge to edge
+    vector<bool> reached(cells.size(), false);
+    vector<size_t> stack(1, 0);
+    reached[0] = true;
+    size_t nReached = 1;
+    while ( ! stack.empty())
+    {
+        Point p = cells[stack.back()];
+        stack.pop_back();
+        for (size_t j = 0; j < cells.size(); j++)
+        {
+            if ( ! reached[j] && abs(cells[j].r - p.r) + abs(cells[j].c - p.c) == 1)
+            {
+                reached[j] = true;
+                nReached++;
+                stack.push_back(j);
+            }
+        }
+    }
+    if (nReached != cells.size())
+    {
+        cout << "Bad ship shape " << shape << "; its cells must be connected" << endl;
+        return false;
+    }
+    
+    if ( ! checkNewShip(*this, int(cells.size()), symbol))
+        return false;
+    if ( ! m_impl->addShip(cells, symbol, name))
+        return false;
+    if (placements(nShips() - 1).empty())
+    {
+        cout << "Bad ship shape " << shape << "; it won't fit on the board" << endl;
+        m_impl->removeLastShip();
+        return false;
+    }
+    return true;
 }
 
 int Game::nShips() const
@@ -335,6 +1022,106 @@ string Game::shipName(int shipId) const
     return m_impl->shipName(shipId);
 }
 
+string Game::shipShape(int shipId) const
+{
+    assert(shipId >= 0  &&  shipId < nShips());
+    return m_impl->shipShape(shipId);
+}
+
+bool Game::isStraight(int shipId) const
+{
+    assert(shipId >= 0  &&  shipId < nShips());
+    return m_impl->isStraight(shipId);
+}
+
+int Game::nOrientations(int shipId) const
+{
+    assert(shipId >= 0  &&  shipId < nShips());
+    return m_impl->nOrientations(shipId);
+}
+
+const vector<CellSet>& Game::placements(int shipId) const
+{
+    assert(shipId >= 0  &&  shipId < nShips());
+    return m_impl->placements(shipId);
+}
+
+int Game::placementAt(int shipId, Point topLeft, int orientation) const
+{
+    assert(shipId >= 0  &&  shipId < nShips());
+    return m_impl->placementAt(shipId, topLeft, orientation);
+}
+
+void Game::setMoveTimeLimit(int ms)
+{
+    m_impl->setMoveTimeLimit(ms);
+}
+
+int Game::moveTimeLimit() const
+{
+    return m_impl->moveTimeLimit();
+}
+
+int Game::overruns(const Player* p) const
+{
+    return m_impl->overruns(p);
+}
+
+void Game::setEventStream(EventStream* events)
+{
+    m_impl->setEventStream(events);
+}
+
+void Game::setCounters(PerfCounters* counters)
+{
+    m_impl->setCounters(counters);
+}
+
+const PhaseCounts* Game::phaseCounts(const Player* p) const
+{
+    return m_impl->phaseCounts(p);
+}
+
+void Game::setQuiet(bool quiet)
+{
+    m_impl->setQuiet(quiet);
+}
+
+int Game::turns(const Player* p) const
+{
+    return m_impl->turns(p);
+}
+
+const vector<int>& Game::sinkOrder(const Player* p) const
+{
+    return m_impl->sinkOrder(p);
+}
+
+int Game::shots(const Player* p) const
+{
+    return m_impl->shots(p);
+}
+
+const vector<int>& Game::sinkShots(const Player* p) const
+{
+    return m_impl->sinkShots(p);
+}
+
+const vector<int>& Game::phases(const Player* p) const
+{
+    return m_impl->phases(p);
+}
+
+void Game::setSalvo(int shotsPerTurn)
+{
+    m_impl->setSalvo(shotsPerTurn);
+}
+
+int Game::salvo() const
+{
+    return m_impl->salvo();
+}
+
 Player* Game::play(Player* p1, Player* p2, bool shouldPause)
 {
     if (p1 == nullptr  ||  p2 == nullptr  ||  nShips() == 0)
@@ -1,12 +1,19 @@
 #ifndef GAME_INCLUDED
 #define GAME_INCLUDED
 
+#include "globals.h"
 #include <string>
+#include <vector>
 #include <cassert>
 
-class Point;
 class Player;
 class GameImpl;
+class EventStream;
+class PerfCounters;
+struct PhaseCounts;
+
+  // For Game::setSalvo: fire one shot per ship the attacker has afloat
+const int SALVO_SHIPS_AFLOAT = 0;
 
 class Game
 {
@@ -18,11 +25,70 @@ class Game
     bool isValid(Point p) const;
     Point randomPoint() const;
     bool addShip(int length, char symbol, std::string name);
+      // Add a ship of any connected shape.  shape gives its rows from top
+      // to bottom, separated by '/', with '#' for each cell of the ship and
+      // '.' for gaps: "##/#." is an L of three cells.  The ship may lie in
+      // any rotation or reflection of the shape.
+    bool addShip(std::string shape, char symbol, std::string name);
     int nShips() const;
-    int shipLength(int shipId) const;
+    int shipLength(int shipId) const;  // the number of cells, for any shape
     char shipSymbol(int shipId) const;
     std::string shipName(int shipId) const;
+      // The ship in orientation 0, written as addShip(std::string, ...) takes it
+    std::string shipShape(int shipId) const;
+    bool isStraight(int shipId) const;
+      // The ship's distinct rotations and reflections.  Orientation 0 is
+      // the shape as given, except that a straight ship's 0 is horizontal
+      // and its 1 vertical.
+    int nOrientations(int shipId) const;
+      // Every set of cells the ship can occupy on the board, worked out
+      // once when the ship is added
+    const std::vector<CellSet>& placements(int shipId) const;
+      // The index into placements of the ship in the given orientation with
+      // the top left corner of its bounding box at topLeft, or -1 if it
+      // doesn't fit there
+    int placementAt(int shipId, Point topLeft, int orientation) const;
     Player* play(Player* p1, Player* p2, bool shouldPause = true);
+      // Give each computer player at most ms milliseconds to recommend an
+      // attack (0, the default, for no limit).  A shot recommended after
+      // the deadline is forfeited as a wasted shot.
+    void setMoveTimeLimit(int ms);
+    int moveTimeLimit() const;
+      // How many of p's moves ran out of time in the last game p played
+    int overruns(const Player* p) const;
+      // Salvo rules: each turn a player fires shotsPerTurn shots at once, or
+      // one for each of its ships still afloat if shotsPerTurn is
+      // SALVO_SHIPS_AFLOAT.  1, the default, is the ordinary game.
+    void setSalvo(int shotsPerTurn);
+    int salvo() const;
+      // Have play publish each game's start, fleets, shots and end to
+      // events (nullptr, the default, for none), for spectators to read.
+      // Only one game at a time may publish to a stream.
+    void setEventStream(EventStream* events);
+      // Have play read counters around each placement, each move's
+      // decision and each attack on a board, so phaseCounts can say where
+      // the time went (nullptr, the default, for no measuring).  The
+      // counters must belong to the thread that calls play.
+    void setCounters(PerfCounters* counters);
+      // With quiet set, play prints nothing (and shouldPause is ignored)
+    void setQuiet(bool quiet);
+      // How many turns p took in the last game p played
+    int turns(const Player* p) const;
+      // The opponent's ships p sank in the last game p played, by shipId,
+      // in the order it sank them
+    const std::vector<int>& sinkOrder(const Player* p) const;
+      // How many shots p fired in the last game p played, and how many it
+      // had fired when it sank each ship of sinkOrder
+    int shots(const Player* p) const;
+    const std::vector<int>& sinkShots(const Player* p) const;
+      // The lengths, in shots, of p's runs of hunting (with no hit it had
+      // yet to account for by a sinking) and targeting (with one) in the
+      // last game p played, alternately, hunting first
+    const std::vector<int>& phases(const Player* p) const;
+      // What the counters counted for p's phases in the last game p played
+      // with counters set, NPHASES of them by ProfilePhase; nullptr if p
+      // played no such game
+    const PhaseCounts* phaseCounts(const Player* p) const;
       // We prevent a Game object from being copied or assigned
     Game(const Game&) = delete;
     Game& operator=(const Game&) = delete;
@@ -0,0 +1,346 @@
+#include "Knowledge.h"
+#include "Game.h"
+#include "Snapshot.h"
+#include "globals.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+  // The Zobrist keys are derived from a fixed seed rather than stored in a
+  // random table, so every thread and every process agrees on them.
+static uint64_t zobristKey(uint64_t kind, uint64_t index)
+{
+    uint64_t z = (kind << 32) + index + 0x9E3779B97F4A7C15ULL; //splitmix64
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+const uint64_t KEY_MISS = 1;
+const uint64_t KEY_HIT = 2;
+const uint64_t KEY_SUNK = 3;
+const uint64_t KEY_CONFIG = 4;
+const uint64_t KEY_SHAPE = 5;
+
+shared_ptr<const Knowledge::Tables> Knowledge::tablesFor(const Game& g)
+{
+      // Placements depend only on the board size and the ships' shapes.
+      // The registry keeps the tables for good, since players come and go
+      // with every game but a process sees few setups.
+    static mutex registryLock;
+    static map<string, shared_ptr<const Tables> > registry;
+    string key = to_string(g.rows()) + "x" + to_string(g.cols());
+    for (int s = 0; s < g.nShips(); s++)
+    {
+        key += " " + g.shipShape(s);
+    }
+    lock_guard<mutex> lock(registryLock);
+    shared_ptr<const Tables>& shared = registry[key];
+    if (shared)
+        return shared;
+
+    shared_ptr<Tables> t = make_shared<Tables>();
+    t->placements.resize(g.nShips());
+    t->baseHash = zobristKey(KEY_CONFIG, g.rows() * 256 + g.cols());
+    for (int s = 0; s < g.nShips(); s++)
+    {
+        t->baseHash ^= zobristKey(KEY_CONFIG, 65536 * (s + 1) + g.shipLength(s));
+
+          // Every position of the ship, as the game worked them out
+        const vector<CellSet>& masks = g.placements(s);
+        for (size_t i = 0; i < masks.size(); i++)
+        {
+            Placement pl;
+            pl.mask = masks[i];
+            for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+            {
+                if (masks[i].test(cell))
+                    pl.cells.push_back(cell);
+            }
+            t->placements[s].push_back(pl);
+        }
+        if ( ! g.isStraight(s) && ! t->placements[s].empty()) //tell shapes of the same size apart
+        {
+            const vector<int>& cells = t->placements[s][0].cells;
+            for (size_t i = 0; i < cells.size(); i++)
+                t->baseHash ^= zobristKey(KEY_SHAPE, 65536 * (s + 1) + cells[i]);
+        }
+    }
+    shared = t;
+    return t;
+}
+
+Knowledge::Knowledge(const Game& g)
+ : m_game(g), m_tables(tablesFor(g))
+{
+    clear();
+}
+
+const Game& Knowledge::game() const
+{
+    return m_game;
+}
+
+void Knowledge::clear()
+{
+    m_shots.reset();
+    m_hits.reset();
+    m_sunkCells.reset();
+    m_sinkCell.assign(m_game.nShips(), -1);
+    m_resolved.assign(m_game.nShips(), false);
+    m_hash = m_tables->baseHash;
+}
+
+void Knowledge::record(Point p, bool validShot, bool shotHit, bool shipDestroyed, int shipId)
+{
+    if ( ! validShot || ! m_game.isValid(p) || isShot(p))
+    {
+        return; //wasted shots teach nothing
+    }
+    int cell = cellIndex(p);
+    m_shots.set(cell);
+    if (shotHit)
+    {
+        m_hits.set(cell);
+        m_hash ^= zobristKey(KEY_HIT, cell);
+        if (shipDestroyed && shipId >= 0 && shipId < m_game.nShips())
+        {
+            m_sinkCell[shipId] = cell;
+            m_hash ^= zobristKey(KEY_SUNK, shipId * 256 + cell);
+            resolveSunkShips();
+        }
+    }
+    else
+    {
+        m_hash ^= zobristKey(KEY_MISS, cell);
+    }
+}
+
+  // A sunk ship's cells are known once exactly one of its placements runs
+  // through the sinking shot over hits not already claimed by another sunk
+  // ship.  Pinning one ship down can settle another, so repeat until stuck.
+void Knowledge::resolveSunkShips()
+{
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        CellSet free = m_hits & ~m_sunkCells;
+        for (int s = 0; s < m_game.nShips(); s++)
+        {
+            if (m_sinkCell[s] < 0 || m_resolved[s])
+                continue;
+            int nFits = 0;
+            const Placement* fit = nullptr;
+            const vector<Placement>& pls = m_tables->placements[s];
+            for (size_t i = 0; i < pls.size(); i++)
+            {
+                const Placement& pl = pls[i];
+                if (pl.mask.test(m_sinkCell[s]) && (pl.mask & ~free).none())
+                {
+                    nFits++;
+                    fit = &pl;
+                }
+            }
+            if (nFits == 1)
+            {
+                m_sunkCells |= fit->mask;
+                m_resolved[s] = true;
+                progress = true;
+                free = m_hits & ~m_sunkCells;
+            }
+        }
+    }
+}
+
+bool Knowledge::isShot(Point p) const
+{
+    return m_shots.test(cellIndex(p));
+}
+
+const CellSet& Knowledge::shots() const
+{
+    return m_shots;
+}
+
+const CellSet& Knowledge::hits() const
+{
+    return m_hits;
+}
+
+CellSet Knowledge::misses() const
+{
+    return m_shots & ~m_hits;
+}
+
+const CellSet& Knowledge::sunkCells() const
+{
+    return m_sunkCells;
+}
+
+CellSet Knowledge::openHits() const
+{
+    return m_hits & ~m_sunkCells;
+}
+
+bool Knowledge::isSunk(int shipId) const
+{
+    return m_sinkCell[shipId] >= 0;
+}
+
+Point Knowledge::sinkPoint(int shipId) const
+{
+    return cellPoint(m_sinkCell[shipId]);
+}
+
+int Knowledge::nSunk() const
+{
+    int n = 0;
+    for (size_t s = 0; s < m_sinkCell.size(); s++)
+    {
+        if (m_sinkCell[s] >= 0)
+            n++;
+    }
+    return n;
+}
+
+const vector<Knowledge::Placement>& Knowledge::placements(int shipId) const
+{
+    return m_tables->placements[shipId];
+}
+
+void Knowledge::save(SnapshotWriter& w) const
+{
+    w.cells(m_shots);
+    w.cells(m_hits);
+    w.cells(m_sunkCells);
+    for (int s = 0; s < m_game.nShips(); s++)
+    {
+        w.u8(m_sinkCell[s] < 0 ? 0xFF : m_sinkCell[s]);
+        w.u8(m_resolved[s]);
+    }
+    w.u64(m_hash);
+}
+
+bool Knowledge::restore(SnapshotReader& r)
+{
+    m_shots = r.cells();
+    m_hits = r.cells();
+    m_sunkCells = r.cells();
+    for (int s = 0; s < m_game.nShips(); s++)
+    {
+        unsigned cell = r.u8();
+        m_sinkCell[s] = (cell == 0xFF ? -1 : int(cell));
+        m_resolved[s] = (r.u8() != 0);
+    }
+    uint64_t saved = r.u64();
+
+      // The hash keys the table every game shares, so it's worked out
+      // afresh rather than taken on trust, and a snapshot whose hash
+      // doesn't match what it says was shot is refused
+    m_hash = m_tables->baseHash;
+    for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+    {
+        if ( ! m_shots.test(cell))
+            continue;
+        if ( ! m_game.isValid(cellPoint(cell)))
+            r.fail();
+        m_hash ^= zobristKey(m_hits.test(cell) ? KEY_HIT : KEY_MISS, cell);
+    }
+    for (int s = 0; s < m_game.nShips(); s++)
+    {
+        if (m_sinkCell[s] < 0)
+            continue;
+        if (m_sinkCell[s] >= MAXROWS*MAXCOLS || ! m_hits.test(m_sinkCell[s]))
+            r.fail();
+        else
+            m_hash ^= zobristKey(KEY_SUNK, s * 256 + m_sinkCell[s]);
+    }
+    if (m_hash != saved || (m_hits & ~m_shots).any() || (m_sunkCells & ~m_hits).any())
+        r.fail();
+    if ( ! r.ok())
+    {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+uint64_t Knowledge::hash() const
+{
+    return m_hash;
+}
+
+void densityScores(const Knowledge& k, long long scores[MAXROWS*MAXCOLS], bool huntOnly)
+{
+    for (int i = 0; i < MAXROWS*MAXCOLS; i++)
+    {
+        scores[i] = 0;
+    }
+    CellSet blocked = k.misses() | k.sunkCells();
+    CellSet open = k.openHits();
+    bool targeting = open.any() && !huntOnly; //once something is hit, only finish it off
+
+      // If no afloat ship can explain the open hits (they belong to a sunk
+      // ship we couldn't pin down), fall back to hunting
+    for (int pass = 0; pass < 2; pass++)
+    {
+        bool counted = false;
+        for (int s = 0; s < k.game().nShips(); s++)
+        {
+            if (k.isSunk(s))
+                continue;
+            const vector<Knowledge::Placement>& pls = k.placements(s);
+            for (size_t i = 0; i < pls.size(); i++)
+            {
+                const Knowledge::Placement& pl = pls[i];
+                if ((pl.mask & blocked).any())
+                    continue;
+                long long weight = 1;
+                if (targeting)
+                {
+                    size_t covered = (pl.mask & open).count();
+                    if (covered == 0)
+                        continue;
+                    for (size_t h = 0; h < covered && h < 5; h++)
+                        weight *= 20; //lining up with more hits is far likelier
+                }
+                for (size_t j = 0; j < pl.cells.size(); j++)
+                {
+                    scores[pl.cells[j]] += weight;
+                }
+                counted = true;
+            }
+        }
+        if (counted || ! targeting)
+            return;
+        targeting = false;
+    }
+}
+
+Point bestDensityShot(const Knowledge& k, long long& bestScore)
+{
+    long long scores[MAXROWS*MAXCOLS];
+    densityScores(k, scores);
+
+    int best = -1;
+    bestScore = -1;
+    for (int r = 0; r < k.game().rows(); r++)
+    {
+        for (int c = 0; c < k.game().cols(); c++)
+        {
+            int cell = cellIndex(Point(r,c));
+            if ( ! k.shots().test(cell) && scores[cell] > bestScore)
+            {
+                best = cell;
+                bestScore = scores[cell];
+            }
+        }
+    }
+    return best < 0 ? Point(0,0) : cellPoint(best);
+}
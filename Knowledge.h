@@ -0,0 +1,83 @@
+#ifndef KNOWLEDGE_INCLUDED
+#define KNOWLEDGE_INCLUDED
+
+#include "globals.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Game;
+class SnapshotReader;
+class SnapshotWriter;
+
+  // Everything an attacker has learned about the opponent's board: the
+  // cells shot, which of them hit, and which ships have been sunk where.
+  // It also keeps a Zobrist hash of that state, updated with every shot,
+  // so identical knowledge reached in different games hashes the same.
+  // What depends only on the board size and fleet, such as where each ship
+  // could lie, is worked out once and shared, read only, by every
+  // Knowledge of games set up alike, so each one is small.
+class Knowledge
+{
+  public:
+      // One way a ship can lie on the board
+    struct Placement
+    {
+        CellSet mask;
+        std::vector<int> cells;  // the cell indexes in mask
+    };
+
+    Knowledge(const Game& g);
+    const Game& game() const;
+    void clear();
+    void record(Point p, bool validShot, bool shotHit, bool shipDestroyed,
+                int shipId);
+
+    bool isShot(Point p) const;
+    const CellSet& shots() const;
+    const CellSet& hits() const;
+    CellSet misses() const;
+      // Hits known to belong to sunk ships, and the hits not yet explained
+    const CellSet& sunkCells() const;
+    CellSet openHits() const;
+    bool isSunk(int shipId) const;
+    Point sinkPoint(int shipId) const;
+    int nSunk() const;
+    const std::vector<Placement>& placements(int shipId) const;
+    std::uint64_t hash() const;
+      // Write everything recorded to w, for restore on a Knowledge of a
+      // game set up the same way; restore returns false if what it reads
+      // doesn't fit this game
+    void save(SnapshotWriter& w) const;
+    bool restore(SnapshotReader& r);
+
+  private:
+    struct Tables
+    {
+        std::vector<std::vector<Placement> > placements;  // per ship
+        std::uint64_t baseHash;       // identifies the board size and fleet
+    };
+      // The tables for games set up as g is, made if no Knowledge has them
+    static std::shared_ptr<const Tables> tablesFor(const Game& g);
+    void resolveSunkShips();
+
+    const Game& m_game;
+    std::shared_ptr<const Tables> m_tables;
+    CellSet m_shots;
+    CellSet m_hits;
+    CellSet m_sunkCells;
+    std::vector<int> m_sinkCell;      // per ship: cell of the sinking shot, or -1
+    std::vector<bool> m_resolved;     // per sunk ship: whether its cells are known
+    std::uint64_t m_hash;
+};
+
+  // Score every cell by how many placements of the ships still afloat are
+  // consistent with k and cover it; placements through unexplained hits
+  // count far more.  scores is indexed by cell index.  Returns the
+  // highest-scoring unshot cell and sets bestScore to its score.  With
+  // huntOnly, densityScores ignores the hits and just counts placements.
+Point bestDensityShot(const Knowledge& k, long long& bestScore);
+void densityScores(const Knowledge& k, long long scores[MAXROWS*MAXCOLS],
+                   bool huntOnly = false);
+
+#endif // KNOWLEDGE_INCLUDED
@@ -0,0 +1,359 @@
+#include "OpeningBook.h"
+#include "Game.h"
+#include "Knowledge.h"
+#include "globals.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char BOOK_MAGIC[8] = { 'B', 'S', 'B', 'O', 'O', 'K', '0', '1' };
+const int BOOK_MAX_SHIPS = 8;
+const int BOOK_MAX_SHOTS = 24;  //an opening this long without a hit is rare
+
+struct BookHeader
+{
+    char magic[8];
+    uint32_t nLines;
+    uint32_t reserved;
+};
+
+struct BookEntry
+{
+    uint8_t rows;
+    uint8_t cols;
+    uint8_t nShips;
+    uint8_t nShots;
+    uint8_t lengths[BOOK_MAX_SHIPS];  // longest first
+    uint32_t offset;                  // of the shots, from the start of the file
+};
+
+//*********************************************************************
+//  OpeningLine
+//*********************************************************************
+
+OpeningLine::OpeningLine()
+ : m_shots(nullptr), m_nShots(0), m_transposed(false)
+{}
+
+OpeningLine::OpeningLine(const unsigned char* shots, int nShots, bool transposed)
+ : m_shots(shots), m_nShots(nShots), m_transposed(transposed)
+{}
+
+int OpeningLine::nShots() const
+{
+    return m_nShots;
+}
+
+bool OpeningLine::shot(int k, Point& p) const
+{
+    if (k < 0 || k >= m_nShots)
+    {
+        return false;
+    }
+    Point q = cellPoint(m_shots[k]);
+    p = (m_transposed ? Point(q.c, q.r) : q);
+    return true;
+}
+
+//*********************************************************************
+//  OpeningBook
+//*********************************************************************
+
+OpeningBook::OpeningBook()
+ : m_data(nullptr), m_size(0)
+{}
+
+OpeningBook::~OpeningBook()
+{
+    close();
+}
+
+bool OpeningBook::open(string path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(BookHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+    m_data = static_cast<const unsigned char*>(mem);
+    m_size = st.st_size;
+
+      // Check the whole book once here so that lookups needn't
+    const BookHeader* header = reinterpret_cast<const BookHeader*>(m_data);
+    bool ok = memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) == 0 &&
+              sizeof(BookHeader) + size_t(header->nLines) * sizeof(BookEntry) <= m_size;
+    const BookEntry* entries = reinterpret_cast<const BookEntry*>(m_data + sizeof(BookHeader));
+    for (uint32_t i = 0; ok && i < header->nLines; i++)
+    {
+        ok = entries[i].nShips <= BOOK_MAX_SHIPS &&
+             size_t(entries[i].offset) + entries[i].nShots <= m_size;
+        for (int k = 0; ok && k < entries[i].nShots; k++)
+        {
+            ok = m_data[entries[i].offset + k] < MAXROWS*MAXCOLS;
+        }
+    }
+    if ( ! ok)
+    {
+        close();
+    }
+    return ok;
+}
+
+void OpeningBook::close()
+{
+    if (m_data != nullptr)
+    {
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
+bool OpeningBook::isOpen() const
+{
+    return m_data != nullptr;
+}
+
+OpeningLine OpeningBook::find(const Game& g) const
+{
+    if (m_data == nullptr || g.nShips() > BOOK_MAX_SHIPS)
+    {
+        return OpeningLine();
+    }
+    uint8_t lengths[BOOK_MAX_SHIPS] = {};
+    for (int s = 0; s < g.nShips(); s++)
+    {
+        if ( ! g.isStraight(s))
+            return OpeningLine(); //the book only knows straight fleets
+        lengths[s] = g.shipLength(s);
+    }
+    sort(lengths, lengths + g.nShips(), greater<uint8_t>());
+
+    const BookHeader* header = reinterpret_cast<const BookHeader*>(m_data);
+    const BookEntry* entries = reinterpret_cast<const BookEntry*>(m_data + sizeof(BookHeader));
+    for (uint32_t i = 0; i < header->nLines; i++)
+    {
+        const BookEntry& e = entries[i];
+        if (e.nShips != g.nShips() || memcmp(e.lengths, lengths, sizeof(lengths)) != 0)
+            continue;
+        if (e.rows == g.rows() && e.cols == g.cols())
+            return OpeningLine(m_data + e.offset, e.nShots, false);
+        if (e.rows == g.cols() && e.cols == g.rows()) //same board turned sideways
+            return OpeningLine(m_data + e.offset, e.nShots, true);
+    }
+    return OpeningLine();
+}
+
+OpeningBook& openingBook()
+{
+    static OpeningBook book;
+    return book;
+}
+
+//*********************************************************************
+//  Book generation
+//*********************************************************************
+
+  // The t-th symmetry of a rows x cols board: the four reflections and
+  // rotations every board has, then four more that only a square one has
+static Point transform(int t, Point p, int rows, int cols)
+{
+    switch (t)
+    {
+      case 0:  return p;
+      case 1:  return Point(p.r, cols-1 - p.c);
+      case 2:  return Point(rows-1 - p.r, p.c);
+      case 3:  return Point(rows-1 - p.r, cols-1 - p.c);
+      case 4:  return Point(p.c, p.r);
+      case 5:  return Point(cols-1 - p.c, p.r);
+      case 6:  return Point(p.c, rows-1 - p.r);
+      default: return Point(cols-1 - p.c, rows-1 - p.r);
+    }
+}
+
+  // Placement counts per cell when every shot so far has missed
+static long long missOnlyScores(const Knowledge& k, const CellSet& misses,
+                                long long scores[MAXROWS*MAXCOLS])
+{
+    long long total = 0;
+    for (int i = 0; i < MAXROWS*MAXCOLS; i++)
+    {
+        scores[i] = 0;
+    }
+    for (int s = 0; s < k.game().nShips(); s++)
+    {
+        const vector<Knowledge::Placement>& pls = k.placements(s);
+        for (size_t i = 0; i < pls.size(); i++)
+        {
+            if ((pls[i].mask & misses).any())
+                continue;
+            for (size_t j = 0; j < pls[i].cells.size(); j++)
+            {
+                scores[pls[i].cells[j]]++;
+            }
+            total += pls[i].cells.size();
+        }
+    }
+    return total;
+}
+
+  // The opening for one board and fleet.  Each shot is the one that
+  // maximizes the placements it covers now plus, should it miss, those the
+  // best next shot would cover.  Cells that a symmetry of the board fixing
+  // the misses so far maps onto each other score the same, so only one
+  // cell of each such orbit is evaluated.
+static vector<unsigned char> computeOpening(const Game& g)
+{
+    Knowledge k(g);
+    int nTransforms = (g.rows() == g.cols() ? 8 : 4);
+    CellSet misses;
+    vector<unsigned char> line;
+    long long now[MAXROWS*MAXCOLS];
+    long long next[MAXROWS*MAXCOLS];
+
+    while (int(line.size()) < BOOK_MAX_SHOTS && missOnlyScores(k, misses, now) > 0)
+    {
+        vector<int> stabilizer;
+        for (int t = 0; t < nTransforms; t++)
+        {
+            bool fixes = true;
+            for (int cell = 0; cell < MAXROWS*MAXCOLS && fixes; cell++)
+            {
+                if (misses.test(cell))
+                    fixes = misses.test(cellIndex(transform(t, cellPoint(cell), g.rows(), g.cols())));
+            }
+            if (fixes)
+                stabilizer.push_back(t);
+        }
+
+        int best = -1;
+        long long bestValue = -1;
+        for (int r = 0; r < g.rows(); r++)
+        {
+            for (int c = 0; c < g.cols(); c++)
+            {
+                int cell = cellIndex(Point(r,c));
+                if (misses.test(cell) || now[cell] == 0)
+                    continue;
+                bool representative = true;
+                for (size_t t = 0; t < stabilizer.size() && representative; t++)
+                {
+                    representative = cellIndex(transform(stabilizer[t], Point(r,c), g.rows(), g.cols())) >= cell;
+                }
+                if ( ! representative)
+                    continue;
+
+                CellSet after = misses;
+                after.set(cell);
+                missOnlyScores(k, after, next);
+                long long bestNext = 0;
+                for (int i = 0; i < MAXROWS*MAXCOLS; i++)
+                {
+                    if ( ! after.test(i) && next[i] > bestNext)
+                        bestNext = next[i];
+                }
+                long long value = 2 * now[cell] + bestNext;
+                if (value > bestValue)
+                {
+                    best = cell;
+                    bestValue = value;
+                }
+            }
+        }
+        if (best < 0)
+            break;
+        line.push_back(best);
+        misses.set(best);
+    }
+    return line;
+}
+
+bool writeOpeningBook(string path)
+{
+    struct Config
+    {
+        int rows;
+        int cols;
+        vector<int> lengths;
+    };
+    vector<Config> configs = {
+        { 10, 10, { 5, 4, 3, 3, 2 } },
+        {  9,  9, { 5, 4, 3, 3, 2 } },
+        {  8,  8, { 5, 4, 3, 3, 2 } },
+        { 10, 10, { 4, 3, 3, 2 } },
+        {  7,  7, { 4, 3, 3, 2 } },
+        {  6,  6, { 3, 3, 2 } },
+        { 10,  8, { 5, 4, 3, 3, 2 } },
+    };
+
+    vector<BookEntry> entries;
+    vector<unsigned char> shots;
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        Game g(configs[i].rows, configs[i].cols);
+        for (size_t s = 0; s < configs[i].lengths.size(); s++)
+        {
+            g.addShip(configs[i].lengths[s], char('A' + s), "ship");
+        }
+        vector<unsigned char> line = computeOpening(g);
+
+        BookEntry e;
+        memset(&e, 0, sizeof(e));
+        e.rows = g.rows();
+        e.cols = g.cols();
+        e.nShips = g.nShips();
+        e.nShots = line.size();
+        for (int s = 0; s < g.nShips(); s++)
+        {
+            e.lengths[s] = g.shipLength(s);
+        }
+        sort(e.lengths, e.lengths + g.nShips(), greater<uint8_t>());
+        e.offset = shots.size(); //made absolute below
+        entries.push_back(e);
+        shots.insert(shots.end(), line.begin(), line.end());
+    }
+
+    BookHeader header;
+    memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+    header.nLines = entries.size();
+    header.reserved = 0;
+    uint32_t shotsStart = sizeof(BookHeader) + entries.size() * sizeof(BookEntry);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        entries[i].offset += shotsStart;
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr)
+    {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(entries.data(), sizeof(BookEntry), entries.size(), f) == entries.size() &&
+              fwrite(shots.data(), 1, shots.size(), f) == shots.size();
+    return fclose(f) == 0 && ok;
+}
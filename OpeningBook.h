@@ -0,0 +1,56 @@
+#ifndef OPENINGBOOK_INCLUDED
+#define OPENINGBOOK_INCLUDED
+
+#include "globals.h"
+#include <cstddef>
+#include <string>
+
+class Game;
+
+  // The book's opening for one board size and fleet: the shots to fire, in
+  // order, for as long as every earlier shot has missed
+class OpeningLine
+{
+  public:
+    OpeningLine();
+    OpeningLine(const unsigned char* shots, int nShots, bool transposed);
+    int nShots() const;
+      // Set p to the shot to fire as shot number k (from 0); false once the
+      // line has run out
+    bool shot(int k, Point& p) const;
+
+  private:
+    const unsigned char* m_shots;  // cell indexes, stored as for the book's board
+    int m_nShots;
+    bool m_transposed;             // the game's board is the book's, turned on its side
+};
+
+  // A precomputed book of openings, read straight from a mapped file
+class OpeningBook
+{
+  public:
+    OpeningBook();
+    ~OpeningBook();
+    bool open(std::string path);
+    void close();
+    bool isOpen() const;
+      // The line for g's board size and fleet; it has no shots if the book
+      // doesn't cover them
+    OpeningLine find(const Game& g) const;
+      // We prevent an OpeningBook object from being copied or assigned
+    OpeningBook(const OpeningBook&) = delete;
+    OpeningBook& operator=(const OpeningBook&) = delete;
+
+  private:
+    const unsigned char* m_data;
+    std::size_t m_size;
+};
+
+  // The book the AI players consult; empty unless someone opens it
+OpeningBook& openingBook();
+
+  // Compute openings for the common board sizes and fleets and write them
+  // to a book at path
+bool writeOpeningBook(std::string path);
+
+#endif // OPENINGBOOK_INCLUDED
@@ -0,0 +1,157 @@
+#include "OpponentModel.h"
+#include "globals.h"
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static_assert(atomic<uint64_t>::is_always_lock_free &&
+              atomic<uint32_t>::is_always_lock_free,
+              "the mapped records rely on lock-free atomics");
+
+const int NSLOTS = 256;  //opponents remembered per store; must be a power of 2
+const char MODEL_MAGIC[8] = { 'B', 'S', 'O', 'P', 'P', 'M', 'D', 'L' };
+const uint32_t MODEL_VERSION = 2;
+
+struct OpponentModel::ModelFile
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nSlots;
+    OpponentRecord slots[NSLOTS];
+};
+
+void OpponentRecord::recordShot(Point p, int shotNumber)
+{
+    int weight = MAXROWS*MAXCOLS - shotNumber; //early shots say most about a strategy
+    if (weight < 1)
+        weight = 1;
+    heat[p.r*MAXCOLS + p.c].fetch_add(weight, memory_order_relaxed);
+    shotsLogged.fetch_add(1, memory_order_relaxed);
+}
+
+uint32_t OpponentRecord::heatAt(Point p) const
+{
+    return heat[p.r*MAXCOLS + p.c].load(memory_order_relaxed);
+}
+
+void OpponentRecord::recordShipCell(Point p)
+{
+    shipCells[p.r*MAXCOLS + p.c].fetch_add(1, memory_order_relaxed);
+}
+
+uint32_t OpponentRecord::shipCellsAt(Point p) const
+{
+    return shipCells[p.r*MAXCOLS + p.c].load(memory_order_relaxed);
+}
+
+OpponentModel::OpponentModel()
+ : m_file(nullptr)
+{}
+
+OpponentModel::~OpponentModel()
+{
+    close();
+}
+
+bool OpponentModel::open(string path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    bool fresh = (fstat(fd, &st) != 0 || st.st_size != sizeof(ModelFile));
+    if (fresh && ftruncate(fd, sizeof(ModelFile)) != 0) //new or unusable file
+    {
+        ::close(fd);
+        return false;
+    }
+    void* mem = mmap(nullptr, sizeof(ModelFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); //the mapping keeps the file alive
+    if (mem == MAP_FAILED)
+    {
+        return false;
+    }
+    m_file = static_cast<ModelFile*>(mem);
+
+    if (fresh || memcmp(m_file->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0 ||
+        m_file->version != MODEL_VERSION || m_file->nSlots != NSLOTS)
+    {
+        memset(static_cast<void*>(m_file), 0, sizeof(ModelFile)); //start an empty store
+        memcpy(m_file->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+        m_file->version = MODEL_VERSION;
+        m_file->nSlots = NSLOTS;
+    }
+    return true;
+}
+
+void OpponentModel::close()
+{
+    if (m_file != nullptr)
+    {
+        munmap(m_file, sizeof(ModelFile));
+        m_file = nullptr;
+    }
+}
+
+bool OpponentModel::isOpen() const
+{
+    return m_file != nullptr;
+}
+
+OpponentRecord* OpponentModel::find(string opponentName, bool create)
+{
+    if (m_file == nullptr)
+    {
+        return nullptr;
+    }
+    char name[sizeof(OpponentRecord().name)] = {};
+    strncpy(name, opponentName.c_str(), sizeof(name) - 1); //long names are truncated
+
+    uint64_t key = 14695981039346656037ULL; //FNV-1a hash of the stored name
+    for (const char* s = name; *s != '\0'; s++)
+    {
+        key = (key ^ static_cast<unsigned char>(*s)) * 1099511628211ULL;
+    }
+    if (key == 0)
+        key = 1;
+
+      // Linear probing from the hash; a slot is claimed by swapping its key
+      // from 0, so two players naming the same new opponent agree on it
+    for (int probe = 0; probe < NSLOTS; probe++)
+    {
+        OpponentRecord& rec = m_file->slots[(key + probe) & (NSLOTS - 1)];
+        uint64_t k = rec.key.load(memory_order_acquire);
+        if (k == 0)
+        {
+            if ( ! create)
+                return nullptr;
+            uint64_t expected = 0;
+            if (rec.key.compare_exchange_strong(expected, key, memory_order_acq_rel))
+            {
+                memcpy(rec.name, name, sizeof(name));
+                return &rec;
+            }
+            k = expected; //someone else claimed it first
+        }
+        if (k == key) //64-bit hashes of distinct names don't collide in practice
+        {
+            return &rec;
+        }
+    }
+    return nullptr; //store is full
+}
+
+OpponentModel& opponentModel()
+{
+    static OpponentModel model;
+    return model;
+}
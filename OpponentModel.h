@@ -0,0 +1,57 @@
+#ifndef OPPONENTMODEL_INCLUDED
+#define OPPONENTMODEL_INCLUDED
+
+#include "globals.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+  // What we have learned about one opponent, kept in the mapped file.
+  // Every update is a single atomic add, so players in different threads
+  // or processes can share a record.
+struct OpponentRecord
+{
+    std::atomic<std::uint64_t> key;   // hash of the name; 0 for a free slot
+    char name[32];
+    std::atomic<std::uint32_t> games;
+    std::atomic<std::uint32_t> shotsLogged;
+      // Each shot the opponent fires at cell (r,c) adds a weight to
+      // heat[r*MAXCOLS+c] that is larger the earlier in the game it came
+    std::atomic<std::uint32_t> heat[MAXROWS*MAXCOLS];
+      // Every fleet the opponent revealed at game end adds 1 to
+      // shipCells[r*MAXCOLS+c] for each cell (r,c) it occupied
+    std::atomic<std::uint32_t> fleetsSeen;
+    std::atomic<std::uint32_t> shipCells[MAXROWS*MAXCOLS];
+
+    void recordShot(Point p, int shotNumber);
+    std::uint32_t heatAt(Point p) const;
+    void recordShipCell(Point p);
+    std::uint32_t shipCellsAt(Point p) const;
+};
+
+class OpponentModel
+{
+  public:
+    OpponentModel();
+    ~OpponentModel();
+      // Map the store at path, creating it if needed
+    bool open(std::string path);
+    void close();
+    bool isOpen() const;
+      // Find the record for the named opponent; with create, claim a free
+      // slot for a new name.  Returns nullptr if not found or not open.
+    OpponentRecord* find(std::string opponentName, bool create);
+      // We prevent an OpponentModel object from being copied or assigned
+    OpponentModel(const OpponentModel&) = delete;
+    OpponentModel& operator=(const OpponentModel&) = delete;
+
+  private:
+    struct ModelFile;
+    ModelFile* m_file;
+};
+
+  // The process-wide store used by the AI players; it stays closed (and
+  // the players learn nothing) unless someone opens it.
+OpponentModel& opponentModel();
+
+#endif // OPPONENTMODEL_INCLUDED
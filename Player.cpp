@@ -1,13 +1,301 @@
 #include "Player.h"
 #include "Board.h"
+#include "Endgame.h"
+#include "Engine.h"
+#include "Equilibrium.h"
 #include "Game.h"
+#include "Knowledge.h"
+#include "OpeningBook.h"
+#include "OpponentModel.h"
+#include "PolicyNet.h"
+#include "Probability.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include "TranspositionTable.h"
 #include "globals.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <utility>
 
 #include <vector>
 using namespace std;
 
+
+  // When a search for p's next move must stop: somewhat before p's deadline,
+  // leaving time to answer, or never if the game has no limit, in which
+  // case the search bounds its own work
+static Clock::time_point searchDeadline(const Player& p)
+{
+    Clock::time_point now = Clock::now();
+    if (p.deadline() == Clock::time_point::max())
+        return p.deadline();
+    if (p.deadline() <= now)
+        return now;
+    return p.deadline() - (p.deadline() - now) / 4; //a quarter held in reserve
+}
+
+  // Whether so few ships are left that the exact endgame search is worth trying
+static bool inEndgame(const Knowledge& k)
+{
+    return k.nSunk() >= k.game().nShips() - 2;
+}
+
+  // Points in snapshots, a byte a coordinate; players' points may lie just
+  // off the board
+static void savePoint(SnapshotWriter& w, Point p)
+{
+    w.u8((unsigned char)(signed char)(p.r));
+    w.u8((unsigned char)(signed char)(p.c));
+}
+
+static Point restorePoint(SnapshotReader& r)
+{
+    int row = (signed char)(r.u8());
+    int col = (signed char)(r.u8());
+    return Point(row, col);
+}
+
+//*********************************************************************
+//  Ponderer
+//*********************************************************************
+
+// Thinks on the opponent's time for the players whose moves search.  As
+// soon as a player has chosen a shot it starts, on background threads,
+// on its replies to that shot missing and to it hitting, and after
+// learning the result it starts on the actual position if that wasn't
+// one of them (a sinking, say).  A pondered search runs for as long as
+// the opponent thinks, so the next move is usually ready at once, and
+// searched deeper than it could be in the move's own time.
+//
+// The search must depend only on the knowledge, and stop once its
+// workLimit drops below the work it has done, or at once at 0, so a
+// reply taken with no deadline is at least the one the player would
+// have found itself.
+
+class Ponderer
+{
+public:
+    typedef Point (*Search)(const Knowledge& k, Clock::time_point searchUntil,
+                            const atomic<long>* workLimit);
+
+    Ponderer(Search search);
+    ~Ponderer();
+    void setOn(bool on);
+    bool isOn() const { return m_on; }
+      // Start on the replies to shot from k missing, unless missToo is
+      // false (the book answers a miss), and hitting
+    void startReplies(const Knowledge& k, Point shot, bool missToo);
+      // The position is now k: drop the replies to what didn't happen
+    void follow(const Knowledge& k);
+      // If the reply to k is under way, set shot to it and return true.
+      // Untimed, the search does at least what one started now would;
+      // timed, it has until searchUntil, then gives the best it has.
+    bool take(const Knowledge& k, Clock::time_point searchUntil, Point& shot);
+
+private:
+    struct Ponder
+    {
+        uint64_t key;                        //the position being replied to
+        shared_ptr<atomic<long> > workLimit; //lowered to cut the search short
+        future<Point> reply;
+    };
+
+    void start(const Knowledge& k);
+      // Stop working out the replies to every position but keep, leaving
+      // them to finish on their own rather than waiting for them
+    void abandon(uint64_t keep = 0);
+
+    Search m_search;
+    bool m_on;                  //whether to think on the opponent's time
+    vector<Ponder> m_ponders;   //replies being worked out
+    vector<Ponder> m_abandoned; //replies no longer wanted, winding down
+};
+
+Ponderer::Ponderer(Search search)
+ : m_search(search), m_on(false)
+{}
+
+Ponderer::~Ponderer()
+{
+    abandon(); //so destroying their futures waits only for them to notice
+}
+
+void Ponderer::setOn(bool on)
+{
+    m_on = on;
+    if ( ! on)
+        abandon();
+}
+
+void Ponderer::startReplies(const Knowledge& k, Point shot, bool missToo)
+{
+    if ( ! m_on || ! k.game().isValid(shot) || k.isShot(shot))
+        return;
+    if (missToo)
+    {
+        Knowledge ifMiss = k;
+        ifMiss.record(shot, true, false, false, -1);
+        start(ifMiss);
+    }
+    Knowledge ifHit = k;
+    ifHit.record(shot, true, true, false, -1);
+    start(ifHit);
+}
+
+void Ponderer::follow(const Knowledge& k)
+{
+    if ( ! m_on)
+        return;
+    abandon(k.hash()); //the reply to the other result is no use now
+    if (m_ponders.empty())
+        start(k);
+}
+
+bool Ponderer::take(const Knowledge& k, Clock::time_point searchUntil, Point& shot)
+{
+    abandon(k.hash());
+    if (m_ponders.empty())
+        return false;
+    Ponder& pondered = m_ponders[0];
+    if (searchUntil == Clock::time_point::max())
+        pondered.workLimit->store(ENDGAME_WORK);
+    else if (pondered.reply.wait_until(searchUntil) != future_status::ready)
+        pondered.workLimit->store(0);
+    shot = pondered.reply.get();
+    m_ponders.clear();
+    return true;
+}
+
+void Ponderer::start(const Knowledge& k)
+{
+    for (size_t i = 0; i < m_ponders.size(); i++)
+    {
+        if (m_ponders[i].key == k.hash())
+            return; //already on it
+    }
+    Ponder pondered;
+    pondered.key = k.hash();
+    pondered.workLimit = make_shared<atomic<long> >(LONG_MAX); //until we need the answer
+    shared_ptr<atomic<long> > workLimit = pondered.workLimit;
+    Search search = m_search;
+    pondered.reply = async(launch::async, [k, workLimit, search]() {
+        return search(k, Clock::time_point::max(), workLimit.get());
+    });
+    m_ponders.push_back(move(pondered));
+}
+
+void Ponderer::abandon(uint64_t keep)
+{
+    for (size_t i = 0; i < m_ponders.size(); )
+    {
+        if (m_ponders[i].key == keep && keep != 0)
+        {
+            i++;
+            continue;
+        }
+        m_ponders[i].workLimit->store(0);
+        m_abandoned.push_back(move(m_ponders[i]));
+        m_ponders.erase(m_ponders.begin() + i);
+    }
+    for (size_t i = 0; i < m_abandoned.size(); )
+    {
+        if (m_abandoned[i].reply.wait_for(chrono::seconds(0)) == future_status::ready)
+            m_abandoned.erase(m_abandoned.begin() + i);
+        else
+            i++;
+    }
+}
+
+//*********************************************************************
+//  Player
+//*********************************************************************
+
+CellSet Player::recommendAttacks(int k)
+{
+    CellSet shots;
+    int nCells = game().rows() * game().cols();
+    if (k > nCells)
+        k = nCells;
+    if (k < 1)
+        return shots;
+      // recommendAttack may count on hearing the result of one shot before
+      // it's asked for another, so ask only once
+    Point p = recommendAttack();
+    if (game().isValid(p))
+        shots.set(cellIndex(p));
+    while (int(shots.count()) < k)
+    {
+        shots.set(cellIndex(game().randomPoint()));
+    }
+    return shots;
+}
+
+  // Add to shots, until it has n cells or k's unshot cells run out, those
+  // of k's unshot cells not in avoid that densityScores rates highest,
+  // hunting's rating breaking ties, so once the cells around open hits
+  // run out the rest of a salvo hunts
+static void addDensityShots(const Knowledge& k, int n, CellSet& shots, const CellSet& avoid)
+{
+    long long scores[MAXROWS*MAXCOLS];
+    long long hunt[MAXROWS*MAXCOLS];
+    densityScores(k, scores);
+    densityScores(k, hunt, true);
+    vector<int> cells;
+    for (int r = 0; r < k.game().rows(); r++)
+    {
+        for (int c = 0; c < k.game().cols(); c++)
+        {
+            int cell = cellIndex(Point(r,c));
+            if ( ! k.isShot(Point(r,c)) && ! shots.test(cell) && ! avoid.test(cell))
+                cells.push_back(cell);
+        }
+    }
+    int more = n - int(shots.count());
+    if (more > int(cells.size()))
+        more = int(cells.size());
+    if (more <= 0)
+        return;
+    partial_sort(cells.begin(), cells.begin() + more, cells.end(), [&](int a, int b) {
+        return scores[a] != scores[b] ? scores[a] > scores[b] : hunt[a] > hunt[b];
+    });
+    for (int i = 0; i < more; i++)
+    {
+        shots.set(cells[i]);
+    }
+}
+
+  // The n of k's unshot cells that scores rates highest, best first, or
+  // all of them if fewer are left; of cells scored alike, the earlier
+  // comes first
+static vector<int> bestUnshotCells(const Knowledge& k, const long long scores[MAXROWS*MAXCOLS], int n)
+{
+    vector<int> cells;
+    for (int r = 0; r < k.game().rows(); r++)
+    {
+        for (int c = 0; c < k.game().cols(); c++)
+        {
+            if ( ! k.isShot(Point(r,c)))
+                cells.push_back(cellIndex(Point(r,c)));
+        }
+    }
+    if (n > int(cells.size()))
+        n = int(cells.size());
+    if (n < 0)
+        n = 0;
+    partial_sort(cells.begin(), cells.begin() + n, cells.end(), [&](int a, int b) {
+        return scores[a] != scores[b] ? scores[a] > scores[b] : a < b;
+    });
+    cells.resize(n);
+    return cells;
+}
+
 //*********************************************************************
 //  AwfulPlayer
 //*********************************************************************
@@ -18,9 +306,12 @@ class AwfulPlayer : public Player
     AwfulPlayer(string nm, const Game& g);
     virtual bool placeShips(Board& b);
     virtual Point recommendAttack();
+    virtual CellSet recommendAttacks(int k);
     virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
                                                 bool shipDestroyed, int shipId);
     virtual void recordAttackByOpponent(Point p);
+    virtual bool saveState(SnapshotWriter& w) const;
+    virtual bool restoreState(SnapshotReader& r);
   private:
     Point m_lastCellAttacked;
 };
@@ -33,8 +324,16 @@ bool AwfulPlayer::placeShips(Board& b)
 {
       // Clustering ships is bad strategy
     for (int k = 0; k < game().nShips(); k++)
-        if ( ! b.placeShip(Point(k,0), k, HORIZONTAL)) //placeShip(point, id, direction)
+    {
+        if (b.placeShip(Point(k,0), k, HORIZONTAL)) //placeShip(point, id, direction)
+            continue;
+          // A shaped ship may not fit there; take the first place it does
+        bool placed = false;
+        for (size_t i = 0; i < game().placements(k).size() && !placed; i++)
+            placed = b.placeShip(k, int(i));
+        if ( ! placed)
             return false;
+    }
     return true;
 }
 
@@ -53,6 +352,18 @@ Point AwfulPlayer::recommendAttack()
     return m_lastCellAttacked;
 }
 
+  // The next k cells of the sweep, which ignores results anyway
+CellSet AwfulPlayer::recommendAttacks(int k)
+{
+    CellSet shots;
+    int nCells = game().rows() * game().cols();
+    for (int i = 0; i < k && i < nCells; i++)
+    {
+        shots.set(cellIndex(recommendAttack()));
+    }
+    return shots;
+}
+
 void AwfulPlayer::recordAttackResult(Point /* p */, bool /* validShot */,
                                      bool /* shotHit */, bool /* shipDestroyed */,
                                      int /* shipId */)
@@ -65,6 +376,18 @@ void AwfulPlayer::recordAttackByOpponent(Point /* p */)
       // AwfulPlayer completely ignores what the opponent does
 }
 
+bool AwfulPlayer::saveState(SnapshotWriter& w) const
+{
+    savePoint(w, m_lastCellAttacked);
+    return true;
+}
+
+bool AwfulPlayer::restoreState(SnapshotReader& r)
+{
+    m_lastCellAttacked = restorePoint(r);
+    return r.ok();
+}
+
 //*********************************************************************
 //  HumanPlayer
 //*********************************************************************
@@ -87,9 +410,15 @@ class HumanPlayer: public Player
     virtual bool isHuman() const;
     virtual bool placeShips(Board& b);
     virtual Point recommendAttack();
+    virtual CellSet recommendAttacks(int k);
     virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
                                                 bool shipDestroyed, int shipId);
     virtual void recordAttackByOpponent(Point p);
+      // A human's game is all in their head, so there's nothing to save
+    virtual bool saveState(SnapshotWriter& /* w */) const { return true; }
+    virtual bool restoreState(SnapshotReader& r) { return r.ok(); }
+  private:
+    void placeShapedShip(Board& b, int shipId);
 };
 
 HumanPlayer::HumanPlayer(string nm, const Game& g):Player(nm,g) {}
@@ -105,6 +434,12 @@ bool HumanPlayer::placeShips(Board& b)
     {
         b.display(false);
         
+        if (game().isStraight(i) == false) //a shape is placed by orientation instead
+        {
+            placeShapedShip(b, i);
+            continue;
+        }
+        
         while (true)
         {
             cout << "Enter h or v for direction of " << game().shipName(i) << " (length " << game().shipLength(i) << "): ";
@@ -160,6 +495,74 @@ bool HumanPlayer::placeShips(Board& b)
     return true;
 }
 
+void HumanPlayer::placeShapedShip(Board& b, int shipId)
+{
+    //show each orientation that fits, drawn in its bounding box
+    for (int o = 0; o < game().nOrientations(shipId); o++)
+    {
+        int pl = game().placementAt(shipId, Point(0,0), o);
+        if (pl < 0)
+        {
+            continue;
+        }
+        const CellSet& cells = game().placements(shipId)[pl];
+        int height = 0;
+        int width = 0;
+        for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+        {
+            if (cells.test(cell))
+            {
+                height = max(height, cellPoint(cell).r + 1);
+                width = max(width, cellPoint(cell).c + 1);
+            }
+        }
+        cout << "Orientation " << o << ":" << endl;
+        for (int r = 0; r < height; r++)
+        {
+            cout << "  ";
+            for (int c = 0; c < width; c++)
+            {
+                cout << (cells.test(cellIndex(Point(r,c))) ? game().shipSymbol(shipId) : '.');
+            }
+            cout << endl;
+        }
+    }
+    
+    int orientation;
+    while (true)
+    {
+        cout << "Enter the orientation of " << game().shipName(shipId) << " (" << game().shipLength(shipId) << " cells): ";
+        int unused;
+        string line;
+        getline(cin, line);
+        istringstream iss(line);
+        if ((iss >> orientation) && !(iss >> unused) && game().placementAt(shipId, Point(0,0), orientation) >= 0)
+        {
+            break;
+        }
+        cout << "That's not one of the orientations shown." << endl;
+    }
+    
+    int row;
+    int col;
+    while (true)
+    {
+        cout << "Enter row and column of the top left corner of its outline (e.g., 3 5): ";
+        if (getLineWithTwoIntegers(row,col) == true)
+        {
+            if (b.placeShip(shipId, game().placementAt(shipId, Point(row,col), orientation)) == true)
+            {
+                return;
+            }
+            cout << "The ship cannot be placed there." << endl;
+        }
+        else
+        {
+            cout << "You must enter two integers." << endl;
+        }
+    }
+}
+
 Point HumanPlayer::recommendAttack()
 {
     int row;
@@ -180,6 +583,31 @@ Point HumanPlayer::recommendAttack()
     }
 }
 
+CellSet HumanPlayer::recommendAttacks(int k)
+{
+    CellSet shots;
+    if (k > game().rows() * game().cols())
+        k = game().rows() * game().cols();
+    cout << "Your salvo has " << k << (k == 1 ? " shot." : " shots.") << endl;
+    while (int(shots.count()) < k) //loops until k different cells on the board are chosen
+    {
+        Point p = recommendAttack();
+        if (game().isValid(p) == false)
+        {
+            cout << "That cell is not on the board." << endl;
+        }
+        else if (shots.test(cellIndex(p)))
+        {
+            cout << "That cell is already in this salvo." << endl;
+        }
+        else
+        {
+            shots.set(cellIndex(p));
+        }
+    }
+    return shots;
+}
+
 void HumanPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool shipDestroyed, int shipId)
 {
     // HumanPlayer completely ignores the result of any attack
@@ -201,14 +629,18 @@ class MediocrePlayer : public Player
     MediocrePlayer(string nm, const Game& g);
     virtual bool placeShips(Board& b);
     virtual Point recommendAttack();
+    virtual CellSet recommendAttacks(int k);
     virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
                                                 bool shipDestroyed, int shipId);
     virtual void recordAttackByOpponent(Point p);
+    virtual bool saveState(SnapshotWriter& w) const;
+    virtual bool restoreState(SnapshotReader& r);
     
     bool recursive(Board& b, int shipId);
     
     bool newPoint(Point p);
   private:
+    Point randomNewPoint(); //a point not attacked before, now counted as attacked
     vector<Point> prevMoves; //vector that stores all the previous Points of the player
     int playerState;
     int crossPoints;
@@ -279,19 +711,7 @@ Point MediocrePlayer::recommendAttack()
 {
     if (playerState == 1) //has not hit a new ship yet (or just destroyed one).. so randomly attack
     {
-        Point p;
-        while (true)
-        {
-            p.r = randInt(game().rows());
-            p.c = randInt(game().cols());
-            if (newPoint(p) == true)
-            {
-                break;
-            }
-        }
-        //exit while loop, meaning found a point that has not been previously hit
-        prevMoves.push_back(p);
-        return p;
+        return randomNewPoint();
     }
     
     else //if playerState == 2
@@ -326,6 +746,38 @@ Point MediocrePlayer::recommendAttack()
     }
 }
 
+Point MediocrePlayer::randomNewPoint()
+{
+    Point p;
+    while (true)
+    {
+        p.r = randInt(game().rows());
+        p.c = randInt(game().cols());
+        if (newPoint(p) == true)
+        {
+            break;
+        }
+    }
+    //exit while loop, meaning found a point that has not been previously hit
+    prevMoves.push_back(p);
+    return p;
+}
+
+  // Each shot of a salvo is picked as a single shot would be, so a hit by
+  // any of them can start the cross search.  If the cross runs out partway
+  // through, the rest of the salvo is random.
+CellSet MediocrePlayer::recommendAttacks(int k)
+{
+    CellSet shots;
+    int nLeft = game().rows() * game().cols() - int(prevMoves.size());
+    for (int i = 0; i < k && i < nLeft; i++)
+    {
+        Point p = (playerState == 2 && crossPoints == 0 ? randomNewPoint() : recommendAttack());
+        shots.set(cellIndex(p));
+    }
+    return shots;
+}
+
 bool MediocrePlayer::newPoint(Point p) //checks to see if the Point p is not one of the previous points in the vector
 {
     for (int i = 0; i < prevMoves.size(); i++)
@@ -366,11 +818,12 @@ void MediocrePlayer::recordAttackResult(Point p, bool validShot, bool shotHit, b
             }
             playerState = 2;
         }
-        //checks to see if all the crossPoints have been hit already
-        if (crossPoints == 0)
-        {
-            playerState = 1;
-        }
+    }
+    //checks to see if all the crossPoints have been hit already; a ship
+    //that isn't straight may not lie wholly on the cross
+    if (playerState == 2 && crossPoints == 0)
+    {
+        playerState = 1;
     }
 }
 
@@ -379,21 +832,95 @@ void MediocrePlayer::recordAttackByOpponent(Point p)
     //this function does nothing for the Mediocre class
 }
 
+bool MediocrePlayer::saveState(SnapshotWriter& w) const
+{
+    w.u16(unsigned(prevMoves.size()));
+    for (size_t i = 0; i < prevMoves.size(); i++)
+    {
+        savePoint(w, prevMoves[i]);
+    }
+    w.u8(playerState);
+    w.u16(crossPoints);
+    savePoint(w, center);
+    return true;
+}
+
+bool MediocrePlayer::restoreState(SnapshotReader& r)
+{
+    prevMoves.resize(r.u16());
+    for (size_t i = 0; i < prevMoves.size(); i++)
+    {
+        prevMoves[i] = restorePoint(r);
+    }
+    playerState = int(r.u8());
+    crossPoints = int(r.u16());
+    center = restorePoint(r);
+    return r.ok();
+}
+
 //*********************************************************************
 //  GoodPlayer
 //*********************************************************************
 
+  // What GoodPlayer has seen of each cell, two bits a cell: 0 for not yet
+  // shot, 1 for a miss, 2 for a hit, 3 for part of a ship it has sunk
+class ShotMarks
+{
+  public:
+    ShotMarks() { clear(); }
+    void clear()
+    {
+        for (int w = 0; w < WORDS; w++)
+            m_words[w] = 0;
+    }
+    int get(int r, int c) const
+    {
+        int i = r * MAXCOLS + c;
+        return int(m_words[i / 32] >> (2 * (i % 32))) & 3;
+    }
+    void set(int r, int c, int mark)
+    {
+        int i = r * MAXCOLS + c;
+        uint64_t& w = m_words[i / 32];
+        w = (w & ~(uint64_t(3) << (2 * (i % 32)))) | (uint64_t(mark) << (2 * (i % 32)));
+    }
+
+  private:
+    static const int WORDS = (MAXROWS*MAXCOLS + 31) / 32;
+    uint64_t m_words[WORDS];
+};
+
+  // GoodPlayer's shot in the position k if it's in the endgame and has
+  // few enough layouts left to solve, and (-1,-1) otherwise; the search
+  // stops at searchUntil, and within workLimit if given
+static Point goodEndgameChoice(const Knowledge& k, Clock::time_point searchUntil,
+                               const atomic<long>* workLimit)
+{
+    Point shot(-1, -1);
+    if (inEndgame(k))
+        endgameShot(k, searchUntil, shot, 1000, nullptr, workLimit);
+    return shot;
+}
+
 class GoodPlayer: public Player
 {
 public:
   GoodPlayer(string nm, const Game& g);
   virtual bool placeShips(Board& b);
   virtual Point recommendAttack();
+  virtual CellSet recommendAttacks(int k);
   virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
                                               bool shipDestroyed, int shipId);
   virtual void recordAttackByOpponent(Point p);
+  virtual void recordOpponentName(string nm);
+  virtual void recordOpponentFleet(const Board& b);
+  virtual void setPondering(bool on);
+  virtual bool saveState(SnapshotWriter& w) const;
+  virtual bool restoreState(SnapshotReader& r);
   
   bool recursive(Board& b, int shipId);
+  bool placeAwayFromHeat(Board& b);
+  Point weightedHuntPoint();
     
 private:
     int playerState;
@@ -404,29 +931,55 @@ private:
     bool end1Reached;
     bool end2Reached;
     bool falseDestruction;
-    int m_board[MAXROWS][MAXCOLS]; //board for recording misses/hits/sunken ships
+    ShotMarks m_board; //board for recording misses/hits/sunken ships
+    OpponentRecord* m_opponent; //what the opponent model knows of this opponent, if anything
+    int m_opponentShots; //shots the opponent has fired at us this game
+    bool m_usePriors; //whether the opponent has revealed fleets in earlier games
+    int m_huntWeight[MAXROWS][MAXCOLS]; //how strongly to favour each cell while scanning
+    OpeningLine m_opening; //the book's opening for this board and fleet
+    int m_openingShots; //how far along the opening we are
+    bool m_inOpening; //true until the first hit
+    Knowledge m_knowledge; //exact record of our shots, for the endgame search
+    bool m_shapedFleet; //some ship isn't straight
+    CellSet m_salvoOthers; //shots of the salvo under way that recommendAttack didn't pick
+    CellSet m_otherHits; //hits by such shots, to follow up once hunting again
+    Ponderer m_ponderer; //works out endgame replies on a human's time
+
+    Point chooseShot();
 };
 
-GoodPlayer::GoodPlayer(string nm, const Game& g): Player(nm,g)
+GoodPlayer::GoodPlayer(string nm, const Game& g)
+ : Player(nm,g), m_knowledge(g), m_ponderer(goodEndgameChoice)
 {
     playerState = 1;
     numMoves = 0;
     dir = HORIZONTAL;
+    end1Reached = false;
     end2Reached = false;
     falseDestruction = false;
-    
-    //initialize the board to record attacks to zeroes
-    for (int r = 0; r < game().rows(); r++)
+    m_opponent = nullptr;
+    m_opponentShots = 0;
+    m_usePriors = false;
+    m_opening = openingBook().find(g);
+    m_openingShots = 0;
+    m_inOpening = true;
+    m_shapedFleet = false;
+    for (int s = 0; s < g.nShips(); s++)
     {
-        for (int c = 0; c < game().cols(); c++)
-        {
-            m_board[r][c] = 0;
-        }
+        if ( ! g.isStraight(s))
+            m_shapedFleet = true;
     }
+    
+    //the board to record attacks starts out all zeroes
 }
 
 bool GoodPlayer::placeShips(Board& b)
 {
+    if (m_opponent != nullptr && m_opponent->shotsLogged > 0 && placeAwayFromHeat(b) == true)
+    {
+        return true; //steered clear of where this opponent likes to shoot
+    }
+    
     //place the ships...
     for (int i = 0; i < 50; i++)
     {
@@ -478,13 +1031,71 @@ bool GoodPlayer::recursive(Board& b, int shipId)
 }
 
 
+  // Only the endgame search is worth pondering; a sinking that brings
+  // the endgame on is pondered once its result is known
 Point GoodPlayer::recommendAttack()
+{
+    Point shot = chooseShot();
+    if (inEndgame(m_knowledge))
+        m_ponderer.startReplies(m_knowledge, shot, true);
+    return shot;
+}
+
+Point GoodPlayer::chooseShot()
 {
     int row = game().rows()/2;
     int col = game().cols()/2;
     
+    Point endgame;
+    Clock::time_point searchUntil = searchDeadline(*this);
+    if ( ! m_ponderer.take(m_knowledge, searchUntil, endgame))
+        endgame = goodEndgameChoice(m_knowledge, searchUntil, nullptr);
+    if (game().isValid(endgame))
+    {
+        return endgame; //few enough layouts left to solve exactly
+    }
+    
+    if (m_shapedFleet) //following lines of hits only finds straight ships
+    {
+        if (m_knowledge.openHits().any())
+        {
+            long long score;
+            return bestDensityShot(m_knowledge, score);
+        }
+        playerState = 1; //nothing left to finish off
+    }
+    
+    CellSet unfollowed = m_otherHits & m_knowledge.openHits();
+    if (playerState == 1 && unfollowed.any()) //another shot of a salvo hit something
+    {
+        int cell;
+        for (cell = 0; ! unfollowed.test(cell); cell++)
+            ;
+        m_otherHits.reset(cell);
+        end1 = cellPoint(cell);
+        end2 = end1;
+        playerState = 2; //look around it as if we had hit it ourselves
+    }
+    
     if (playerState == 1) //no ship hit yet; scanning...
     {
+        if (m_usePriors == true) //aim where this opponent has put ships before
+        {
+            return weightedHuntPoint();
+        }
+        if (m_inOpening == true) //follow the book while everything has missed
+        {
+            Point p;
+            while (m_opening.shot(m_openingShots, p))
+            {
+                m_openingShots++;
+                if (m_board.get(p.r, p.c) == 0)
+                {
+                    return p;
+                }
+            }
+            m_inOpening = false;
+        }
         int numLoops = 0;
         numMoves++;
         if (numMoves < 13) // if true...attack the first half of the board
@@ -499,7 +1110,7 @@ Point GoodPlayer::recommendAttack()
                    numMoves = 14;
                    break;
                 }
-                if (m_board[row][col] == 0) //if found a new, valid point...
+                if (m_board.get(row, col) == 0) //if found a new, valid point...
                 {
                     break;
                 }
@@ -513,7 +1124,7 @@ Point GoodPlayer::recommendAttack()
             {
                 row = randInt(game().rows());
                 col = randInt(game().cols());
-                if (m_board[row][col] == 0) //if found a new, valid point...
+                if (m_board.get(row, col) == 0) //if found a new, valid point...
                 {
                     break;
                 }
@@ -525,7 +1136,7 @@ Point GoodPlayer::recommendAttack()
     {
         if (dir == HORIZONTAL)
         {
-            if (end1Reached == false && game().isValid(Point(end1.r, end1.c-1)) && m_board[end1.r][end1.c -1] == 0) //horizontal left attack
+            if (end1Reached == false && game().isValid(Point(end1.r, end1.c-1)) && m_board.get(end1.r, end1.c -1) == 0) //horizontal left attack
             {
                 return Point(end1.r, end1.c-1);
             }
@@ -533,7 +1144,7 @@ Point GoodPlayer::recommendAttack()
             {
                 end1Reached = true;
             }
-            if (end2Reached == false && game().isValid(Point(end2.r, end2.c + 1 )) && m_board[end2.r][end2.c + 1] == 0) //horizontal right attack
+            if (end2Reached == false && game().isValid(Point(end2.r, end2.c + 1 )) && m_board.get(end2.r, end2.c + 1) == 0) //horizontal right attack
             {
                 return Point(end2.r, end2.c+1);
             }
@@ -544,7 +1155,7 @@ Point GoodPlayer::recommendAttack()
         }
         else if (dir == VERTICAL)
         {
-            if (end1Reached == false && game().isValid(Point(end1.r-1, end1.c)) && m_board[end1.r-1][end1.c] == 0) //vertically up attack
+            if (end1Reached == false && game().isValid(Point(end1.r-1, end1.c)) && m_board.get(end1.r-1, end1.c) == 0) //vertically up attack
             {
                 return Point(end1.r-1, end1.c);
             }
@@ -552,7 +1163,7 @@ Point GoodPlayer::recommendAttack()
             {
                 end1Reached = true;
             }
-            if (end2Reached == false && game().isValid(Point(end2.r+1, end2.c)) && m_board[end2.r+1][end2.c] == 0) //vertically down attack
+            if (end2Reached == false && game().isValid(Point(end2.r+1, end2.c)) && m_board.get(end2.r+1, end2.c) == 0) //vertically down attack
             {
                 return Point(end2.r+1, end2.c);
             }
@@ -573,7 +1184,7 @@ Point GoodPlayer::recommendAttack()
             {
                 for (int c = 0; c < game().cols(); c++)
                 {
-                    if (m_board[r][c] == 2) //if ship is hit but not sunk
+                    if (m_board.get(r, c) == 2) //if ship is hit but not sunk
                     {
                         end1.r = r;
                         end1.c = c;
@@ -586,19 +1197,19 @@ Point GoodPlayer::recommendAttack()
         }
         for (int i = 1; i < 5; i++) //basically the cross method from mediocre player but gradual for max effect
         {
-            if (game().isValid(Point(end1.r - i, end1.c)) && m_board[end1.r - i][end1.c] == 0) //up
+            if (game().isValid(Point(end1.r - i, end1.c)) && m_board.get(end1.r - i, end1.c) == 0) //up
             {
                 return Point(end1.r-i, end1.c);
             }
-            else if (game().isValid(Point(end1.r, end1.c - i)) && m_board[end1.r][end1.c - i] == 0) //left
+            else if (game().isValid(Point(end1.r, end1.c - i)) && m_board.get(end1.r, end1.c - i) == 0) //left
             {
                 return Point(end1.r, end1.c-i);
             }
-            else if (game().isValid(Point(end2.r + i, end1.c)) && m_board[end2.r + i][end2.c] == 0) //down
+            else if (game().isValid(Point(end2.r + i, end1.c)) && m_board.get(end2.r + i, end2.c) == 0) //down
             {
                 return Point(end2.r+i, end2.c);
             }
-            else if (game().isValid(Point(end2.r, end2.c + i)) && m_board[end2.r][end2.c + i] == 0) //right
+            else if (game().isValid(Point(end2.r, end2.c + i)) && m_board.get(end2.r, end2.c + i) == 0) //right
             {
                 return Point(end2.r, end2.c+i);
             }
@@ -609,12 +1220,68 @@ Point GoodPlayer::recommendAttack()
     return Point(row,col);
 }
 
+  // A salvo's first shot is the one recommendAttack picks, and only its
+  // result moves the targeting state on; the rest are the cells density
+  // rates highest, whose hits are followed up once the state is back to
+  // hunting.  Random extras would waste shots on cells already shot, and
+  // their hits would send the state after cells it never chose.
+CellSet GoodPlayer::recommendAttacks(int k)
+{
+    CellSet shots;
+    if (k < 1)
+        return shots;
+    Point p = chooseShot();
+    if (game().isValid(p))
+        shots.set(cellIndex(p));
+    CellSet marked; //cells the board already accounts for
+    for (int r = 0; r < game().rows(); r++)
+    {
+        for (int c = 0; c < game().cols(); c++)
+        {
+            if (m_board.get(r, c) != 0)
+                marked.set(cellIndex(Point(r,c)));
+        }
+    }
+    addDensityShots(m_knowledge, k, shots, marked);
+    m_salvoOthers = shots;
+    if (game().isValid(p))
+        m_salvoOthers.reset(cellIndex(p));
+    return shots;
+}
+
 void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool shipDestroyed, int shipId)
 {
+    m_knowledge.record(p, validShot, shotHit, shipDestroyed, shipId);
+    if (inEndgame(m_knowledge))
+        m_ponderer.follow(m_knowledge);
+    if (game().isValid(p) && m_salvoOthers.test(cellIndex(p)))
+    {
+          // Not the shot the state chose: just mark the board
+        m_salvoOthers.reset(cellIndex(p));
+        if (validShot == false) {return;}
+        m_board.set(p.r, p.c, shotHit ? 2 : 1);
+        if (shotHit == true)
+        {
+            m_inOpening = false;
+            m_otherHits.set(cellIndex(p));
+        }
+        const CellSet& sunk = m_knowledge.sunkCells();
+        for (int r = 0; r < game().rows(); r++)
+        {
+            for (int c = 0; c < game().cols(); c++)
+            {
+                if (sunk.test(cellIndex(Point(r,c))))
+                    m_board.set(r, c, 3);
+            }
+        }
+        return;
+    }
     if (validShot == false) {return;}
     
     if (shotHit == true) //if Point p hit a ship
     {
+        m_inOpening = false; //the book only covers openings that keep missing
+        
         if (shipDestroyed == true) //the ship has been hit and sunk
         {
             if (end1.c == p.c)
@@ -632,7 +1299,8 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
                 {
                     for (int i = 0; i < game().shipLength(shipId); i++)
                     {
-                        m_board[p.r + i][p.c] = 3;
+                        if (game().isValid(Point(p.r + i, p.c))) //guessed extent may run off the board
+                            m_board.set(p.r + i, p.c, 3);
                     }
                 }
                 else
@@ -640,7 +1308,8 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
                     //mark the ship as sunk on the 2D board array
                     for (int i = 0; i < game().shipLength(shipId); i++)
                     {
-                        m_board[p.r - i][p.c] = 3;
+                        if (game().isValid(Point(p.r - i, p.c))) //guessed extent may run off the board
+                            m_board.set(p.r - i, p.c, 3);
                     }
                 }
             }
@@ -650,7 +1319,8 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
                 {
                     for (int i = 0; i < game().shipLength(shipId); i++)
                     {
-                        m_board[p.r][p.c+i] = 3;
+                        if (game().isValid(Point(p.r, p.c+i))) //guessed extent may run off the board
+                            m_board.set(p.r, p.c+i, 3);
                     }
                 }
                 else
@@ -658,7 +1328,8 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
                     //mark the ship as sunk on the 2D board array
                     for (int i = 0; i < game().shipLength(shipId); i++)
                     {
-                        m_board[p.r][p.c-i] = 3;
+                        if (game().isValid(Point(p.r, p.c-i))) //guessed extent may run off the board
+                            m_board.set(p.r, p.c-i, 3);
                     }
                 }
             }
@@ -670,7 +1341,7 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
                 {
                     for (int c = 0; c < game().cols(); c++)
                     {
-                        if (m_board[r][c] == 2)
+                        if (m_board.get(r, c) == 2)
                         {
                             notAllDestroyed = false;
                         }
@@ -699,7 +1370,7 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
         }
         else //the ship has been hit but not destroyed...  when hit something, check the bounds...
         {
-            m_board[p.r][p.c] = 2;
+            m_board.set(p.r, p.c, 2);
             if (playerState == 1) // if it was randomly searching and got first hit...
             {
                 playerState = 2;
@@ -739,22 +1410,22 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
             {
                 if (dir == HORIZONTAL) //end1 to end2 spans from left to right
                 {
-                    if (end1.c == 0 || m_board[end1.r][end1.c-1] == 1)
+                    if (end1.c == 0 || m_board.get(end1.r, end1.c-1) == 1)
                     {
                         end1Reached = true;
                     }
-                    if (end2.c == game().cols()-1 || m_board[end2.r][end2.c+1] == 1)
+                    if (end2.c == game().cols()-1 || m_board.get(end2.r, end2.c+1) == 1)
                     {
                         end2Reached = true;
                     }
                 }
                 if (dir == VERTICAL) //end1 to end2 spans from up to down
                 {
-                    if (end1.r == 0 || m_board[end1.r-1][end1.c] == 1)
+                    if (end1.r == 0 || m_board.get(end1.r-1, end1.c) == 1)
                     {
                         end1Reached = true;
                     }
-                    if (end2.r == game().rows()-1 || m_board[end2.r+1][end2.c] == 1)
+                    if (end2.r == game().rows()-1 || m_board.get(end2.r+1, end2.c) == 1)
                     {
                         end2Reached = true;
                     }
@@ -782,22 +1453,848 @@ void GoodPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool
     }
     else //the player missed
     {
-        m_board[p.r][p.c] = 1;
+        m_board.set(p.r, p.c, 1);
     }
 }
 
-void GoodPlayer::recordAttackByOpponent(Point p){}
-
-
-
-//*********************************************************************
+//picks, out of many random layouts, the one covering the cells this opponent shoots at least
+bool GoodPlayer::placeAwayFromHeat(Board& b)
+{
+    Layout best;
+    long long bestHeat = -1;
+    for (int i = 0; i < 200; i++)
+    {
+        Layout candidate;
+        if (randomLayout(game(), candidate) == false)
+        {
+            break;
+        }
+        CellSet cells;
+        for (int shipId = 0; shipId < game().nShips(); shipId++)
+        {
+            cells |= game().placements(shipId)[candidate[shipId]];
+        }
+        long long heat = 0;
+        for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+        {
+            if (cells.test(cell))
+                heat += m_opponent->heatAt(cellPoint(cell));
+        }
+        if (bestHeat < 0 || heat < bestHeat)
+        {
+            bestHeat = heat;
+            best = candidate;
+        }
+    }
+    return bestHeat >= 0 && applyLayout(b, best);
+}
+
+void GoodPlayer::recordAttackByOpponent(Point p)
+{
+    if (m_opponent != nullptr && game().isValid(p)) //log the shot for later games
+    {
+        m_opponent->recordShot(p, m_opponentShots);
+    }
+    m_opponentShots++;
+}
+
+//draws an unattacked cell with probability proportional to its hunt weight
+Point GoodPlayer::weightedHuntPoint()
+{
+    long total = 0;
+    for (int r = 0; r < game().rows(); r++)
+    {
+        for (int c = 0; c < game().cols(); c++)
+        {
+            if (m_board.get(r, c) == 0)
+                total += m_huntWeight[r][c];
+        }
+    }
+    long pick = (total > 0 ? randLong(total) : 0);
+    for (int r = 0; r < game().rows(); r++)
+    {
+        for (int c = 0; c < game().cols(); c++)
+        {
+            if (m_board.get(r, c) == 0)
+            {
+                pick -= m_huntWeight[r][c];
+                if (pick < 0)
+                    return Point(r,c);
+            }
+        }
+    }
+    return game().randomPoint(); //every cell has been attacked
+}
+
+void GoodPlayer::recordOpponentName(string nm)
+{
+    m_opponent = opponentModel().find(nm, true);
+    m_opponentShots = 0;
+    m_usePriors = false;
+    if (m_opponent != nullptr)
+    {
+        m_opponent->games++;
+        
+        //weight each cell by how often the opponent's revealed fleets covered it,
+        //on top of a floor so no cell is ever ruled out
+        int fleets = m_opponent->fleetsSeen;
+        m_usePriors = (fleets > 0);
+        for (int r = 0; r < game().rows(); r++)
+        {
+            for (int c = 0; c < game().cols(); c++)
+            {
+                m_huntWeight[r][c] = fleets + 4 * int(m_opponent->shipCellsAt(Point(r,c)));
+            }
+        }
+    }
+}
+
+void GoodPlayer::recordOpponentFleet(const Board& b)
+{
+    if (m_opponent == nullptr)
+    {
+        return;
+    }
+    for (int r = 0; r < game().rows(); r++)
+    {
+        for (int c = 0; c < game().cols(); c++)
+        {
+            if (b.isShipCell(Point(r,c)))
+                m_opponent->recordShipCell(Point(r,c));
+        }
+    }
+    m_opponent->fleetsSeen++;
+}
+
+void GoodPlayer::setPondering(bool on)
+{
+    m_ponderer.setOn(on);
+}
+
+bool GoodPlayer::saveState(SnapshotWriter& w) const
+{
+    w.u8(playerState);
+    w.u16(numMoves);
+    w.u8(dir);
+    savePoint(w, end1);
+    savePoint(w, end2);
+    w.u8(end1Reached);
+    w.u8(end2Reached);
+    w.u8(falseDestruction);
+    w.bytes(&m_board, sizeof(m_board));
+      // The opponent's record is found again by name; the hunt weights
+      // are kept as they were, since the record may have changed since
+    string opponent;
+    if (m_opponent != nullptr)
+        opponent.assign(m_opponent->name, strnlen(m_opponent->name, sizeof(m_opponent->name)));
+    w.str(opponent);
+    w.u16(m_opponentShots);
+    w.u8(m_usePriors);
+    if (m_opponent != nullptr)
+    {
+        for (int r = 0; r < game().rows(); r++)
+        {
+            for (int c = 0; c < game().cols(); c++)
+                w.u32(uint32_t(m_huntWeight[r][c]));
+        }
+    }
+    w.u16(m_openingShots);
+    w.u8(m_inOpening);
+    w.cells(m_otherHits);
+    w.u8(m_ponderer.isOn());
+    m_knowledge.save(w);
+    return true;
+}
+
+bool GoodPlayer::restoreState(SnapshotReader& r)
+{
+    playerState = int(r.u8());
+    numMoves = int(r.u16());
+    dir = (r.u8() == VERTICAL ? VERTICAL : HORIZONTAL);
+    end1 = restorePoint(r);
+    end2 = restorePoint(r);
+    end1Reached = (r.u8() != 0);
+    end2Reached = (r.u8() != 0);
+    falseDestruction = (r.u8() != 0);
+    r.bytes(&m_board, sizeof(m_board));
+    string opponent = r.str();
+    m_opponent = (opponent.empty() ? nullptr : opponentModel().find(opponent, true));
+    m_opponentShots = int(r.u16());
+    m_usePriors = (r.u8() != 0);
+    if ( ! opponent.empty())
+    {
+        for (int row = 0; row < game().rows(); row++)
+        {
+            for (int c = 0; c < game().cols(); c++)
+                m_huntWeight[row][c] = int(r.u32());
+        }
+    }
+    m_openingShots = int(r.u16());
+    m_inOpening = (r.u8() != 0);
+    m_otherHits = r.cells();
+    m_salvoOthers.reset();
+    m_ponderer.setOn(false); //drop replies to the position we're leaving
+    m_ponderer.setOn(r.u8() != 0);
+    return m_knowledge.restore(r) && r.ok();
+}
+
+//*********************************************************************
+//  AdaptivePlayer
+//*********************************************************************
+
+// Attacks exactly like GoodPlayer, but places its fleet by simulating a
+// chosen attacker model against candidate layouts and keeping the layout
+// that survived longest.  Without a move time limit it scores a fixed
+// number of candidates rather than as many as the time allows, so that a
+// batch places the same fleets however it's split among processes.
+
+const int ADAPTIVE_CANDIDATES = 4; //about what its time budget scores on a few cores
+
+class AdaptivePlayer: public GoodPlayer
+{
+public:
+  AdaptivePlayer(string nm, const Game& g, string attackerType, int timeBudgetMs);
+  virtual bool placeShips(Board& b);
+
+private:
+    string m_attackerType; //createPlayer type the placement is tuned against
+    int m_timeBudgetMs;    //time allowed for the placement search
+};
+
+AdaptivePlayer::AdaptivePlayer(string nm, const Game& g, string attackerType, int timeBudgetMs)
+ : GoodPlayer(nm, g), m_attackerType(attackerType), m_timeBudgetMs(timeBudgetMs)
+{}
+
+bool AdaptivePlayer::placeShips(Board& b)
+{
+    int nCandidates = (game().moveTimeLimit() > 0 ? 0 : ADAPTIVE_CANDIDATES);
+    if (placeShipsAgainst(game(), b, m_attackerType, m_timeBudgetMs, 0, nCandidates) == true)
+    {
+        return true;
+    }
+    return GoodPlayer::placeShips(b); //attacker model can't be simulated
+}
+
+
+
+//*********************************************************************
+//  DensityPlayer
+//*********************************************************************
+
+// Fires at the cell covered by the most placements of the ships still
+// afloat that agree with everything it has seen.  The choice depends only
+// on that knowledge, so it is cached in the shared transposition table.
+// Against a human it ponders (see Ponderer).
+
+  // DensityPlayer's shot in the position k once out of the book; any
+  // endgame search stops at searchUntil, and within workLimit if given
+static Point densityChoice(const Knowledge& k, Clock::time_point searchUntil,
+                           const atomic<long>* workLimit)
+{
+    uint64_t key = k.hash();
+    Point shot;
+    int score;
+    if (transpositionTable().probe(key, shot, score) && k.game().isValid(shot) && !k.isShot(shot))
+    {
+        return shot; //some game already reached this exact position
+    }
+    
+      // Only an answer the search finished is stored: one it was cut short
+      // on depends on the time it had, and would be handed to later games
+      // that had more
+    bool complete = true;
+    if (inEndgame(k) && endgameShot(k, searchUntil, shot, 1000, &complete, workLimit))
+    {
+        if (complete)
+            transpositionTable().store(key, shot, 0, 8); //dear to recompute, so keep it longer
+        return shot;
+    }
+    
+    long long bestScore;
+    shot = bestDensityShot(k, bestScore);
+    if (complete)
+        transpositionTable().store(key, shot, int(bestScore > 0x7FFFFFFF ? 0x7FFFFFFF : bestScore), 1);
+    return shot;
+}
+
+class DensityPlayer: public Player
+{
+public:
+  DensityPlayer(string nm, const Game& g);
+  virtual bool placeShips(Board& b);
+  virtual Point recommendAttack();
+  virtual CellSet recommendAttacks(int k);
+  virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
+                                              bool shipDestroyed, int shipId);
+  virtual void recordAttackByOpponent(Point p);
+  virtual void setPondering(bool on);
+  virtual bool saveState(SnapshotWriter& w) const;
+  virtual bool restoreState(SnapshotReader& r);
+
+private:
+    Point chooseShot();
+    
+    Knowledge m_knowledge; //what we know of the opponent's board
+    OpeningLine m_opening; //the book's opening for this board and fleet
+    int m_openingShots;
+    Ponderer m_ponderer;
+};
+
+DensityPlayer::DensityPlayer(string nm, const Game& g)
+ : Player(nm, g), m_knowledge(g), m_opening(openingBook().find(g)), m_openingShots(0),
+   m_ponderer(densityChoice)
+{}
+
+bool DensityPlayer::placeShips(Board& b)
+{
+    Layout layout;
+    if ( ! placementTable().sample(game(), layout) && ! randomLayout(game(), layout))
+        return false; //no solved mix for this fleet, and no room for it at random
+    return applyLayout(b, layout);
+}
+
+Point DensityPlayer::recommendAttack()
+{
+    Point shot = chooseShot();
+    bool missToo = (m_openingShots >= m_opening.nShots()); //a miss in the book is answered by the book
+    m_ponderer.startReplies(m_knowledge, shot, missToo);
+    return shot;
+}
+
+Point DensityPlayer::chooseShot()
+{
+    Point p;
+    if (m_knowledge.hits().none() && m_opening.shot(m_openingShots, p) && !m_knowledge.isShot(p))
+    {
+        m_openingShots++;
+        return p; //still in the book
+    }
+    m_openingShots = m_opening.nShots(); //out of the book for good
+    
+    Clock::time_point searchUntil = searchDeadline(*this);
+    if (m_ponderer.take(m_knowledge, searchUntil, p))
+        return p;
+    return densityChoice(m_knowledge, searchUntil, nullptr);
+}
+
+  // A salvo is the k best cells of a single density evaluation.  Once
+  // the cells around open hits run out, the rest of it hunts.
+CellSet DensityPlayer::recommendAttacks(int k)
+{
+    CellSet shots;
+    addDensityShots(m_knowledge, k, shots, CellSet());
+    return shots;
+}
+
+void DensityPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool shipDestroyed, int shipId)
+{
+    m_knowledge.record(p, validShot, shotHit, shipDestroyed, shipId);
+    m_ponderer.follow(m_knowledge);
+}
+
+void DensityPlayer::recordAttackByOpponent(Point /* p */)
+{
+      // DensityPlayer only reasons about its own shots
+}
+
+void DensityPlayer::setPondering(bool on)
+{
+    m_ponderer.setOn(on);
+}
+
+bool DensityPlayer::saveState(SnapshotWriter& w) const
+{
+      // Replies being pondered are left behind; they only save time
+    m_knowledge.save(w);
+    w.u16(m_openingShots);
+    w.u8(m_ponderer.isOn());
+    return true;
+}
+
+bool DensityPlayer::restoreState(SnapshotReader& r)
+{
+    m_ponderer.setOn(false);
+    bool ok = m_knowledge.restore(r);
+    m_openingShots = int(r.u16());
+    m_ponderer.setOn(r.u8() != 0);
+    return ok && r.ok();
+}
+
+//*********************************************************************
+//  NeuralPlayer
+//*********************************************************************
+
+// Fires at the unshot cell the policy network scores highest.  It keeps
+// the network's first layer in step with its knowledge a shot at a time,
+// so a move costs a few microseconds.  If no network has been opened it
+// fires where placements are densest instead.
+
+class NeuralPlayer : public Player
+{
+public:
+  NeuralPlayer(string nm, const Game& g);
+  virtual bool placeShips(Board& b);
+  virtual Point recommendAttack();
+  virtual CellSet recommendAttacks(int k);
+  virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
+                                              bool shipDestroyed, int shipId);
+  virtual void recordAttackByOpponent(Point p);
+  virtual bool saveState(SnapshotWriter& w) const;
+  virtual bool restoreState(SnapshotReader& r);
+
+private:
+    void scoreCells(long long scores[MAXROWS*MAXCOLS]);
+
+    Knowledge m_knowledge; //what we know of the opponent's board
+    PolicyNet::Accumulator m_acc; //the network's first layer for m_knowledge
+};
+
+NeuralPlayer::NeuralPlayer(string nm, const Game& g)
+ : Player(nm, g), m_knowledge(g)
+{
+    policyNet().start(g, m_acc);
+}
+
+bool NeuralPlayer::placeShips(Board& b)
+{
+    Layout layout;
+    if ( ! placementTable().sample(game(), layout) && ! randomLayout(game(), layout))
+        return false;
+    return applyLayout(b, layout);
+}
+
+void NeuralPlayer::scoreCells(long long scores[MAXROWS*MAXCOLS])
+{
+    if ( ! policyNet().isOpen())
+    {
+        densityScores(m_knowledge, scores);
+        return;
+    }
+    int32_t netScores[MAXROWS*MAXCOLS];
+    policyNet().update(m_knowledge, m_acc);
+    policyNet().score(m_acc, netScores);
+    for (int i = 0; i < MAXROWS*MAXCOLS; i++)
+    {
+        scores[i] = netScores[i];
+    }
+}
+
+Point NeuralPlayer::recommendAttack()
+{
+    long long scores[MAXROWS*MAXCOLS];
+    scoreCells(scores);
+    vector<int> best = bestUnshotCells(m_knowledge, scores, 1);
+    return best.empty() ? game().randomPoint() : cellPoint(best[0]);
+}
+
+CellSet NeuralPlayer::recommendAttacks(int k)
+{
+    long long scores[MAXROWS*MAXCOLS];
+    scoreCells(scores);
+    vector<int> best = bestUnshotCells(m_knowledge, scores, k);
+    CellSet shots;
+    for (size_t i = 0; i < best.size(); i++)
+    {
+        shots.set(best[i]);
+    }
+    return shots;
+}
+
+void NeuralPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool shipDestroyed, int shipId)
+{
+    m_knowledge.record(p, validShot, shotHit, shipDestroyed, shipId);
+}
+
+void NeuralPlayer::recordAttackByOpponent(Point /* p */)
+{
+      // NeuralPlayer only reasons about its own shots
+}
+
+bool NeuralPlayer::saveState(SnapshotWriter& w) const
+{
+    m_knowledge.save(w);
+    return true;
+}
+
+bool NeuralPlayer::restoreState(SnapshotReader& r)
+{
+      // The accumulator catches up with the knowledge at the next move
+    policyNet().start(game(), m_acc);
+    return m_knowledge.restore(r);
+}
+
+//*********************************************************************
+//  ExactPlayer
+//*********************************************************************
+
+// Fires at the unshot cell most likely to hold part of a ship, counting
+// exactly over every layout of the fleet that agrees with what it knows.
+// It opens from the book, like DensityPlayer, and while there are still
+// too many layouts to count in the time a move has, it fires where
+// placements are densest instead.  Against a human it ponders (see
+// Ponderer).
+
+  // Score the cells for ExactPlayer in the position k: their exact chances
+  // if the count is done by searchUntil, and not called off through
+  // workLimit, and their densities otherwise
+static void exactScores(const Knowledge& k, Clock::time_point searchUntil,
+                        const atomic<long>* workLimit, long long scores[MAXROWS*MAXCOLS])
+{
+    double probs[MAXROWS*MAXCOLS];
+    double layouts;
+    if ( ! exactProbabilities(k, probs, layouts, searchUntil, workLimit))
+    {
+        densityScores(k, scores);
+        return;
+    }
+    for (int i = 0; i < MAXROWS*MAXCOLS; i++)
+    {
+        scores[i] = (long long)(probs[i] * (1LL << 50));
+    }
+}
+
+  // ExactPlayer's shot in the position k once out of the book
+static Point exactChoice(const Knowledge& k, Clock::time_point searchUntil,
+                         const atomic<long>* workLimit)
+{
+    long long scores[MAXROWS*MAXCOLS];
+    exactScores(k, searchUntil, workLimit, scores);
+    vector<int> best = bestUnshotCells(k, scores, 1);
+    return best.empty() ? k.game().randomPoint() : cellPoint(best[0]);
+}
+
+class ExactPlayer : public Player
+{
+public:
+  ExactPlayer(string nm, const Game& g);
+  virtual bool placeShips(Board& b);
+  virtual Point recommendAttack();
+  virtual CellSet recommendAttacks(int k);
+  virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
+                                              bool shipDestroyed, int shipId);
+  virtual void recordAttackByOpponent(Point p);
+  virtual void setPondering(bool on);
+  virtual bool saveState(SnapshotWriter& w) const;
+  virtual bool restoreState(SnapshotReader& r);
+
+private:
+    Point chooseShot();
+
+    Knowledge m_knowledge; //what we know of the opponent's board
+    OpeningLine m_opening; //the book's opening for this board and fleet
+    int m_openingShots;
+    Ponderer m_ponderer;
+};
+
+ExactPlayer::ExactPlayer(string nm, const Game& g)
+ : Player(nm, g), m_knowledge(g), m_opening(openingBook().find(g)), m_openingShots(0),
+   m_ponderer(exactChoice)
+{}
+
+bool ExactPlayer::placeShips(Board& b)
+{
+    Layout layout;
+    if ( ! placementTable().sample(game(), layout) && ! randomLayout(game(), layout))
+        return false;
+    return applyLayout(b, layout);
+}
+
+Point ExactPlayer::recommendAttack()
+{
+    Point shot = chooseShot();
+    bool missToo = (m_openingShots >= m_opening.nShots()); //a miss in the book is answered by the book
+    m_ponderer.startReplies(m_knowledge, shot, missToo);
+    return shot;
+}
+
+Point ExactPlayer::chooseShot()
+{
+    Point p;
+    if (m_knowledge.hits().none() && m_opening.shot(m_openingShots, p) && !m_knowledge.isShot(p))
+    {
+        m_openingShots++;
+        return p; //still in the book
+    }
+    m_openingShots = m_opening.nShots(); //out of the book for good
+
+    Clock::time_point searchUntil = searchDeadline(*this);
+    if (m_ponderer.take(m_knowledge, searchUntil, p))
+        return p;
+    return exactChoice(m_knowledge, searchUntil, nullptr);
+}
+
+CellSet ExactPlayer::recommendAttacks(int k)
+{
+    long long scores[MAXROWS*MAXCOLS];
+    exactScores(m_knowledge, searchDeadline(*this), nullptr, scores);
+    vector<int> best = bestUnshotCells(m_knowledge, scores, k);
+    CellSet shots;
+    for (size_t i = 0; i < best.size(); i++)
+    {
+        shots.set(best[i]);
+    }
+    return shots;
+}
+
+void ExactPlayer::recordAttackResult(Point p, bool validShot, bool shotHit, bool shipDestroyed, int shipId)
+{
+    m_knowledge.record(p, validShot, shotHit, shipDestroyed, shipId);
+    m_ponderer.follow(m_knowledge);
+}
+
+void ExactPlayer::recordAttackByOpponent(Point /* p */)
+{
+      // ExactPlayer only reasons about its own shots
+}
+
+void ExactPlayer::setPondering(bool on)
+{
+    m_ponderer.setOn(on);
+}
+
+bool ExactPlayer::saveState(SnapshotWriter& w) const
+{
+    m_knowledge.save(w);
+    w.u16(m_openingShots);
+    w.u8(m_ponderer.isOn());
+    return true;
+}
+
+bool ExactPlayer::restoreState(SnapshotReader& r)
+{
+    m_ponderer.setOn(false);
+    bool ok = m_knowledge.restore(r);
+    m_openingShots = int(r.u16());
+    m_ponderer.setOn(r.u8() != 0);
+    return ok && r.ok();
+}
+
+//*********************************************************************
+//  PipePlayer
+//*********************************************************************
+
+// A PipePlayer is played by an external engine program (see Engine.h),
+// created by createPlayer for the type "pipe:" followed by the command
+// that runs it.  Beyond the greeting, the engine is sent
+//
+//   newgame <rows> <cols> <nShips>        at the start of each game, then
+//   ship <id> <length> <symbol> <shape> <name>   for each ship, its shape
+//                                         written as for Game::addShip
+//   opponent <name>
+//   result <r> <c> <outcome>              the outcome of its shot: MISS,
+//                                         HIT, SUNK <shipId> or INVALID
+//   shot <r> <c>                          where the opponent fired
+//
+// none of which it answers, and these, which it does:
+//
+//   place                                 fleet <r> <c> <orientation> ...
+//                                         giving for each ship in order
+//                                         the top left of its outline and
+//                                         h, v or an orientation number
+//   go [shots <k>] [movetime <ms>]        fire <r> <c> ...
+//                                         with k shots, 1 if not given,
+//                                         within ms if a time is given
+//
+// The lines needing no answer are held back and sent together with the
+// next that does, so a move costs one write and one read.
+
+class PipePlayer : public Player
+{
+  public:
+    PipePlayer(string nm, const Game& g, string command);
+    virtual ~PipePlayer();
+    bool isRunning() const;
+    virtual bool placeShips(Board& b);
+    virtual Point recommendAttack();
+    virtual CellSet recommendAttacks(int k);
+    virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
+                                    bool shipDestroyed, int shipId);
+    virtual void recordAttackByOpponent(Point p);
+    virtual void recordOpponentName(string nm);
+  private:
+      // Ask the engine for k shots; false if it doesn't answer with them
+    bool go(int k, vector<Point>& shots);
+    Engine* m_engine;  // nullptr if it couldn't be started
+};
+
+PipePlayer::PipePlayer(string nm, const Game& g, string command)
+ : Player(nm, g), m_engine(Engine::acquire(command))
+{
+    if (m_engine == nullptr)
+    {
+        return;
+    }
+    ostringstream newGame;
+    newGame << "newgame " << g.rows() << " " << g.cols() << " " << g.nShips();
+    m_engine->tell(newGame.str());
+    for (int s = 0; s < g.nShips(); s++)
+    {
+        ostringstream ship;
+        ship << "ship " << s << " " << g.shipLength(s) << " " << g.shipSymbol(s)
+             << " " << g.shipShape(s) << " " << g.shipName(s);
+        m_engine->tell(ship.str());
+    }
+}
+
+PipePlayer::~PipePlayer()
+{
+    Engine::release(m_engine); //kept running for the next game
+}
+
+bool PipePlayer::isRunning() const
+{
+    return m_engine != nullptr && ! m_engine->failed();
+}
+
+bool PipePlayer::placeShips(Board& b)
+{
+    string reply;
+    if ( ! isRunning() || ! m_engine->ask("place", Clock::time_point::max(), reply))
+    {
+        return false;
+    }
+    istringstream iss(reply);
+    string word;
+    iss >> word;
+    int shipId;
+    for (shipId = 0; word == "fleet" && shipId < game().nShips(); shipId++)
+    {
+        int r;
+        int c;
+        string o;
+        if ( ! (iss >> r >> c >> o))
+            break;
+        int orientation = -1;
+        if (o == "h")
+            orientation = 0;
+        else if (o == "v")
+            orientation = (game().nOrientations(shipId) > 1 ? 1 : 0);
+        else
+            istringstream(o) >> orientation;
+        int placement = game().placementAt(shipId, Point(r, c), orientation);
+        if (placement < 0 || ! b.placeShip(shipId, placement))
+            break;
+    }
+    if (shipId < game().nShips()) //leave the board as we found it
+    {
+        b.clear();
+        return false;
+    }
+    return true;
+}
+
+bool PipePlayer::go(int k, vector<Point>& shots)
+{
+    if ( ! isRunning())
+    {
+        return false;
+    }
+    ostringstream request;
+    request << "go";
+    if (k != 1)
+        request << " shots " << k;
+    Clock::time_point now = Clock::now();
+    if (deadline() != Clock::time_point::max())
+    {
+        long long ms = chrono::duration_cast<chrono::milliseconds>(deadline() - now).count();
+        request << " movetime " << (ms > 0 ? ms : 0);
+    }
+    string reply;
+    if ( ! m_engine->ask(request.str(), deadline(), reply))
+    {
+        return false;
+    }
+    istringstream iss(reply);
+    string word;
+    iss >> word;
+    int r;
+    int c;
+    while (word == "fire" && int(shots.size()) < k && iss >> r >> c)
+    {
+        shots.push_back(Point(r, c));
+    }
+    return ! shots.empty();
+}
+
+Point PipePlayer::recommendAttack()
+{
+    vector<Point> shots;
+    if ( ! go(1, shots))
+    {
+        return Point(-1, -1); //wasted, as it should be
+    }
+    return shots[0];
+}
+
+CellSet PipePlayer::recommendAttacks(int k)
+{
+    vector<Point> shots;
+    CellSet cells;
+    go(k, shots);
+    for (size_t i = 0; i < shots.size(); i++)
+    {
+        if (game().isValid(shots[i]))
+            cells.set(cellIndex(shots[i]));
+    }
+    return cells;
+}
+
+void PipePlayer::recordAttackResult(Point p, bool validShot, bool shotHit,
+                                    bool shipDestroyed, int shipId)
+{
+    if (m_engine == nullptr)
+    {
+        return;
+    }
+    ostringstream result;
+    result << "result " << p.r << " " << p.c << " ";
+    if ( ! validShot)
+        result << "INVALID";
+    else if ( ! shotHit)
+        result << "MISS";
+    else if (shipDestroyed)
+        result << "SUNK " << shipId;
+    else
+        result << "HIT";
+    m_engine->tell(result.str());
+}
+
+void PipePlayer::recordAttackByOpponent(Point p)
+{
+    if (m_engine == nullptr)
+    {
+        return;
+    }
+    ostringstream shot;
+    shot << "shot " << p.r << " " << p.c;
+    m_engine->tell(shot.str());
+}
+
+void PipePlayer::recordOpponentName(string nm)
+{
+    if (m_engine != nullptr)
+        m_engine->tell("opponent " + nm);
+}
+
+//*********************************************************************
 //  createPlayer
 //*********************************************************************
 
 Player* createPlayer(string type, string nm, const Game& g)
 {
+    if (type.compare(0, 5, "pipe:") == 0)
+    {
+        PipePlayer* p = new PipePlayer(nm, g, type.substr(5));
+        if ( ! p->isRunning())
+        {
+            delete p;
+            return nullptr; //as for a type we don't know
+        }
+        return p;
+    }
+
     static string types[] = {
-        "human", "awful", "mediocre", "good"
+        "human", "awful", "mediocre", "good", "adaptive", "density", "neural", "exact"
     };
     
     int pos;
@@ -810,6 +2307,16 @@ Player* createPlayer(string type, string nm, const Game& g)
       case 1:  return new AwfulPlayer(nm, g);
       case 2:  return new MediocrePlayer(nm, g);
       case 3:  return new GoodPlayer(nm, g);
+      case 4:  return new AdaptivePlayer(nm, g, "good", 200);
+      case 5:  return new DensityPlayer(nm, g);
+      case 6:  return new NeuralPlayer(nm, g);
+      case 7:  return new ExactPlayer(nm, g);
       default: return nullptr;
     }
 }
+
+Player* createAdaptivePlayer(string nm, const Game& g, string attackerType,
+                             int timeBudgetMs)
+{
+    return new AdaptivePlayer(nm, g, attackerType, timeBudgetMs);
+}
@@ -1,17 +1,20 @@
 #ifndef PLAYER_INCLUDED
 #define PLAYER_INCLUDED
 
+#include "globals.h"
 #include <string>
 
 class Point;
 class Board;
 class Game;
+class SnapshotReader;
+class SnapshotWriter;
 
 class Player
 {
   public:
     Player(std::string nm, const Game& g)
-     : m_name(nm), m_game(g)
+     : m_name(nm), m_game(g), m_deadline(Clock::time_point::max())
     {}
 
     virtual ~Player() {}
@@ -21,11 +24,39 @@ class Player
 
     virtual bool isHuman() const { return false; }
 
+      // When recommendAttack must answer by.  Game::play sets it before each
+      // move if the game has a move time limit; otherwise it's
+      // Clock::time_point::max().  Players that search should stop in time
+      // and answer with the best shot found so far.
+    void setDeadline(Clock::time_point t) { m_deadline = t; }
+    Clock::time_point deadline() const { return m_deadline; }
+
     virtual bool placeShips(Board& b) = 0;
     virtual Point recommendAttack() = 0;
+      // Salvo games ask for k shots at once; only the first k set cells
+      // count.  By default this is recommendAttack's answer plus random
+      // cells, so players that can rank many cells in one go should
+      // override it.
+    virtual CellSet recommendAttacks(int k);
     virtual void recordAttackResult(Point p, bool validShot, bool shotHit,
                                         bool shipDestroyed, int shipId) = 0;
     virtual void recordAttackByOpponent(Point p) = 0;
+      // Called by Game::play before placement with the opponent's name
+    virtual void recordOpponentName(std::string /* nm */) {}
+      // Called by Game::play when the game ends, revealing the opponent's fleet
+    virtual void recordOpponentFleet(const Board& /* b */) {}
+      // Called by Game::play before placement: whether the player may think
+      // in the background while the opponent takes its turn.  It's on when
+      // the opponent is human, whose turns leave the machine mostly idle.
+    virtual void setPondering(bool /* on */) {}
+      // Write everything the player has learned and decided in the game
+      // under way, between moves, for restoreState on a player of the
+      // same type made for the same game to carry on from exactly there
+      // (see saveMatch).  saveState returns false for players that can't
+      // be saved, such as external engines; restoreState returns false if
+      // what it reads makes no sense.
+    virtual bool saveState(SnapshotWriter& /* w */) const { return false; }
+    virtual bool restoreState(SnapshotReader& /* r */) { return false; }
       // We prevent any kind of Player object from being copied or assigned
     Player(const Player&) = delete;
     Player& operator=(const Player&) = delete;
@@ -33,8 +64,20 @@ class Player
   private:
     std::string m_name;
     const Game& m_game;
+    Clock::time_point m_deadline;
 };
 
+  // type is "human", "awful", "mediocre", "good", "adaptive", "density",
+  // "neural" or "exact", or "pipe:" followed by the command running an
+  // external engine.
+  // Returns nullptr for any other type, or an engine that won't start.
 Player* createPlayer(std::string type, std::string nm, const Game& g);
 
+  // An "adaptive" player whose placement is searched, for timeBudgetMs
+  // milliseconds at game start, to survive longest against attackerType.
+  // In a game with no move time limit it scores a fixed number of
+  // layouts instead, so the same seed places the same fleet.
+Player* createAdaptivePlayer(std::string nm, const Game& g,
+                             std::string attackerType, int timeBudgetMs);
+
 #endif // PLAYER_INCLUDED
@@ -0,0 +1,658 @@
+#include "PolicyNet.h"
+#include "Game.h"
+#include "Knowledge.h"
+#include "Simulation.h"
+#include "globals.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define POLICYNET_AVX2
+#endif
+
+using namespace std;
+
+const char NET_MAGIC[8] = { 'B', 'S', 'N', 'E', 'T', '0', '0', '1' };
+const int PLANES = PolicyNet::PLANES;
+const int H = PolicyNet::HIDDEN;
+const int SPAN1 = PolicyNet::SPAN1;
+const int SPAN2 = PolicyNet::SPAN2;
+const int WINDOW1 = SPAN1 * SPAN1;
+const int WINDOW2 = SPAN2 * SPAN2;
+const int REACH1 = SPAN1 / 2;             // how far the first layer sees from a cell
+const int OFF_BOARD = PLANES - 1;         // the plane of cells off the board
+
+static_assert(H == 16, "the AVX2 kernels hold a cell's channels in one register");
+
+  // followed by int8 w1[PLANES][WINDOW1][H], int16 b1[H] and int8
+  // w2[WINDOW2][H], each window in row order
+struct NetHeader
+{
+    char magic[8];
+    uint8_t planes;
+    uint8_t span1;
+    uint8_t hidden;
+    uint8_t span2;
+    int32_t shift;
+    int32_t b2;
+    uint32_t reserved;
+};
+
+  // The planes the network sees of k, but for the cells off the board.  A
+  // cell is in at most one of them.
+static void inputPlanes(const Knowledge& k, CellSet planes[PLANES-1])
+{
+    planes[0] = k.misses();
+    planes[1] = k.openHits();
+    planes[2] = k.sunkCells();
+}
+
+//*********************************************************************
+//  Kernels
+//*********************************************************************
+
+  // sums += w, or sums -= w, over one cell's channels
+static void addChannels(int16_t* sums, const int16_t* w, bool subtract)
+{
+    for (int h = 0; h < H; h++)
+    {
+        sums[h] = int16_t(subtract ? sums[h] - w[h] : sums[h] + w[h]);
+    }
+}
+
+  // hidden = sums >> shift, clipped to 0..127, over one cell's channels
+static void clipChannels(const int16_t* sums, int shift, uint8_t* hidden)
+{
+    for (int h = 0; h < H; h++)
+    {
+        int v = sums[h] >> shift;
+        hidden[h] = uint8_t(v < 0 ? 0 : v > 127 ? 127 : v);
+    }
+}
+
+  // The second layer at one cell: the dot product of each of the window's
+  // rows, three cells' channels side by side in hidden, with w's row
+static int32_t secondLayer(const uint8_t* hidden, int rowStride, const int8_t w[][64])
+{
+    int32_t sum = 0;
+    for (int dr = 0; dr < SPAN2; dr++)
+    {
+        const uint8_t* row = hidden + dr * rowStride;
+        for (int i = 0; i < SPAN2 * H; i++)
+        {
+            sum += int32_t(row[i]) * w[dr][i];
+        }
+    }
+    return sum;
+}
+
+#ifdef POLICYNET_AVX2
+
+__attribute__((target("avx2")))
+static void addChannelsAvx2(int16_t* sums, const int16_t* w, bool subtract)
+{
+    __m256i s = _mm256_load_si256(reinterpret_cast<const __m256i*>(sums));
+    __m256i d = _mm256_load_si256(reinterpret_cast<const __m256i*>(w));
+    s = (subtract ? _mm256_sub_epi16(s, d) : _mm256_add_epi16(s, d));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(sums), s);
+}
+
+__attribute__((target("avx2")))
+static void clipChannelsAvx2(const int16_t* sums, int shift, uint8_t* hidden)
+{
+    __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(sums));
+    v = _mm256_sra_epi16(v, _mm_cvtsi32_si128(shift));
+    v = _mm256_min_epi16(v, _mm256_set1_epi16(127));
+    __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)); //negatives to 0
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(hidden), packed);
+}
+
+  // Each row is 48 bytes: two cells in a 256-bit multiply-add and one in a
+  // 128-bit one.  The unsigned hidden values are at most 127 and the
+  // weights at least -127, so the pairwise int16 sums can't saturate.
+__attribute__((target("avx2")))
+static int32_t secondLayerAvx2(const uint8_t* hidden, int rowStride, const int8_t w[][64])
+{
+    __m256i ones = _mm256_set1_epi16(1);
+    __m256i wide = _mm256_setzero_si256();
+    __m128i narrow = _mm_setzero_si128();
+    for (int dr = 0; dr < SPAN2; dr++)
+    {
+        const uint8_t* row = hidden + dr * rowStride;
+        __m256i a = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row)),
+                                         _mm256_load_si256(reinterpret_cast<const __m256i*>(w[dr])));
+        wide = _mm256_add_epi32(wide, _mm256_madd_epi16(a, ones));
+        __m128i b = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 2*H)),
+                                      _mm_load_si128(reinterpret_cast<const __m128i*>(w[dr] + 2*H)));
+        narrow = _mm_add_epi32(narrow, _mm_madd_epi16(b, _mm256_castsi256_si128(ones)));
+    }
+    __m128i s = _mm_add_epi32(_mm_add_epi32(_mm256_castsi256_si128(wide),
+                                            _mm256_extracti128_si256(wide, 1)), narrow);
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+#endif // POLICYNET_AVX2
+
+//*********************************************************************
+//  PolicyNet
+//*********************************************************************
+
+PolicyNet::PolicyNet()
+ : m_open(false), m_avx2(false), m_shift(0), m_b2(0)
+{
+#ifdef POLICYNET_AVX2
+    m_avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool PolicyNet::open(string path)
+{
+    close();
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr)
+    {
+        return false;
+    }
+    NetHeader header;
+    int8_t w1[PLANES][WINDOW1][H];
+    int16_t b1[H];
+    int8_t w2[WINDOW2][H];
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              memcmp(header.magic, NET_MAGIC, sizeof(NET_MAGIC)) == 0 &&
+              header.planes == PLANES && header.span1 == SPAN1 &&
+              header.hidden == HIDDEN && header.span2 == SPAN2 &&
+              header.shift >= 0 && header.shift < 16 &&
+              fread(w1, sizeof(w1), 1, f) == 1 &&
+              fread(b1, sizeof(b1), 1, f) == 1 &&
+              fread(w2, sizeof(w2), 1, f) == 1;
+    fclose(f);
+    if ( ! ok)
+    {
+        return false;
+    }
+
+    for (int p = 0; p < PLANES; p++)
+    {
+        for (int w = 0; w < WINDOW1; w++)
+        {
+            for (int h = 0; h < H; h++)
+            {
+                m_w1[p][w][h] = w1[p][w][h];
+            }
+        }
+    }
+    memcpy(m_b1, b1, sizeof(m_b1));
+    memset(m_w2, 0, sizeof(m_w2));
+    for (int w = 0; w < WINDOW2; w++)
+    {
+        for (int h = 0; h < H; h++)
+        {
+            m_w2[w / SPAN2][(w % SPAN2) * H + h] = max<int8_t>(w2[w][h], -127);
+        }
+    }
+    m_b2 = header.b2;
+    m_shift = header.shift;
+    m_open = true;
+    return true;
+}
+
+void PolicyNet::close()
+{
+    m_open = false;
+}
+
+bool PolicyNet::isOpen() const
+{
+    return m_open;
+}
+
+void PolicyNet::start(const Game& g, Accumulator& acc) const
+{
+    acc.rows = g.rows();
+    acc.cols = g.cols();
+    for (int p = 0; p < PLANES-1; p++)
+    {
+        acc.planes[p].reset();
+    }
+    memset(acc.sums, 0, sizeof(acc.sums));
+    for (int r = 0; r < acc.rows; r++)
+    {
+        for (int c = 0; c < acc.cols; c++)
+        {
+            int16_t* sums = acc.sums[cellIndex(Point(r,c))];
+            memcpy(sums, m_b1, sizeof(m_b1));
+            for (int w = 0; w < WINDOW1; w++)
+            {
+                int sr = r + w / SPAN1 - REACH1;
+                int sc = c + w % SPAN1 - REACH1;
+                if (sr < 0 || sr >= acc.rows || sc < 0 || sc >= acc.cols)
+                    addChannels(sums, m_w1[OFF_BOARD][w], false);
+            }
+        }
+    }
+}
+
+void PolicyNet::update(const Knowledge& k, Accumulator& acc) const
+{
+    CellSet now[PLANES-1];
+    inputPlanes(k, now);
+    for (int p = 0; p < PLANES-1; p++)
+    {
+        CellSet changed = now[p] ^ acc.planes[p];
+        for (int cell = 0; cell < MAXROWS*MAXCOLS && changed.any(); cell++)
+        {
+            if ( ! changed.test(cell))
+                continue;
+            changed.reset(cell);
+            bool gone = ! now[p].test(cell); //a hit explained by a sinking leaves the hit plane
+            Point s = cellPoint(cell);
+              // Every cell whose window covers s, at window position w
+            for (int w = 0; w < WINDOW1; w++)
+            {
+                int tr = s.r - (w / SPAN1 - REACH1);
+                int tc = s.c - (w % SPAN1 - REACH1);
+                if (tr < 0 || tr >= acc.rows || tc < 0 || tc >= acc.cols)
+                    continue;
+#ifdef POLICYNET_AVX2
+                if (m_avx2)
+                {
+                    addChannelsAvx2(acc.sums[cellIndex(Point(tr,tc))], m_w1[p][w], gone);
+                    continue;
+                }
+#endif
+                addChannels(acc.sums[cellIndex(Point(tr,tc))], m_w1[p][w], gone);
+            }
+        }
+        acc.planes[p] = now[p];
+    }
+}
+
+void PolicyNet::score(const Accumulator& acc, int32_t scores[MAXROWS*MAXCOLS]) const
+{
+      // The clipped channels with a border of zeros, for the cells off the
+      // board, so every window is whole
+    alignas(32) uint8_t hidden[MAXROWS+2][MAXCOLS+2][H];
+    memset(hidden, 0, sizeof(hidden));
+    for (int r = 0; r < acc.rows; r++)
+    {
+        for (int c = 0; c < acc.cols; c++)
+        {
+#ifdef POLICYNET_AVX2
+            if (m_avx2)
+            {
+                clipChannelsAvx2(acc.sums[cellIndex(Point(r,c))], m_shift, hidden[r+1][c+1]);
+                continue;
+            }
+#endif
+            clipChannels(acc.sums[cellIndex(Point(r,c))], m_shift, hidden[r+1][c+1]);
+        }
+    }
+
+    for (int i = 0; i < MAXROWS*MAXCOLS; i++)
+    {
+        scores[i] = 0;
+    }
+    const int rowStride = (MAXCOLS+2) * H;
+    for (int r = 0; r < acc.rows; r++)
+    {
+        for (int c = 0; c < acc.cols; c++)
+        {
+#ifdef POLICYNET_AVX2
+            if (m_avx2)
+            {
+                scores[cellIndex(Point(r,c))] = m_b2 + secondLayerAvx2(hidden[r][c], rowStride, m_w2);
+                continue;
+            }
+#endif
+            scores[cellIndex(Point(r,c))] = m_b2 + secondLayer(hidden[r][c], rowStride, m_w2);
+        }
+    }
+}
+
+PolicyNet& policyNet()
+{
+    static PolicyNet net;
+    return net;
+}
+
+//*********************************************************************
+//  Training
+//*********************************************************************
+
+const unsigned TRAIN_SEED = 20261019;
+const int TRAIN_GAMES = 3000;
+const int RANDOM_SHOT_ODDS = 4;  //one training shot in this many is random, for variety
+const float LEARNING_RATE = 0.0001f;
+
+  // The network in floating point while it's trained.  Its hidden values
+  // are unclipped.
+struct FloatNet
+{
+    float w1[PLANES][WINDOW1][H];
+    float b1[H];
+    float w2[WINDOW2][H];
+    float b2;
+};
+
+const int N_PARAMS = sizeof(FloatNet) / sizeof(float);
+
+  // Which plane each cell is in, -1 for none, with a border as wide as the
+  // first layer's reach of cells off the board
+struct InputGrid
+{
+    signed char plane[MAXROWS + 2*REACH1][MAXCOLS + 2*REACH1];
+
+    InputGrid(const Knowledge& k)
+    {
+        CellSet planes[PLANES-1];
+        inputPlanes(k, planes);
+        for (int r = 0; r < MAXROWS + 2*REACH1; r++)
+        {
+            for (int c = 0; c < MAXCOLS + 2*REACH1; c++)
+            {
+                Point p(r - REACH1, c - REACH1);
+                plane[r][c] = (k.game().isValid(p) ? -1 : OFF_BOARD);
+                for (int i = 0; i < PLANES-1 && plane[r][c] < 0; i++)
+                {
+                    if (planes[i].test(cellIndex(p)))
+                        plane[r][c] = i;
+                }
+            }
+        }
+    }
+};
+
+  // The first layer's output over g's board, clipped at 0, with a border
+  // of zeros
+static void forward(const FloatNet& net, const Game& g, const InputGrid& in,
+                    float sums[MAXROWS][MAXCOLS][H], float hidden[MAXROWS+2][MAXCOLS+2][H])
+{
+    memset(hidden, 0, sizeof(float) * (MAXROWS+2) * (MAXCOLS+2) * H);
+    for (int r = 0; r < g.rows(); r++)
+    {
+        for (int c = 0; c < g.cols(); c++)
+        {
+            float* s = sums[r][c];
+            memcpy(s, net.b1, sizeof(net.b1));
+            for (int w = 0; w < WINDOW1; w++)
+            {
+                int p = in.plane[r + w / SPAN1][c + w % SPAN1];
+                if (p < 0)
+                    continue;
+                for (int h = 0; h < H; h++)
+                {
+                    s[h] += net.w1[p][w][h];
+                }
+            }
+            for (int h = 0; h < H; h++)
+            {
+                hidden[r+1][c+1][h] = max(s[h], 0.0f);
+            }
+        }
+    }
+}
+
+  // The second layer's output at (r,c)
+static float output(const FloatNet& net, const float hidden[MAXROWS+2][MAXCOLS+2][H], int r, int c)
+{
+    float out = net.b2;
+    for (int w = 0; w < WINDOW2; w++)
+    {
+        const float* hv = hidden[r + w / SPAN2][c + w % SPAN2];
+        for (int h = 0; h < H; h++)
+        {
+            out += net.w2[w][h] * hv[h];
+        }
+    }
+    return out;
+}
+
+  // Set grad to the gradient, over the unshot cells of k's board, of the
+  // mean cross-entropy between the network's prediction that a cell holds
+  // a ship and whether it does, as fleet says
+static void gradient(const FloatNet& net, const Knowledge& k, const CellSet& fleet, FloatNet& grad)
+{
+    const Game& g = k.game();
+    InputGrid in(k);
+    static thread_local float sums[MAXROWS][MAXCOLS][H];
+    static thread_local float hidden[MAXROWS+2][MAXCOLS+2][H];
+    static thread_local float dHidden[MAXROWS+2][MAXCOLS+2][H];
+    forward(net, g, in, sums, hidden);
+
+    memset(&grad, 0, sizeof(grad));
+    memset(dHidden, 0, sizeof(dHidden));
+    int nUnshot = g.rows() * g.cols() - int(k.shots().count());
+    if (nUnshot == 0)
+        return;
+    for (int r = 0; r < g.rows(); r++)
+    {
+        for (int c = 0; c < g.cols(); c++)
+        {
+            int cell = cellIndex(Point(r,c));
+            if (k.shots().test(cell))
+                continue;
+            float prob = 1.0f / (1.0f + exp(-output(net, hidden, r, c)));
+            float d = (prob - (fleet.test(cell) ? 1.0f : 0.0f)) / nUnshot;
+            grad.b2 += d;
+            for (int w = 0; w < WINDOW2; w++)
+            {
+                float* hv = hidden[r + w / SPAN2][c + w % SPAN2];
+                float* dh = dHidden[r + w / SPAN2][c + w % SPAN2];
+                for (int h = 0; h < H; h++)
+                {
+                    grad.w2[w][h] += d * hv[h];
+                    dh[h] += d * net.w2[w][h];
+                }
+            }
+        }
+    }
+    for (int r = 0; r < g.rows(); r++)
+    {
+        for (int c = 0; c < g.cols(); c++)
+        {
+            float ds[H];
+            for (int h = 0; h < H; h++)
+            {
+                ds[h] = (sums[r][c][h] > 0 ? dHidden[r+1][c+1][h] : 0.0f);
+                grad.b1[h] += ds[h];
+            }
+            for (int w = 0; w < WINDOW1; w++)
+            {
+                int p = in.plane[r + w / SPAN1][c + w % SPAN1];
+                if (p < 0)
+                    continue;
+                for (int h = 0; h < H; h++)
+                {
+                    grad.w1[p][w][h] += ds[h];
+                }
+            }
+        }
+    }
+}
+
+  // Adam: each parameter's step is scaled by running estimates of its
+  // gradient's mean and variance
+struct Optimizer
+{
+    vector<float> m;
+    vector<float> v;
+    long long t;
+
+    Optimizer()
+     : m(N_PARAMS, 0.0f), v(N_PARAMS, 0.0f), t(0)
+    {}
+    void step(FloatNet& net, const FloatNet& grad)
+    {
+        float* x = reinterpret_cast<float*>(&net);
+        const float* g = reinterpret_cast<const float*>(&grad);
+        t++;
+        float c1 = 1.0f - pow(0.9f, float(t));
+        float c2 = 1.0f - pow(0.999f, float(t));
+        for (int i = 0; i < N_PARAMS; i++)
+        {
+            m[i] = 0.9f * m[i] + 0.1f * g[i];
+            v[i] = 0.999f * v[i] + 0.001f * g[i] * g[i];
+            x[i] -= LEARNING_RATE * (m[i] / c1) / (sqrt(v[i] / c2) + 1e-8f);
+        }
+    }
+};
+
+  // Record the shot at cell against the fleet laid out as layout
+static void recordShot(Knowledge& k, const Game& g, const Layout& layout, int cell)
+{
+    int shipId = -1;
+    for (int s = 0; s < g.nShips() && shipId < 0; s++)
+    {
+        if (g.placements(s)[layout[s]].test(cell))
+            shipId = s;
+    }
+    CellSet shots = k.shots();
+    shots.set(cell);
+    bool destroyed = (shipId >= 0 && (g.placements(shipId)[layout[shipId]] & ~shots).none());
+    k.record(cellPoint(cell), true, shipId >= 0, destroyed, destroyed ? shipId : -1);
+}
+
+  // The int8 network nearest net.  Its first layer's weights are scaled so
+  // the largest is 127; the shift then brings nearly all the hidden values
+  // seen in positions into 0..127; the second layer's weights are scaled
+  // so the largest is 127 too.
+static bool writeQuantized(const FloatNet& net, const vector<float>& hiddenSeen, string path)
+{
+    float maxW1 = 1e-6f;
+    for (int p = 0; p < PLANES; p++)
+        for (int w = 0; w < WINDOW1; w++)
+            for (int h = 0; h < H; h++)
+                maxW1 = max(maxW1, fabs(net.w1[p][w][h]));
+    float maxW2 = 1e-6f;
+    for (int w = 0; w < WINDOW2; w++)
+        for (int h = 0; h < H; h++)
+            maxW2 = max(maxW2, fabs(net.w2[w][h]));
+    float scale1 = 127 / maxW1;
+    float scale2 = 127 / maxW2;
+
+    vector<float> seen = hiddenSeen;
+    float top = 1.0f;
+    if ( ! seen.empty())
+    {
+        size_t i = seen.size() * 999 / 1000;
+        nth_element(seen.begin(), seen.begin() + i, seen.end());
+        top = max(seen[i], 1e-3f);
+    }
+    int shift = int(lround(log2(top * scale1 / 127)));
+    shift = max(0, min(15, shift));
+
+    NetHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NET_MAGIC, sizeof(NET_MAGIC));
+    header.planes = PLANES;
+    header.span1 = SPAN1;
+    header.hidden = H;
+    header.span2 = SPAN2;
+    header.shift = shift;
+    header.b2 = int32_t(lround(net.b2 * scale2 * scale1 / (1 << shift)));
+    int8_t w1[PLANES][WINDOW1][H];
+    int16_t b1[H];
+    int8_t w2[WINDOW2][H];
+    for (int p = 0; p < PLANES; p++)
+        for (int w = 0; w < WINDOW1; w++)
+            for (int h = 0; h < H; h++)
+                w1[p][w][h] = int8_t(lround(net.w1[p][w][h] * scale1));
+    for (int h = 0; h < H; h++)
+        b1[h] = int16_t(max(-8000L, min(8000L, lround(net.b1[h] * scale1))));
+    for (int w = 0; w < WINDOW2; w++)
+        for (int h = 0; h < H; h++)
+            w2[w][h] = int8_t(lround(net.w2[w][h] * scale2));
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr)
+    {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(w1, sizeof(w1), 1, f) == 1 &&
+              fwrite(b1, sizeof(b1), 1, f) == 1 &&
+              fwrite(w2, sizeof(w2), 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+  // The positions come from games against random fleets in which the
+  // attacker mostly fires where placements are densest, as the strong
+  // players do, and otherwise at random.  The network learns from each
+  // position as it arises, before the shot that follows.
+bool writePolicyNet(string path)
+{
+    Game g(10, 10);
+    int lengths[] = { 5, 4, 3, 3, 2 };
+    for (int s = 0; s < 5; s++)
+    {
+        g.addShip(lengths[s], char('A' + s), "ship");
+    }
+    seedRandom(TRAIN_SEED);
+
+    FloatNet net;
+    float* x = reinterpret_cast<float*>(&net);
+    for (int i = 0; i < N_PARAMS; i++)
+    {
+        x[i] = (randInt(2001) - 1000) / 10000.0f;
+    }
+    for (int h = 0; h < H; h++)
+    {
+        net.b1[h] = 0.1f; //start every channel alive
+    }
+    Optimizer opt;
+    FloatNet grad;
+    vector<float> hiddenSeen;
+    static float sums[MAXROWS][MAXCOLS][H];
+    static float hidden[MAXROWS+2][MAXCOLS+2][H];
+
+    for (int game = 0; game < TRAIN_GAMES; game++)
+    {
+        Layout layout;
+        if ( ! randomLayout(g, layout))
+            return false;
+        CellSet fleet;
+        for (int s = 0; s < g.nShips(); s++)
+        {
+            fleet |= g.placements(s)[layout[s]];
+        }
+        Knowledge k(g);
+        while ((fleet & ~k.shots()).any())
+        {
+            gradient(net, k, fleet & ~k.shots(), grad);
+            opt.step(net, grad);
+            if (game >= TRAIN_GAMES - 100) //for choosing the hidden values' scale
+            {
+                forward(net, g, InputGrid(k), sums, hidden);
+                for (int r = 0; r < g.rows(); r++)
+                    for (int c = 0; c < g.cols(); c++)
+                        for (int h = 0; h < H; h++)
+                            if (hidden[r+1][c+1][h] > 0)
+                                hiddenSeen.push_back(hidden[r+1][c+1][h]);
+            }
+
+            int cell;
+            if (randInt(RANDOM_SHOT_ODDS) == 0)
+            {
+                do
+                {
+                    cell = cellIndex(g.randomPoint());
+                } while (k.shots().test(cell));
+            }
+            else
+            {
+                long long score;
+                cell = cellIndex(bestDensityShot(k, score));
+            }
+            recordShot(k, g, layout, cell);
+        }
+    }
+    return writeQuantized(net, hiddenSeen, path);
+}
@@ -0,0 +1,75 @@
+#ifndef POLICYNET_INCLUDED
+#define POLICYNET_INCLUDED
+
+#include "globals.h"
+#include <cstdint>
+#include <string>
+
+class Game;
+class Knowledge;
+
+  // A small convolutional network that scores every cell by how likely it
+  // is to hold part of a ship not yet found, given what an attacker knows.
+  // Its input is four planes of the board: the misses, the hits not yet
+  // explained by a sinking, the cells of sunk ships, and the cells off the
+  // board.  The first layer sums weights over the 5x5 cells around each
+  // cell into HIDDEN channels; the second clips those to 0..127 and sums
+  // weights over the 3x3 cells around each cell into its score.  The
+  // weights are int8, read from a file made by writePolicyNet.
+  //
+  // A player keeps the first layer's sums in an Accumulator that follows
+  // the game: a shot changes the sums of only the 25 cells around it, so
+  // scoring a position costs little more than the second layer.  Both
+  // layers run on AVX2 where the processor has it and in plain integer
+  // code where it doesn't, with the same results either way.
+class PolicyNet
+{
+  public:
+    static const int PLANES = 4;
+    static const int SPAN1 = 5;    // the first layer's window
+    static const int HIDDEN = 16;  // channels between the layers
+    static const int SPAN2 = 3;    // the second layer's window
+
+    struct Accumulator
+    {
+        alignas(32) std::int16_t sums[MAXROWS*MAXCOLS][HIDDEN];  // by cell index
+        CellSet planes[PLANES-1];  // the input the sums are for; the cells
+                                   // off the board never change
+        int rows;
+        int cols;
+    };
+
+    PolicyNet();
+    bool open(std::string path);
+    void close();
+    bool isOpen() const;
+      // Set acc to the sums for g's board with nothing yet shot
+    void start(const Game& g, Accumulator& acc) const;
+      // Bring acc up to date with k, however much has changed
+    void update(const Knowledge& k, Accumulator& acc) const;
+      // Set scores, by cell index, for the position acc holds; the higher
+      // the likelier a hit.  Cells off the board score 0.
+    void score(const Accumulator& acc, std::int32_t scores[MAXROWS*MAXCOLS]) const;
+      // We prevent a PolicyNet object from being copied or assigned
+    PolicyNet(const PolicyNet&) = delete;
+    PolicyNet& operator=(const PolicyNet&) = delete;
+
+  private:
+    bool m_open;
+    bool m_avx2;   // the processor has AVX2
+    int m_shift;   // first layer sums are shifted right this much, then clipped
+    alignas(32) std::int16_t m_w1[PLANES][SPAN1*SPAN1][HIDDEN];  // widened from int8
+    alignas(32) std::int16_t m_b1[HIDDEN];
+    alignas(32) std::int8_t m_w2[SPAN2][64];  // per window row, its 3 cells'
+                                              // HIDDEN weights each, then padding
+    std::int32_t m_b2;
+};
+
+  // The network the neural players consult; closed unless someone opens it
+PolicyNet& policyNet();
+
+  // Train a network on positions from simulated games on a 10x10 board
+  // with the standard fleet, and write it to path for PolicyNet::open
+bool writePolicyNet(std::string path);
+
+#endif // POLICYNET_INCLUDED
@@ -0,0 +1,251 @@
+#include "Probability.h"
+#include "Game.h"
+#include "Knowledge.h"
+#include "globals.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+  // A state packs the cells ahead that placed ships cover, bit j standing
+  // for j cells on from the current one, under the ships placed so far
+const int FRONTIER_BITS = 52;
+const int MAX_SHIPS = 64 - FRONTIER_BITS;
+const uint64_t FRONTIER_MASK = (uint64_t(1) << FRONTIER_BITS) - 1;
+const size_t MAX_STATES = 4000000;  // over all the cells, before giving up;
+                                    // 16 bytes each
+
+  // A placement of a ship whose first cell, in cell index order, is the
+  // current one
+struct Start
+{
+    uint64_t cells;    // bit j for the cell j on from the first
+    uint64_t ship;     // the ship's bit among those placed
+    uint64_t before;   // the bits of the same ships with lower ids, which
+                       // must be placed first
+};
+
+  // The states before one cell and how many ways there are to each, with
+  // a table to find a state's index by its key
+struct Layer
+{
+    vector<uint64_t> keys;
+    vector<double> counts;  // whole numbers, exact below 2^53
+    vector<uint32_t> table; // index + 1 of the state in each slot, or 0
+    int shift;
+
+    void clearTable(size_t expected)
+    {
+        size_t size = 64;
+        shift = 58;
+        while (size < 2 * expected)
+        {
+            size *= 2;
+            shift--;
+        }
+        table.assign(size, 0);
+    }
+    size_t slot(uint64_t key) const
+    {
+        return size_t((key * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+      // The index of the state key, or -1 if there's none
+    long find(uint64_t key) const
+    {
+        size_t mask = table.size() - 1;
+        for (size_t i = slot(key); table[i] != 0; i = (i + 1) & mask)
+        {
+            if (keys[table[i] - 1] == key)
+                return long(table[i]) - 1;
+        }
+        return -1;
+    }
+    void add(uint64_t key, double count)
+    {
+        size_t mask = table.size() - 1;
+        size_t i = slot(key);
+        for ( ; table[i] != 0; i = (i + 1) & mask)
+        {
+            if (keys[table[i] - 1] == key)
+            {
+                counts[table[i] - 1] += count;
+                return;
+            }
+        }
+        keys.push_back(key);
+        counts.push_back(count);
+        table[i] = uint32_t(keys.size());
+        if (2 * keys.size() > table.size())
+            rehash();
+    }
+    void rehash()
+    {
+        clearTable(keys.size());
+        size_t mask = table.size() - 1;
+        for (size_t k = 0; k < keys.size(); k++)
+        {
+            size_t i = slot(keys[k]);
+            while (table[i] != 0)
+                i = (i + 1) & mask;
+            table[i] = uint32_t(k + 1);
+        }
+    }
+};
+
+  // Call visit(next, covered) for each state the state key can move to
+  // over a cell from which starts begin, covered being whether a ship
+  // lies on that cell.  If mustCover (it's a hit), one must.
+template<class Visit>
+inline void successors(uint64_t key, bool mustCover, const vector<Start>& starts, Visit visit)
+{
+    uint64_t frontier = key & FRONTIER_MASK;
+    uint64_t placed = key >> FRONTIER_BITS;
+    if ((frontier & 1) != 0)
+    {
+        visit((frontier >> 1) | (placed << FRONTIER_BITS), true); //already covered
+        return;
+    }
+    if ( ! mustCover)
+        visit((frontier >> 1) | (placed << FRONTIER_BITS), false);
+    for (size_t i = 0; i < starts.size(); i++)
+    {
+        const Start& s = starts[i];
+        if ((placed & s.ship) != 0 || (placed & s.before) != s.before || (frontier & s.cells) != 0)
+            continue;
+        visit(((frontier | s.cells) >> 1) | ((placed | s.ship) << FRONTIER_BITS), true);
+    }
+}
+
+  // Whether another thread has called the count off
+inline bool stopped(const atomic<long>* workLimit)
+{
+    return workLimit != nullptr && workLimit->load(memory_order_relaxed) <= 0;
+}
+
+}  // namespace
+
+bool exactProbabilities(const Knowledge& k, double probs[MAXROWS*MAXCOLS], double& layouts,
+                        Clock::time_point deadline, const atomic<long>* workLimit)
+{
+    const Game& g = k.game();
+    int nShips = g.nShips();
+    if (nShips > MAX_SHIPS)
+        return false;
+    int nCells = (g.rows() - 1) * MAXCOLS + g.cols();
+
+      // Ships afloat that lie the same ways can be told apart in a layout
+      // only by their ids, so each set of them is placed in id order and
+      // the layouts counted multiplied by the orders there could have been
+    vector<uint64_t> before(nShips, 0);
+    double orders = 1;
+    for (int s = 0; s < nShips; s++)
+    {
+        for (int t = 0; t < s; t++)
+        {
+            if ( ! k.isSunk(s) && ! k.isSunk(t) && g.placements(s) == g.placements(t))
+                before[s] |= uint64_t(1) << t;
+        }
+        orders *= __builtin_popcountll(before[s]) + 1;
+    }
+
+      // Where each ship can lie given k, by its first cell
+    CellSet misses = k.misses();
+    const CellSet& hits = k.hits();
+    vector<vector<Start> > starts(nCells);
+    for (int s = 0; s < nShips; s++)
+    {
+        bool sunk = k.isSunk(s);
+        int sinkCell = (sunk ? cellIndex(k.sinkPoint(s)) : -1);
+        const vector<Knowledge::Placement>& pls = k.placements(s);
+        for (size_t i = 0; i < pls.size(); i++)
+        {
+            const Knowledge::Placement& pl = pls[i];
+            bool allHit = (pl.mask & ~hits).none();
+            if (sunk ? ! (allHit && pl.mask.test(sinkCell)) : (allHit || (pl.mask & misses).any()))
+                continue;
+            Start start;
+            start.cells = 0;
+            start.ship = uint64_t(1) << s;
+            start.before = before[s];
+            int first = pl.cells[0];
+            for (size_t j = 0; j < pl.cells.size(); j++)
+            {
+                if (pl.cells[j] - first >= FRONTIER_BITS)
+                    return false; //too tall to fit the state
+                start.cells |= uint64_t(1) << (pl.cells[j] - first);
+            }
+            starts[first].push_back(start);
+        }
+    }
+
+      // Forward: how many ways there are to reach each state before each cell
+    vector<Layer> layers(nCells + 1);
+    layers[0].keys.push_back(0);
+    layers[0].counts.push_back(1);
+    size_t nStates = 1;
+    for (int x = 0; x < nCells; x++)
+    {
+        const Layer& here = layers[x];
+        Layer& next = layers[x+1];
+        next.clearTable(here.keys.size());
+        bool mustCover = hits.test(x);
+        for (size_t i = 0; i < here.keys.size(); i++)
+        {
+            double count = here.counts[i];
+            successors(here.keys[i], mustCover, starts[x], [&](uint64_t key, bool) {
+                next.add(key, count);
+            });
+        }
+        layers[x].table = vector<uint32_t>(); //only the next layer's is needed
+        nStates += next.keys.size();
+        if (nStates > MAX_STATES || Clock::now() > deadline || stopped(workLimit))
+            return false;
+    }
+    uint64_t finished = ((uint64_t(1) << nShips) - 1) << FRONTIER_BITS;
+    long end = layers[nCells].find(finished);
+    if (end < 0)
+        return false; //no layout agrees with k
+    double total = layers[nCells].counts[end];
+
+      // Back: how many ways there are to finish from each state, and so how
+      // many layouts cover each cell
+    vector<double> after(layers[nCells].keys.size(), 0);
+    after[end] = 1;
+    double covers[MAXROWS*MAXCOLS] = { 0 };
+    for (int x = nCells - 1; x >= 0; x--)
+    {
+        const Layer& here = layers[x];
+        Layer& next = layers[x+1];
+        if (next.table.empty())
+            next.rehash();
+        vector<double> ways(here.keys.size(), 0);
+        bool mustCover = hits.test(x);
+        for (size_t i = 0; i < here.keys.size(); i++)
+        {
+            double count = here.counts[i];
+            double& w = ways[i];
+            successors(here.keys[i], mustCover, starts[x], [&](uint64_t key, bool covered) {
+                long j = next.find(key);
+                if (j < 0)
+                    return;
+                w += after[j];
+                if (covered)
+                    covers[x] += count * after[j];
+            });
+        }
+        after.swap(ways);
+        next = Layer(); //done with it
+        if ((x & 15) == 0 && (Clock::now() > deadline || stopped(workLimit)))
+            return false;
+    }
+
+    for (int i = 0; i < MAXROWS*MAXCOLS; i++)
+    {
+        probs[i] = (i < nCells ? covers[i] / total : 0);
+    }
+    layouts = total * orders;
+    return true;
+}
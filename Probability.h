@@ -0,0 +1,33 @@
+#ifndef PROBABILITY_INCLUDED
+#define PROBABILITY_INCLUDED
+
+#include "globals.h"
+#include <atomic>
+
+class Knowledge;
+
+  // Set probs, by cell index, to the exact chance that each cell holds part
+  // of a ship, over every layout of the whole fleet that agrees with k
+  // taken as equally likely, and layouts to how many of those there are.
+  // A layout agrees with k if no ship lies on a miss, every hit is covered,
+  // each sunk ship lies on hits only and through the shot that sank it,
+  // and no ship still afloat has all its cells hit.
+  //
+  // Rather than enumerate the layouts, it counts them with dynamic
+  // programming over the cells in order, the state being which ships have
+  // been placed and which cells ahead the ships placed so far will
+  // cover.  A pass forward counts the ways of reaching each state and one
+  // back the ways of finishing from it, so a cell's count is a sum of
+  // their products.  Returns false, leaving probs alone, if a ship is too
+  // tall for the state to hold, the fleet has more than 12 ships, no
+  // layout agrees with k, the count needs too many states, or it isn't
+  // done by deadline; callers then fall back on densityScores.  With no
+  // deadline (Clock::time_point::max()) the cap on states alone bounds
+  // the work, so whether the count succeeds depends only on k.  If
+  // workLimit isn't nullptr, another thread may set it to 0 to give up at
+  // once, as at the deadline, as pondering does with counts not wanted.
+bool exactProbabilities(const Knowledge& k, double probs[MAXROWS*MAXCOLS], double& layouts,
+                        Clock::time_point deadline,
+                        const std::atomic<long>* workLimit = nullptr);
+
+#endif // PROBABILITY_INCLUDED
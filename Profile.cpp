@@ -0,0 +1,244 @@
+#include "Profile.h"
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char* const PHASE_NAMES[NPHASES] = { "placement", "hunt", "target", "attack" };
+const char* const COUNTER_NAMES[NCOUNTERS] = { "nanos", "cycles", "instructions",
+                                               "cacheMisses", "branchMisses" };
+
+//*********************************************************************
+//  PhaseCounts
+//*********************************************************************
+
+PhaseCounts::PhaseCounts()
+ : calls(0)
+{
+    memset(counts, 0, sizeof(counts));
+}
+
+void PhaseCounts::add(const uint64_t before[NCOUNTERS], const uint64_t after[NCOUNTERS])
+{
+    calls++;
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        counts[c] += after[c] - before[c];
+    }
+}
+
+void PhaseCounts::merge(const PhaseCounts& c)
+{
+    calls += c.calls;
+    for (int i = 0; i < NCOUNTERS; i++)
+    {
+        counts[i] += c.counts[i];
+    }
+}
+
+//*********************************************************************
+//  PerfCounters
+//*********************************************************************
+
+PerfCounters::PerfCounters()
+ : m_nOpen(0)
+{
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        m_fds[c] = -1;
+        m_order[c] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        if (m_fds[c] >= 0)
+            close(m_fds[c]);
+    }
+}
+
+bool PerfCounters::open()
+{
+    static const uint32_t types[NCOUNTERS] = {
+        PERF_TYPE_SOFTWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+    };
+    static const uint64_t configs[NCOUNTERS] = {
+        PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    if (m_nOpen > 0)
+        return true;
+      // The task clock leads, since it opens wherever the others might
+      // not; the kernel moves a software group to the hardware's context
+      // when hardware counters join it.  Any that won't open are left out.
+    int leader = -1;
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[c];
+        attr.config = configs[c];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+        if (fd < 0)
+            continue;
+        if (leader < 0)
+            leader = fd;
+        m_fds[c] = fd;
+        m_order[m_nOpen++] = c;
+    }
+    return m_nOpen > 0;
+}
+
+unsigned PerfCounters::available() const
+{
+    unsigned bits = 0;
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        if (m_fds[c] >= 0)
+            bits |= 1u << c;
+    }
+    return bits;
+}
+
+void PerfCounters::read(uint64_t values[NCOUNTERS]) const
+{
+    memset(values, 0, NCOUNTERS * sizeof(values[0]));
+    if (m_nOpen == 0)
+        return;
+    uint64_t buf[1 + NCOUNTERS]; //how many, then their values in the order opened
+    ssize_t n = ::read(m_fds[m_order[0]], buf, sizeof(buf));
+    if (n < ssize_t(sizeof(uint64_t)))
+        return;
+    for (uint64_t i = 0; i < buf[0] && i < uint64_t(m_nOpen); i++)
+    {
+        values[m_order[i]] = buf[1 + i];
+    }
+}
+
+//*********************************************************************
+//  Profile
+//*********************************************************************
+
+Profile::Profile()
+ : m_available(0)
+{}
+
+void Profile::add(int side, const PhaseCounts* phases)
+{
+    if (phases == nullptr)
+        return;
+    for (int ph = 0; ph < NPHASES; ph++)
+    {
+        m_phases[side][ph].merge(phases[ph]);
+    }
+}
+
+void Profile::merge(const Profile& p)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        for (int ph = 0; ph < NPHASES; ph++)
+        {
+            m_phases[i][ph].merge(p.m_phases[i][ph]);
+        }
+    }
+    m_available |= p.m_available;
+}
+
+void Profile::setAvailable(unsigned available)
+{
+    m_available = available;
+}
+
+unsigned Profile::available() const
+{
+    return m_available;
+}
+
+void Profile::report(ostream& os, const string names[2]) const
+{
+    bool has[NCOUNTERS];
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        has[c] = (m_available & (1u << c)) != 0;
+    }
+    os << fixed << setprecision(1);
+    for (int i = 0; i < 2; i++)
+    {
+        os << names[i] << ", per call:" << endl;
+        for (int ph = 0; ph < NPHASES; ph++)
+        {
+            const PhaseCounts& p = m_phases[i][ph];
+            double calls = double(p.calls > 0 ? p.calls : 1);
+            os << "  " << PHASE_NAMES[ph] << ", " << p.calls << " calls: ";
+            os << p.counts[COUNTER_NANOS] / calls / 1000 << " us";
+            if (has[COUNTER_CYCLES])
+                os << ", " << p.counts[COUNTER_CYCLES] / calls << " cycles";
+            if (has[COUNTER_INSTRUCTIONS])
+            {
+                os << ", " << p.counts[COUNTER_INSTRUCTIONS] / calls << " instructions";
+                if (has[COUNTER_CYCLES] && p.counts[COUNTER_CYCLES] > 0)
+                    os << " (" << setprecision(2) << double(p.counts[COUNTER_INSTRUCTIONS]) / p.counts[COUNTER_CYCLES]
+                       << " per cycle)" << setprecision(1);
+            }
+              // Misses per thousand instructions say more than misses alone
+            double kilo = p.counts[COUNTER_INSTRUCTIONS] / 1000.0;
+            if (has[COUNTER_CACHE_MISSES])
+            {
+                os << ", " << p.counts[COUNTER_CACHE_MISSES] / calls << " cache misses";
+                if (has[COUNTER_INSTRUCTIONS] && kilo > 0)
+                    os << " (" << setprecision(2) << p.counts[COUNTER_CACHE_MISSES] / kilo
+                       << " per 1000 instructions)" << setprecision(1);
+            }
+            if (has[COUNTER_BRANCH_MISSES])
+            {
+                os << ", " << p.counts[COUNTER_BRANCH_MISSES] / calls << " branch misses";
+                if (has[COUNTER_INSTRUCTIONS] && kilo > 0)
+                    os << " (" << setprecision(2) << p.counts[COUNTER_BRANCH_MISSES] / kilo
+                       << " per 1000 instructions)" << setprecision(1);
+            }
+            os << endl;
+        }
+    }
+    os << "counts are for the playing threads only; adaptive placement simulations and pondering"
+          " on other threads aren't included" << endl;
+    if ((m_available & ~(1u << COUNTER_NANOS)) == 0)
+        os << "no hardware counters could be read (no PMU, or perf_event_paranoid forbids it)" << endl;
+}
+
+void Profile::writeJson(ostream& os) const
+{
+    os << "{\"sides\":[";
+    for (int i = 0; i < 2; i++)
+    {
+        os << (i == 0 ? "" : ",") << "{";
+        for (int ph = 0; ph < NPHASES; ph++)
+        {
+            const PhaseCounts& p = m_phases[i][ph];
+            os << (ph == 0 ? "" : ",") << "\"" << PHASE_NAMES[ph] << "\":{\"calls\":" << p.calls;
+            for (int c = 0; c < NCOUNTERS; c++)
+            {
+                os << ",\"" << COUNTER_NAMES[c] << "\":";
+                if (m_available & (1u << c))
+                    os << p.counts[c];
+                else
+                    os << "null";
+            }
+            os << "}";
+        }
+        os << "}";
+    }
+    os << "]}";
+}
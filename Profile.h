@@ -0,0 +1,86 @@
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+  // The parts of a game that Game::play can measure: placing the fleet,
+  // deciding on a move while hunting (with no hit yet to account for by a
+  // sinking) or targeting (with one), and the board carrying out attacks
+enum ProfilePhase { PHASE_PLACEMENT, PHASE_HUNT, PHASE_TARGET, PHASE_ATTACK, NPHASES };
+
+  // What PerfCounters count: task clock nanoseconds, which the kernel
+  // always keeps, and the hardware's cycles, instructions, cache misses
+  // and branch misses, which it may not
+enum ProfileCounter { COUNTER_NANOS, COUNTER_CYCLES, COUNTER_INSTRUCTIONS,
+                      COUNTER_CACHE_MISSES, COUNTER_BRANCH_MISSES, NCOUNTERS };
+
+  // The counts for one phase of one side's play, over one or more games
+struct PhaseCounts
+{
+    std::uint64_t calls;            // times the phase was measured
+    std::uint64_t counts[NCOUNTERS];
+
+    PhaseCounts();
+      // Add a call over which the counters went from before to after
+    void add(const std::uint64_t before[NCOUNTERS], const std::uint64_t after[NCOUNTERS]);
+    void merge(const PhaseCounts& c);
+};
+
+  // The calling thread's counters, read through perf_event_open in user
+  // mode only, so they need no more privilege than perf_event_paranoid 2
+  // allows.  The counters are read as a group, in one system call, and
+  // count only while the thread that opened them runs, so each thread
+  // that measures needs its own.  They aren't inherited: work a player
+  // hands to other threads, namely the adaptive player's placement
+  // simulations and pondering on a human's time, isn't counted.  Searches
+  // for a move, endgame ones included, run on the thread that asks.
+class PerfCounters
+{
+  public:
+    PerfCounters();
+    ~PerfCounters();
+      // Open what counters the kernel and hardware allow; false if none
+    bool open();
+      // Which counters opened, bit c for ProfileCounter c
+    unsigned available() const;
+      // Set values to the counts so far, 0 for counters that didn't open
+    void read(std::uint64_t values[NCOUNTERS]) const;
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+  private:
+    int m_fds[NCOUNTERS];     // -1 for those that didn't open; the first
+                              // that did leads the group
+    int m_order[NCOUNTERS];   // the counter at each place in a group read
+    int m_nOpen;
+};
+
+  // Counts per phase for two sides over any number of games, in the
+  // manner of PlayStats: a thread can keep its own and merge it into
+  // another's
+class Profile
+{
+  public:
+    Profile();
+      // Add side's counts from one game, NPHASES of them, as Game gives
+    void add(int side, const PhaseCounts* phases);
+    void merge(const Profile& p);
+      // Which counters the counts came from, as for PerfCounters
+    void setAvailable(unsigned available);
+    unsigned available() const;
+      // Write a table headed by each side's name, to be read, noting that
+      // work on other threads isn't in it...
+    void report(std::ostream& os, const std::string names[2]) const;
+      // ...or the same as a JSON object, counters that weren't available
+      // being null
+    void writeJson(std::ostream& os) const;
+
+  private:
+    PhaseCounts m_phases[2][NPHASES];
+    unsigned m_available;
+};
+
+#endif // PROFILE_INCLUDED
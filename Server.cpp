@@ -0,0 +1,1076 @@
+#include "Server.h"
+#include "Board.h"
+#include "Game.h"
+#include "Player.h"
+#include "Snapshot.h"
+#include "TranspositionTable.h"
+#include "globals.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t MAX_LINE = 256;           // a longer line from a client is an error
+const size_t MAX_PENDING = 1 << 20;    // output bytes a client may leave unread
+const int MAX_EVENTS = 512;            // handled per epoll_wait
+const int SERVER_MOVE_MS = 10;         // per computer shot, if the game sets no limit
+const size_t MAX_SAVED = 1 << 16;      // matches set aside with SAVE, awaiting RESUME
+
+  // The computer players a client may ask to play.  Human players would
+  // read the server's own terminal, and adaptive ones search for their
+  // placement for longer than the other games should wait.
+static const char* const SERVED_TYPES[] = { "awful", "mediocre", "good", "density" };
+
+class ServerImpl
+{
+  public:
+    ServerImpl(const Game& g, int nThinkers);
+    ~ServerImpl();
+    bool listenOn(int fd, const sockaddr* addr, socklen_t len);
+    bool run();
+    void stop();
+    int nClients() const;
+    int nGames() const;
+    long long nGamesPlayed() const;
+
+  private:
+      // One side of a game: a connected client or a computer player
+    struct Side
+    {
+        int client;      // the client's socket, or -1
+        Player* player;  // the computer player, or nullptr
+        string type;     // the computer player's, as for createPlayer
+        Board* board;    // this side's fleet
+        int nPlaced;     // ships placed so far
+    };
+      // A game under way.  Finished ones keep their boards for the next.
+    struct Match
+    {
+        int id;          // index into m_matches
+        Side sides[2];
+        int turn;        // the side to fire next
+        bool started;    // both fleets are placed
+        bool thinking;   // a thinker is choosing the computer player's shot
+        bool over;       // ended while it was thinking
+        Point shot;      // the shot it chose
+        bool late;       // and whether it chose it after the deadline
+    };
+      // A match a client set aside, to take up again by its ticket
+    struct SavedMatch
+    {
+        int clientSide;
+        string opponent; // the computer player's name
+        string snapshot; // from saveMatch
+    };
+    struct Client
+    {
+        string name;     // empty until the client gives one
+        string in;       // received, not yet a whole line
+        string out;      // to send
+        size_t outPos;   // how much of out has been sent
+        bool writing;    // waiting for the socket to take more of out
+        bool closing;    // hang up once out is sent
+        int match;       // index into m_matches, or -1
+        int side;
+    };
+
+    void acceptClients(int listener);
+    void readClient(int fd);
+    void handleLine(int fd, const string& line);
+    void play(int fd, istringstream& args);
+    void place(int fd, istringstream& args);
+    void fire(int fd, istringstream& args);
+    void save(int fd);
+    void resume(int fd, istringstream& args);
+    void send(int fd, const string& line);
+    void flush(int fd);
+    void closeClient(int fd);
+
+    int newMatch();
+    void startMatch(int m);
+      // Ask the side to move for its shot: TURN for a client, a job for the
+      // thinkers for a computer player
+    void advance(int m);
+      // The side to move fires at p; true if that ended the game
+    bool shoot(int m, Point p, bool late);
+      // Tell the clients who won (if anyone did), and once no thinker is
+      // using the match, free it.  revealed is whether the game was played
+      // out, so each side may see the other's fleet.
+    void endMatch(int m, int winner, bool revealed);
+      // Each thinker thread runs this, choosing computer players' shots so
+      // that a slow one holds up only its own game
+    void think();
+    void finishThinking();
+    bool placeRandomly(Board& b, int shipId);
+    string sideName(const Side& s) const;
+
+    const Game& m_game;
+    int m_epoll;
+    int m_wake;                    // eventfd that stop() writes to
+    atomic<bool> m_stopping;
+    vector<int> m_listeners;
+    vector<Client*> m_clients;     // indexed by socket
+    vector<int> m_dirty;           // clients with output to flush
+    vector<Match*> m_matches;
+    vector<int> m_freeMatches;
+    int m_waiting;                 // client waiting for another to play, or -1
+    vector<thread> m_thinkers;
+    mutex m_mutex;                 // guards what the thinkers share:
+    condition_variable m_jobReady;
+    deque<Match*> m_jobs;          //   matches whose computer player is to choose a shot,
+    vector<Match*> m_done;         //   those that have chosen,
+    bool m_quitting;               //   and whether the thinkers should finish
+    int m_doneEvent;               // eventfd the thinkers write to
+    int m_nClients;
+    int m_nGames;
+    long long m_nGamesPlayed;
+    map<uint64_t, SavedMatch> m_saved;  // by ticket
+    mt19937_64 m_tickets;          // not the game's generator, so tickets can't be guessed from a seed
+};
+
+ServerImpl::ServerImpl(const Game& g, int nThinkers)
+ : m_game(g), m_stopping(false), m_waiting(-1), m_quitting(false),
+   m_nClients(0), m_nGames(0), m_nGamesPlayed(0), m_tickets(random_device()())
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_doneEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll >= 0 && m_wake >= 0 && m_doneEvent >= 0)
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = m_wake;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &ev);
+        ev.data.fd = m_doneEvent;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_doneEvent, &ev);
+    }
+
+    if (nThinkers < 1)
+        nThinkers = max(1, int(thread::hardware_concurrency()) - 1); //leave a core for the event loop
+    for (int i = 0; i < nThinkers; i++)
+    {
+        m_thinkers.push_back(thread(&ServerImpl::think, this));
+    }
+
+      // Every client is a descriptor, so allow as many as we're permitted
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max)
+    {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+ServerImpl::~ServerImpl()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_quitting = true;
+    }
+    m_jobReady.notify_all();
+    for (size_t i = 0; i < m_thinkers.size(); i++)
+    {
+        m_thinkers[i].join();
+    }
+    for (size_t m = 0; m < m_matches.size(); m++)
+    {
+        m_matches[m]->thinking = false; //whatever was left unthought stays so
+    }
+
+    for (size_t fd = 0; fd < m_clients.size(); fd++)
+    {
+        if (m_clients[fd] != nullptr)
+            closeClient(fd);
+    }
+    for (size_t m = 0; m < m_matches.size(); m++)
+    {
+        delete m_matches[m]->sides[0].player; //ended while thinking
+        delete m_matches[m]->sides[1].player;
+        delete m_matches[m]->sides[0].board;
+        delete m_matches[m]->sides[1].board;
+        delete m_matches[m];
+    }
+    for (size_t i = 0; i < m_listeners.size(); i++)
+    {
+        close(m_listeners[i]);
+    }
+    if (m_wake >= 0)
+        close(m_wake);
+    if (m_doneEvent >= 0)
+        close(m_doneEvent);
+    if (m_epoll >= 0)
+        close(m_epoll);
+}
+
+bool ServerImpl::listenOn(int fd, const sockaddr* addr, socklen_t len)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (m_epoll < 0  ||  bind(fd, addr, len) != 0  ||  listen(fd, SOMAXCONN) != 0  ||
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    m_listeners.push_back(fd);
+    return true;
+}
+
+bool ServerImpl::run()
+{
+    if (m_epoll < 0  ||  m_wake < 0  ||  m_doneEvent < 0)
+    {
+        return false;
+    }
+    epoll_event events[MAX_EVENTS];
+    while ( ! m_stopping.load(memory_order_relaxed))
+    {
+        int n = epoll_wait(m_epoll, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == m_wake)
+                continue; //only here to end the wait
+            if (fd == m_doneEvent)
+            {
+                finishThinking();
+                continue;
+            }
+            bool listener = false;
+            for (size_t k = 0; k < m_listeners.size() && ! listener; k++)
+            {
+                listener = (m_listeners[k] == fd);
+            }
+            if (listener)
+            {
+                acceptClients(fd);
+                continue;
+            }
+            if (size_t(fd) >= m_clients.size() || m_clients[fd] == nullptr)
+                continue; //closed earlier in this batch
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                readClient(fd);
+            if (events[i].events & EPOLLOUT)
+                m_dirty.push_back(fd);
+        }
+
+          // Everything the batch said to each client goes out in one write
+        for (size_t k = 0; k < m_dirty.size(); k++)
+        {
+            int fd = m_dirty[k];
+            if (size_t(fd) < m_clients.size() && m_clients[fd] != nullptr)
+                flush(fd);
+        }
+        m_dirty.clear();
+    }
+    return true;
+}
+
+void ServerImpl::stop()
+{
+    m_stopping.store(true, memory_order_relaxed);
+    uint64_t one = 1;
+    ssize_t n = write(m_wake, &one, sizeof(one)); //fails only if already woken
+    (void) n;
+}
+
+int ServerImpl::nClients() const
+{
+    return m_nClients;
+}
+
+int ServerImpl::nGames() const
+{
+    return m_nGames;
+}
+
+long long ServerImpl::nGamesPlayed() const
+{
+    return m_nGamesPlayed;
+}
+
+void ServerImpl::acceptClients(int listener)
+{
+    while (true)
+    {
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return; //no one else waiting, or out of descriptors for now
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); //fails harmlessly for Unix sockets
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            continue;
+        }
+        if (size_t(fd) >= m_clients.size())
+            m_clients.resize(fd + 1, nullptr);
+        Client* c = new Client;
+        c->outPos = 0;
+        c->writing = false;
+        c->closing = false;
+        c->match = -1;
+        c->side = 0;
+        m_clients[fd] = c;
+        m_nClients++;
+
+        ostringstream hello;
+        hello << "HELLO " << m_game.rows() << " " << m_game.cols() << " " << m_game.nShips();
+        send(fd, hello.str());
+        for (int s = 0; s < m_game.nShips(); s++)
+        {
+            ostringstream ship;
+            ship << "SHIP " << s << " " << m_game.shipLength(s) << " "
+                 << m_game.shipSymbol(s) << " " << m_game.shipShape(s) << " "
+                 << m_game.shipName(s);
+            send(fd, ship.str());
+        }
+    }
+}
+
+void ServerImpl::readClient(int fd)
+{
+    Client* c = m_clients[fd];
+    char buf[4096];
+    bool hungUp = false;
+    while ( ! c->closing)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            hungUp = true; //or the connection failed
+            break;
+        }
+
+          // Handle each line as it comes, so only a part line is ever kept
+        c->in.append(buf, n);
+        size_t start = 0;
+        size_t end;
+        while ( ! c->closing && (end = c->in.find('\n', start)) != string::npos)
+        {
+            size_t len = end - start;
+            if (len > 0 && c->in[end-1] == '\r')
+                len--;
+            handleLine(fd, c->in.substr(start, len));
+            start = end + 1;
+        }
+        c->in.erase(0, start);
+        if ( ! c->closing && c->in.size() > MAX_LINE)
+        {
+            send(fd, "ERR line too long");
+            c->closing = true;
+        }
+    }
+    if (hungUp)
+    {
+          // It may only have finished sending, so answer what it sent, and
+          // stop hearing about the end of its input meanwhile
+        c->closing = true;
+        epoll_event ev;
+        ev.events = EPOLLOUT;
+        ev.data.fd = fd;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev);
+        c->writing = true;
+    }
+    if (c->closing)
+        m_dirty.push_back(fd); //so the hang up happens once the output is out
+}
+
+void ServerImpl::handleLine(int fd, const string& line)
+{
+    istringstream args(line);
+    string cmd;
+    args >> cmd;
+    if (cmd == "NAME")
+    {
+        string nm;
+        getline(args >> ws, nm);
+        if (nm.empty())
+        {
+            send(fd, "ERR NAME needs a name");
+            return;
+        }
+        m_clients[fd]->name = nm;
+        send(fd, "OK");
+    }
+    else if (cmd == "PLAY")
+        play(fd, args);
+    else if (cmd == "PLACE")
+        place(fd, args);
+    else if (cmd == "FIRE")
+        fire(fd, args);
+    else if (cmd == "SAVE")
+        save(fd);
+    else if (cmd == "RESUME")
+        resume(fd, args);
+    else if (cmd == "QUIT")
+        m_clients[fd]->closing = true;
+    else if ( ! cmd.empty())
+        send(fd, "ERR unknown command " + cmd);
+}
+
+void ServerImpl::play(int fd, istringstream& args)
+{
+    Client* c = m_clients[fd];
+    string type;
+    args >> type;
+    if (c->match >= 0  ||  m_waiting == fd)
+    {
+        send(fd, "ERR already playing");
+        return;
+    }
+
+    if (type == "client")
+    {
+        if (m_waiting < 0)
+        {
+            m_waiting = fd;
+            send(fd, "WAIT");
+            return;
+        }
+        int m = newMatch();
+        m_matches[m]->sides[0].client = m_waiting; //first come, first to fire
+        m_matches[m]->sides[1].client = fd;
+        m_waiting = -1;
+        startMatch(m);
+        return;
+    }
+
+    bool served = false;
+    for (size_t k = 0; k < sizeof(SERVED_TYPES)/sizeof(SERVED_TYPES[0]) && ! served; k++)
+    {
+        served = (type == SERVED_TYPES[k]);
+    }
+    if ( ! served)
+    {
+        send(fd, "ERR no player of type " + type);
+        return;
+    }
+    int m = newMatch();
+    m_matches[m]->sides[0].client = fd;
+    m_matches[m]->sides[1].player = createPlayer(type, type + " player", m_game);
+    m_matches[m]->sides[1].type = type;
+    startMatch(m);
+}
+
+void ServerImpl::place(int fd, istringstream& args)
+{
+    Client* c = m_clients[fd];
+    if (c->match < 0  ||  m_matches[c->match]->started)
+    {
+        send(fd, "ERR not placing ships");
+        return;
+    }
+    int m = c->match;
+    Side& s = m_matches[m]->sides[c->side];
+    if (s.nPlaced == m_game.nShips())
+    {
+        send(fd, "ERR the fleet is placed");
+        return;
+    }
+
+    string first;
+    args >> first;
+    if (first == "random")
+    {
+        for (int shipId = s.nPlaced; shipId < m_game.nShips(); shipId++)
+        {
+            if ( ! placeRandomly(*s.board, shipId))
+            {
+                s.board->clear(); //boxed in by the ships placed by hand
+                s.nPlaced = 0;
+                send(fd, "ERR no room for the rest of the fleet; place it again");
+                return;
+            }
+        }
+        s.nPlaced = m_game.nShips();
+    }
+    else
+    {
+        istringstream rowArg(first);
+        int r;
+        int col;
+        string o;
+        if ( ! (rowArg >> r) || ! (args >> col >> o))
+        {
+            send(fd, "ERR PLACE needs a row, a column and an orientation");
+            return;
+        }
+        int shipId = s.nPlaced;
+        int orientation;
+        if (o == "h" || o == "H")
+            orientation = 0;
+        else if (o == "v" || o == "V")
+            orientation = (m_game.nOrientations(shipId) > 1 ? 1 : 0); //as Board::placeShip does
+        else if ( ! (istringstream(o) >> orientation) || orientation < 0 || orientation >= m_game.nOrientations(shipId))
+        {
+            send(fd, "ERR no orientation " + o);
+            return;
+        }
+        int placement = m_game.placementAt(shipId, Point(r, col), orientation);
+        if (placement < 0  ||  ! s.board->placeShip(shipId, placement))
+        {
+            send(fd, "ERR the " + m_game.shipName(shipId) + " can't go there");
+            return;
+        }
+        s.nPlaced++;
+    }
+    send(fd, "OK");
+
+    Match* match = m_matches[m];
+    if (match->sides[0].nPlaced == m_game.nShips() && match->sides[1].nPlaced == m_game.nShips())
+    {
+        match->started = true;
+        advance(m);
+    }
+}
+
+void ServerImpl::fire(int fd, istringstream& args)
+{
+    Client* c = m_clients[fd];
+    if (c->match < 0  ||  ! m_matches[c->match]->started  ||
+        m_matches[c->match]->turn != c->side)
+    {
+        send(fd, "ERR not your turn");
+        return;
+    }
+    int r;
+    int col;
+    if ( ! (args >> r >> col))
+    {
+        send(fd, "ERR FIRE needs a row and a column");
+        return;
+    }
+    int m = c->match;
+    if ( ! shoot(m, Point(r, col), false))
+        advance(m);
+}
+
+void ServerImpl::save(int fd)
+{
+    Client* c = m_clients[fd];
+    if (c->match < 0  ||  ! m_matches[c->match]->started  ||
+        m_matches[c->match]->turn != c->side)
+    {
+        send(fd, "ERR not your turn"); //so no thinker has the match
+        return;
+    }
+    int m = c->match;
+    Match* match = m_matches[m];
+    const Side& other = match->sides[1 - c->side];
+    if (other.player == nullptr)
+    {
+        send(fd, "ERR only a match against a computer player can be saved");
+        return;
+    }
+    if (m_saved.size() >= MAX_SAVED)
+    {
+        send(fd, "ERR too many matches saved");
+        return;
+    }
+
+      // The snapshot stays here, as it shows the computer player's fleet
+    MatchSide sides[2];
+    for (int i = 0; i < 2; i++)
+    {
+        sides[i].type = match->sides[i].type;
+        sides[i].player = match->sides[i].player;
+        sides[i].board = match->sides[i].board;
+    }
+    SavedMatch saved;
+    saved.clientSide = c->side;
+    saved.opponent = other.player->name();
+    if ( ! saveMatch(m_game, sides, match->turn, saved.snapshot))
+    {
+        send(fd, "ERR the match can't be saved");
+        return;
+    }
+    uint64_t ticket;
+    do
+    {
+        ticket = m_tickets();
+    } while (m_saved.count(ticket) != 0);
+    m_saved[ticket] = saved;
+
+    ostringstream reply;
+    reply << "SAVED " << hex << setw(16) << setfill('0') << ticket;
+    send(fd, reply.str());
+    endMatch(m, -1, false);
+    m_nGamesPlayed--; //set aside, not played out
+}
+
+void ServerImpl::resume(int fd, istringstream& args)
+{
+    Client* c = m_clients[fd];
+    if (c->match >= 0  ||  m_waiting == fd)
+    {
+        send(fd, "ERR already playing");
+        return;
+    }
+    uint64_t ticket;
+    map<uint64_t, SavedMatch>::iterator it;
+    if ( ! (args >> hex >> ticket) || (it = m_saved.find(ticket)) == m_saved.end())
+    {
+        send(fd, "ERR no match saved with that ticket");
+        return;
+    }
+    SavedMatch saved = it->second;
+    m_saved.erase(it); //a ticket is good once
+
+    int m = newMatch();
+    Match* match = m_matches[m];
+    MatchSide sides[2];
+    string names[2];
+    names[1 - saved.clientSide] = saved.opponent;
+    for (int i = 0; i < 2; i++)
+    {
+        sides[i].board = match->sides[i].board;
+    }
+    int turn;
+    if ( ! restoreMatch(m_game, saved.snapshot, 0, names, sides, turn))
+    {
+        endMatch(m, -1, false); //can't happen with a snapshot we took
+        m_nGamesPlayed--;
+        send(fd, "ERR the match can't be restored");
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        match->sides[i].player = sides[i].player;
+        match->sides[i].type = sides[i].type;
+        match->sides[i].nPlaced = m_game.nShips();
+    }
+    match->sides[saved.clientSide].client = fd;
+    match->turn = turn;
+    match->started = true;
+    c->match = m;
+    c->side = saved.clientSide;
+    send(fd, "MATCH " + saved.opponent);
+    advance(m);
+}
+
+void ServerImpl::send(int fd, const string& line)
+{
+    Client* c = m_clients[fd];
+    if (c->out.size() - c->outPos > MAX_PENDING)
+    {
+        c->closing = true; //the client isn't reading; stop talking to it
+        return;
+    }
+    if (c->out.size() == c->outPos)
+        m_dirty.push_back(fd);
+    c->out += line;
+    c->out += '\n';
+}
+
+void ServerImpl::flush(int fd)
+{
+    Client* c = m_clients[fd];
+    while (c->outPos < c->out.size())
+    {
+        ssize_t n = ::send(fd, c->out.data() + c->outPos, c->out.size() - c->outPos, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            c->outPos += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        closeClient(fd);
+        return;
+    }
+
+    bool pending = (c->outPos < c->out.size());
+    if ( ! pending)
+    {
+        c->out.clear();
+        c->outPos = 0;
+        if (c->closing)
+        {
+            closeClient(fd);
+            return;
+        }
+    }
+    if (pending != c->writing) //only ask to hear about room to write while there's a need
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN | (pending ? EPOLLOUT : 0u);
+        ev.data.fd = fd;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev);
+        c->writing = pending;
+    }
+}
+
+void ServerImpl::closeClient(int fd)
+{
+    Client* c = m_clients[fd];
+    if (m_waiting == fd)
+        m_waiting = -1;
+    if (c->match >= 0)
+    {
+        int m = c->match;
+        m_matches[m]->sides[c->side].client = -1; //so it's told nothing more
+        endMatch(m, 1 - c->side, false); //leaving forfeits
+    }
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    delete c;
+    m_clients[fd] = nullptr;
+    m_nClients--;
+}
+
+int ServerImpl::newMatch()
+{
+    int m;
+    if ( ! m_freeMatches.empty())
+    {
+        m = m_freeMatches.back();
+        m_freeMatches.pop_back();
+        m_matches[m]->sides[0].board->clear();
+        m_matches[m]->sides[1].board->clear();
+    }
+    else
+    {
+        m = m_matches.size();
+        Match* match = new Match;
+        match->id = m;
+        match->sides[0].board = new Board(m_game);
+        match->sides[1].board = new Board(m_game);
+        m_matches.push_back(match);
+    }
+    Match* match = m_matches[m];
+    for (int i = 0; i < 2; i++)
+    {
+        match->sides[i].client = -1;
+        match->sides[i].player = nullptr;
+        match->sides[i].type.clear();
+        match->sides[i].nPlaced = 0;
+    }
+    match->turn = 0;
+    match->started = false;
+    match->thinking = false;
+    match->over = false;
+    m_nGames++;
+    return m;
+}
+
+void ServerImpl::startMatch(int m)
+{
+    Match* match = m_matches[m];
+    transpositionTable().newGeneration(); //positions from matches long over go first
+    for (int i = 0; i < 2; i++)
+    {
+        Side& s = match->sides[i];
+        const Side& other = match->sides[1-i];
+        if (s.client >= 0)
+        {
+            m_clients[s.client]->match = m;
+            m_clients[s.client]->side = i;
+            send(s.client, "MATCH " + sideName(other));
+        }
+        else
+        {
+            if (other.client >= 0 && ! m_clients[other.client]->name.empty())
+                s.player->recordOpponentName(m_clients[other.client]->name); //only named clients can be learned
+            if ( ! s.player->placeShips(*s.board))
+            {
+                endMatch(m, 1 - i, false); //can't happen with a fleet Game accepted
+                return;
+            }
+            s.nPlaced = m_game.nShips();
+        }
+    }
+}
+
+void ServerImpl::advance(int m)
+{
+    Match* match = m_matches[m];
+    if (match->sides[match->turn].player == nullptr)
+    {
+        send(match->sides[match->turn].client, "TURN");
+        return;
+    }
+    match->thinking = true;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_jobs.push_back(match);
+    }
+    m_jobReady.notify_one();
+}
+
+void ServerImpl::think()
+{
+    int ms = (m_game.moveTimeLimit() > 0 ? m_game.moveTimeLimit() : SERVER_MOVE_MS);
+    unique_lock<mutex> lock(m_mutex);
+    while (true)
+    {
+        m_jobReady.wait(lock, [this]{ return m_quitting || ! m_jobs.empty(); });
+        if (m_quitting)
+            return;
+        Match* match = m_jobs.front();
+        m_jobs.pop_front();
+        lock.unlock();
+
+          // Until it's back on m_done, the event loop leaves this match alone
+        Player* p = match->sides[match->turn].player;
+        p->setDeadline(Clock::now() + chrono::milliseconds(ms)); //the time spent queued isn't its fault
+        match->shot = p->recommendAttack();
+        match->late = (Clock::now() > p->deadline());
+
+        lock.lock();
+        m_done.push_back(match);
+        uint64_t one = 1;
+        ssize_t n = write(m_doneEvent, &one, sizeof(one));
+        (void) n;
+    }
+}
+
+void ServerImpl::finishThinking()
+{
+    uint64_t count;
+    ssize_t n = read(m_doneEvent, &count, sizeof(count));
+    (void) n;
+    vector<Match*> done;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        done.swap(m_done);
+    }
+    for (size_t i = 0; i < done.size(); i++)
+    {
+        Match* match = done[i];
+        match->thinking = false;
+        if (match->over)
+            endMatch(match->id, -1, false); //the client left meanwhile
+        else if ( ! shoot(match->id, match->shot, match->late))
+            advance(match->id);
+    }
+}
+
+bool ServerImpl::shoot(int m, Point p, bool late)
+{
+    Match* match = m_matches[m];
+    Side& attacker = match->sides[match->turn];
+    Side& defender = match->sides[1 - match->turn];
+
+    bool shotHit = false;
+    bool shipDestroyed = false;
+    int shipId = 0;
+    bool valid = ! late && defender.board->attack(p, shotHit, shipDestroyed, shipId);
+    bool won = valid && defender.board->allShipsDestroyed();
+
+    ostringstream outcome;
+    outcome << p.r << " " << p.c << " ";
+    if ( ! valid)
+        outcome << "INVALID";
+    else if ( ! shotHit)
+        outcome << "MISS";
+    else if (shipDestroyed)
+        outcome << "SUNK " << shipId;
+    else
+        outcome << "HIT";
+
+    if (attacker.client >= 0)
+        send(attacker.client, "RESULT " + outcome.str());
+    else if ( ! won)
+        attacker.player->recordAttackResult(p, valid, shotHit, shipDestroyed, shipId);
+    if ( ! late) //a forfeited shot never reached the defender's board
+    {
+        if (defender.client >= 0)
+            send(defender.client, "SHOT " + outcome.str());
+        else if ( ! won)
+            defender.player->recordAttackByOpponent(p);
+    }
+
+    if (won)
+    {
+        endMatch(m, match->turn, true);
+        return true;
+    }
+    match->turn = 1 - match->turn;
+    return false;
+}
+
+void ServerImpl::endMatch(int m, int winner, bool revealed)
+{
+    Match* match = m_matches[m];
+    for (int i = 0; i < 2; i++)
+    {
+        Side& s = match->sides[i];
+        if (s.client >= 0)
+        {
+            if (winner >= 0)
+                send(s.client, i == winner ? "WIN" : "LOSE");
+            m_clients[s.client]->match = -1;
+            s.client = -1;
+        }
+    }
+    if (match->thinking)
+    {
+        match->over = true; //finishThinking frees it
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        Side& s = match->sides[i];
+        if (s.player != nullptr)
+        {
+            if (revealed)
+                s.player->recordOpponentFleet(*match->sides[1-i].board); //both fleets are revealed at the end
+            delete s.player;
+            s.player = nullptr;
+        }
+    }
+    m_freeMatches.push_back(m);
+    m_nGames--;
+    m_nGamesPlayed++;
+}
+
+bool ServerImpl::placeRandomly(Board& b, int shipId)
+{
+    const vector<CellSet>& pls = m_game.placements(shipId);
+    for (int tries = 0; tries < 50; tries++)
+    {
+        if (b.placeShip(shipId, randInt(pls.size())))
+            return true;
+    }
+    vector<int> fits; //crowded: choose among those that fit
+    for (size_t i = 0; i < pls.size(); i++)
+    {
+        if (b.placeShip(shipId, i))
+        {
+            fits.push_back(i);
+            b.unplaceShip(shipId, i);
+        }
+    }
+    return ! fits.empty() && b.placeShip(shipId, fits[randInt(fits.size())]);
+}
+
+string ServerImpl::sideName(const Side& s) const
+{
+    if (s.player != nullptr)
+        return s.player->name();
+    const string& nm = m_clients[s.client]->name;
+    return nm.empty() ? "anonymous" : nm;
+}
+
+//******************** Server functions *******************************
+
+// These functions simply delegate to ServerImpl's functions.
+
+Server::Server(const Game& g, int nThinkers)
+{
+    m_impl = new ServerImpl(g, nThinkers);
+}
+
+Server::~Server()
+{
+    delete m_impl;
+}
+
+bool Server::listenTcp(int port)
+{
+    if (port < 1 || port > 65535)
+    {
+        return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0)
+    {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); //games are for this machine only
+    return m_impl->listenOn(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+}
+
+bool Server::listenUnix(string path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path.c_str()); //left by an earlier server
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    return m_impl->listenOn(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+}
+
+bool Server::run()
+{
+    return m_impl->run();
+}
+
+void Server::stop()
+{
+    m_impl->stop();
+}
+
+int Server::nClients() const
+{
+    return m_impl->nClients();
+}
+
+int Server::nGames() const
+{
+    return m_impl->nGames();
+}
+
+long long Server::nGamesPlayed() const
+{
+    return m_impl->nGamesPlayed();
+}
@@ -0,0 +1,78 @@
+#ifndef SERVER_INCLUDED
+#define SERVER_INCLUDED
+
+#include <string>
+
+class Game;
+class ServerImpl;
+
+  // Hosts games for clients connecting over loopback TCP or a Unix socket,
+  // as many at once as there are clients, all from one thread waiting on
+  // epoll.  Computer players choose their shots on a pool of thinker
+  // threads, so a slow one doesn't hold up the other games.  Every game
+  // uses g's board and fleet, one shot a turn.  Each message is a line of
+  // text:
+  //
+  //   client sends                    server answers
+  //   NAME <name>                     OK
+  //   PLAY <type>                     MATCH <opponent name>, against a
+  //                                   computer player of that type, or
+  //                                   WAIT then MATCH for "PLAY client",
+  //                                   once another client asks the same
+  //   PLACE <r> <c> <orientation>     OK; ships are placed in order, each
+  //                                   with the top left of its outline at
+  //                                   (r,c) and an orientation of h, v or
+  //                                   a number (see Game::nOrientations)
+  //   PLACE random                    OK, with the rest of the fleet placed
+  //   FIRE <r> <c>                    RESULT <r> <c> <outcome>
+  //   SAVE                            SAVED <ticket>, with the match set
+  //                                   aside; only on the client's turn
+  //                                   against a computer player
+  //   RESUME <ticket>                 MATCH, then the match goes on as it
+  //                                   was saved; from any client, once
+  //   QUIT                            (the server hangs up)
+  //
+  // A client is greeted with HELLO <rows> <cols> <nShips> and a line
+  // SHIP <id> <length> <symbol> <shape> <name> for each ship, the shape
+  // written as for Game::addShip.  Once both fleets are placed, the
+  // server sends TURN when the client is to fire and SHOT <r> <c>
+  // <outcome> when its opponent fires, where the outcome is
+  // MISS, HIT, SUNK <shipId> or INVALID; a computer opponent that takes
+  // too long forfeits its shot, and the client hears nothing of it.  The
+  // game ends with WIN or LOSE, after which the client may PLAY again;
+  // leaving mid-game forfeits it, unless it was saved.  The server keeps
+  // a saved match as a snapshot of a kilobyte or two (see saveMatch), not
+  // the players themselves, until a client resumes it.
+  // Whatever the server can't accept gets ERR <reason>.
+  //
+  // The messages follow the Player interface: PLACE is placeShips, TURN
+  // asks for recommendAttack, RESULT is recordAttackResult and SHOT is
+  // recordAttackByOpponent.
+class Server
+{
+  public:
+      // nThinkers threads choose the computer players' shots; 0 for one
+      // per core but one
+    Server(const Game& g, int nThinkers = 0);
+    ~Server();
+      // Accept clients on a TCP port of 127.0.0.1, or at a Unix socket
+      // path.  Either may be called more than once before run.
+    bool listenTcp(int port);
+    bool listenUnix(std::string path);
+      // Serve clients until stop is called.  Returns false if it can't wait
+      // for them.
+    bool run();
+      // Make run return; safe to call from a signal handler or another thread
+    void stop();
+    int nClients() const;
+    int nGames() const;              // games under way
+    long long nGamesPlayed() const;  // games finished
+      // We prevent a Server object from being copied or assigned
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+  private:
+    ServerImpl* m_impl;
+};
+
+#endif // SERVER_INCLUDED
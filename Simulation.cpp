@@ -0,0 +1,237 @@
+#include "Simulation.h"
+#include "Board.h"
+#include "Game.h"
+#include "Player.h"
+#include "globals.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+const int TRIALS_PER_CANDIDATE = 12; //simulated games used to score one layout
+
+bool randomLayout(const Game& g, Layout& layout)
+{
+    for (int attempt = 0; attempt < 50; attempt++) //start over if the fleet gets boxed in
+    {
+        CellSet taken;
+        layout.assign(g.nShips(), -1);
+        bool placedAll = true;
+
+        for (int shipId = 0; shipId < g.nShips() && placedAll; shipId++)
+        {
+            const vector<CellSet>& pls = g.placements(shipId);
+            bool placed = false;
+            for (int tries = 0; tries < 100 && !placed && !pls.empty(); tries++)
+            {
+                int i = randInt(int(pls.size()));
+                if ((pls[i] & taken).none())
+                {
+                    taken |= pls[i];
+                    layout[shipId] = i;
+                    placed = true;
+                }
+            }
+            placedAll = placed;
+        }
+        if (placedAll)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool applyLayout(Board& b, const Layout& layout)
+{
+    for (int shipId = 0; shipId < int(layout.size()); shipId++)
+    {
+        if ( ! b.placeShip(shipId, layout[shipId]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int shotsToSink(const Game& g, const Layout& layout, string attackerType, int maxShots)
+{
+    Player* attacker = createPlayer(attackerType, "simulated attacker", g);
+    if (attacker == nullptr || attacker->isHuman()) //a human can't be simulated
+    {
+        delete attacker;
+        return -1;
+    }
+
+    Board b(g);
+    if ( ! applyLayout(b, layout))
+    {
+        delete attacker;
+        return -1;
+    }
+
+    int shots = 0;
+    bool shotHit;
+    bool shipDestroyed;
+    int shipId = 0;
+    while (shots < maxShots)
+    {
+        Point p = attacker->recommendAttack();
+        bool valid = b.attack(p, shotHit, shipDestroyed, shipId);
+        shots++; //wasted shots cost a turn too
+        if (valid && b.allShipsDestroyed())
+        {
+            break;
+        }
+        attacker->recordAttackResult(p, valid, shotHit, shipDestroyed, shipId);
+    }
+    delete attacker;
+    return shots;
+}
+
+  // Score nCandidates layouts drawn on the calling thread, each over its
+  // trials with random numbers seeded from the calling thread too, so the
+  // workers' timing can't change which layout wins
+static bool placeAmongCandidates(const Game& g, Board& b, string attackerType,
+                                 int nCandidates, int nThreads, int maxShots)
+{
+    vector<Layout> candidates(nCandidates);
+    vector<unsigned> seeds(nCandidates);
+    for (int i = 0; i < nCandidates; i++)
+    {
+        if ( ! randomLayout(g, candidates[i]))
+            return false;
+        seeds[i] = unsigned(randomGenerator()());
+    }
+
+    vector<double> scores(nCandidates, -1);
+    atomic<int> next(0);
+    atomic<bool> simulable(true);
+    auto worker = [&]() {
+        int i;
+        while (simulable && (i = next++) < nCandidates)
+        {
+            seedRandom(seeds[i]);
+            int totalShots = 0;
+            for (int trial = 0; trial < TRIALS_PER_CANDIDATE; trial++)
+            {
+                int shots = shotsToSink(g, candidates[i], attackerType, maxShots);
+                if (shots < 0)
+                {
+                    simulable = false;
+                    return;
+                }
+                totalShots += shots;
+            }
+            scores[i] = double(totalShots) / TRIALS_PER_CANDIDATE;
+        }
+    };
+
+    mt19937 callersRandom = randomGenerator(); //which candidates this thread scores varies
+    vector<thread> workers;
+    for (int t = 1; t < nThreads && t < nCandidates; t++)
+    {
+        workers.push_back(thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+    randomGenerator() = callersRandom;
+    if ( ! simulable)
+        return false;
+
+    int best = 0;
+    for (int i = 1; i < nCandidates; i++)
+    {
+        if (scores[i] > scores[best]) //ties go to the first drawn
+            best = i;
+    }
+    return applyLayout(b, candidates[best]);
+}
+
+bool placeShipsAgainst(const Game& g, Board& b, string attackerType,
+                       int timeBudgetMs, int nThreads, int nCandidates)
+{
+    Clock::time_point deadline = Clock::now() + chrono::milliseconds(timeBudgetMs);
+    int maxShots = 4 * g.rows() * g.cols(); //bounds attackers that never finish
+
+    if (nThreads < 1)
+    {
+        nThreads = int(thread::hardware_concurrency());
+        if (nThreads < 1)
+            nThreads = 1;
+    }
+    if (nCandidates > 0)
+        return placeAmongCandidates(g, b, attackerType, nCandidates, nThreads, maxShots);
+
+    mutex bestMutex;
+    Layout best;
+    double bestScore = -1;
+    atomic<bool> haveBest(false);
+    atomic<bool> simulable(true);
+
+      // Each worker keeps drawing candidates until the deadline.  Only
+      // candidates scored over all their trials compete, except that the
+      // first candidate counts however few trials it got, so there is
+      // always something to place.
+    auto worker = [&]() {
+        Layout candidate;
+        while (true)
+        {
+            if ( ! simulable || (haveBest && Clock::now() >= deadline))
+                return;
+            if ( ! randomLayout(g, candidate))
+                return;
+
+            int totalShots = 0;
+            int trials = 0;
+            for ( ; trials < TRIALS_PER_CANDIDATE; trials++)
+            {
+                if (trials > 0 && Clock::now() >= deadline)
+                    break;
+                int shots = shotsToSink(g, candidate, attackerType, maxShots);
+                if (shots < 0)
+                {
+                    simulable = false;
+                    return;
+                }
+                totalShots += shots;
+            }
+
+            lock_guard<mutex> lock(bestMutex);
+            if (trials == TRIALS_PER_CANDIDATE || bestScore < 0)
+            {
+                double score = double(totalShots) / trials;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = candidate;
+                    haveBest = true;
+                }
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (int t = 1; t < nThreads; t++)
+    {
+        workers.push_back(thread(worker));
+    }
+    worker(); //this thread does its share too
+    for (size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+
+    if (best.empty())
+    {
+        return false;
+    }
+    return applyLayout(b, best);
+}
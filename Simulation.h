@@ -0,0 +1,37 @@
+#ifndef SIMULATION_INCLUDED
+#define SIMULATION_INCLUDED
+
+#include "globals.h"
+#include <string>
+#include <vector>
+
+class Game;
+class Board;
+
+  // A complete fleet layout: for each shipId, the index of its placement
+  // in Game::placements
+typedef std::vector<int> Layout;
+
+  // Pick a random feasible layout for the game's fleet
+bool randomLayout(const Game& g, Layout& layout);
+
+  // Place every ship of the layout on b; false if any ship doesn't fit
+bool applyLayout(Board& b, const Layout& layout);
+
+  // Let a freshly created player of attackerType attack the layout until
+  // the whole fleet is sunk, without any display.  Returns the number of
+  // shots fired (capped at maxShots), or -1 if attackerType can't be
+  // simulated (unknown or human).
+int shotsToSink(const Game& g, const Layout& layout, std::string attackerType,
+                int maxShots);
+
+  // Search random candidate layouts for timeBudgetMs milliseconds, scoring
+  // each by its mean shots-to-sink against attackerType over several
+  // simulated games, and place the longest-surviving one on b.  nThreads
+  // worker threads share the search; 0 means one per hardware thread.
+  // With nCandidates set, score that many instead, whatever the time, so
+  // that the same random numbers give the same placement.
+bool placeShipsAgainst(const Game& g, Board& b, std::string attackerType,
+                       int timeBudgetMs, int nThreads = 0, int nCandidates = 0);
+
+#endif // SIMULATION_INCLUDED
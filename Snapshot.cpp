@@ -0,0 +1,283 @@
+#include "Snapshot.h"
+#include "Board.h"
+#include "Game.h"
+#include "Player.h"
+#include "globals.h"
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+const char MATCH_MAGIC[8] = { 'B', 'S', 'M', 'A', 'T', 'C', 'H', '1' };
+const int CELLSET_BYTES = (MAXROWS*MAXCOLS + 7) / 8;
+
+//*********************************************************************
+//  SnapshotWriter
+//*********************************************************************
+
+SnapshotWriter::SnapshotWriter(string& out)
+ : m_out(out)
+{}
+
+void SnapshotWriter::u8(unsigned v)
+{
+    m_out += char(v);
+}
+
+void SnapshotWriter::u16(unsigned v)
+{
+    uint16_t x = uint16_t(v);
+    bytes(&x, sizeof(x));
+}
+
+void SnapshotWriter::u32(uint32_t v)
+{
+    bytes(&v, sizeof(v));
+}
+
+void SnapshotWriter::u64(uint64_t v)
+{
+    bytes(&v, sizeof(v));
+}
+
+void SnapshotWriter::cells(const CellSet& s)
+{
+    unsigned char packed[CELLSET_BYTES] = { 0 };
+    for (size_t cell = 0; cell < s.size(); cell++)
+    {
+        if (s.test(cell))
+            packed[cell / 8] |= (unsigned char)(1 << (cell % 8));
+    }
+    bytes(packed, sizeof(packed));
+}
+
+void SnapshotWriter::str(const string& s)
+{
+    size_t n = (s.size() < 0xFFFF ? s.size() : 0xFFFF);
+    u16(unsigned(n));
+    bytes(s.data(), n);
+}
+
+void SnapshotWriter::bytes(const void* p, size_t n)
+{
+    m_out.append(static_cast<const char*>(p), n);
+}
+
+//*********************************************************************
+//  SnapshotReader
+//*********************************************************************
+
+SnapshotReader::SnapshotReader(const string& in, size_t pos)
+ : m_in(in), m_pos(pos), m_ok(pos <= in.size())
+{}
+
+unsigned SnapshotReader::u8()
+{
+    unsigned char x = 0;
+    bytes(&x, sizeof(x));
+    return x;
+}
+
+unsigned SnapshotReader::u16()
+{
+    uint16_t x = 0;
+    bytes(&x, sizeof(x));
+    return x;
+}
+
+uint32_t SnapshotReader::u32()
+{
+    uint32_t x = 0;
+    bytes(&x, sizeof(x));
+    return x;
+}
+
+uint64_t SnapshotReader::u64()
+{
+    uint64_t x = 0;
+    bytes(&x, sizeof(x));
+    return x;
+}
+
+CellSet SnapshotReader::cells()
+{
+    unsigned char packed[CELLSET_BYTES];
+    bytes(packed, sizeof(packed));
+    CellSet s;
+    for (int cell = 0; cell < MAXROWS*MAXCOLS; cell++)
+    {
+        if (packed[cell / 8] & (1 << (cell % 8)))
+            s.set(cell);
+    }
+    return s;
+}
+
+string SnapshotReader::str()
+{
+    size_t n = u16();
+    if ( ! m_ok || m_in.size() - m_pos < n)
+    {
+        m_ok = false;
+        return string();
+    }
+    m_pos += n;
+    return m_in.substr(m_pos - n, n);
+}
+
+void SnapshotReader::bytes(void* p, size_t n)
+{
+    if ( ! m_ok || m_in.size() - m_pos < n)
+    {
+        m_ok = false;
+        memset(p, 0, n);
+        return;
+    }
+    memcpy(p, m_in.data() + m_pos, n);
+    m_pos += n;
+}
+
+void SnapshotReader::fail()
+{
+    m_ok = false;
+}
+
+bool SnapshotReader::ok() const
+{
+    return m_ok;
+}
+
+bool SnapshotReader::atEnd() const
+{
+    return m_pos == m_in.size();
+}
+
+//*********************************************************************
+//  Matches
+//*********************************************************************
+
+  // Identifies g's board size and fleet, so a match isn't restored into a
+  // game set up differently
+static uint64_t gameFingerprint(const Game& g)
+{
+    string key = to_string(g.rows()) + "x" + to_string(g.cols());
+    for (int s = 0; s < g.nShips(); s++)
+    {
+        key += " " + g.shipShape(s);
+    }
+    uint64_t h = 0xCBF29CE484222325ULL; //FNV-1a
+    for (size_t i = 0; i < key.size(); i++)
+    {
+        h = (h ^ (unsigned char)(key[i])) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+  // A board's cells on the board, its fleet and its undo stack; the unused
+  // ends of BoardSnapshot's arrays are left out
+static void saveBoard(const Game& g, const Board& b, SnapshotWriter& w)
+{
+    BoardSnapshot s = b.snapshot();
+    for (int r = 0; r < g.rows(); r++)
+    {
+        w.bytes(s.cells[r], g.cols());
+    }
+    w.cells(s.occupied);
+    w.cells(s.blocked);
+    w.cells(s.hits);
+    w.u8(s.nShips);
+    w.bytes(s.ships, s.nShips * sizeof(s.ships[0]));
+    w.u8(s.nUndo);
+    w.bytes(s.undo, s.nUndo * sizeof(s.undo[0]));
+}
+
+static bool restoreBoard(const Game& g, Board& b, SnapshotReader& r)
+{
+    b.clear();
+    BoardSnapshot s = b.snapshot(); //for the cells off the board
+    for (int row = 0; row < g.rows(); row++)
+    {
+        r.bytes(s.cells[row], g.cols());
+    }
+    s.occupied = r.cells();
+    s.blocked = r.cells();
+    s.hits = r.cells();
+    s.nShips = int(r.u8());
+    if (s.nShips > g.nShips())
+        return false;
+    r.bytes(s.ships, s.nShips * sizeof(s.ships[0]));
+    for (int i = 0; i < s.nShips; i++)
+    {
+        if (s.ships[i].id >= g.nShips() || s.ships[i].placement >= g.placements(s.ships[i].id).size())
+            return false;
+    }
+    s.nUndo = int(r.u8());
+    if (s.nUndo > MAXROWS*MAXCOLS)
+        return false;
+    r.bytes(s.undo, s.nUndo * sizeof(s.undo[0]));
+    for (int i = 0; i < s.nUndo; i++)
+    {
+        if ( ! g.isValid(Point(s.undo[i].r, s.undo[i].c)))
+            return false;
+    }
+    if ( ! r.ok())
+        return false;
+    b.restore(s);
+    return true;
+}
+
+bool saveMatch(const Game& g, const MatchSide sides[2], int turn, string& out)
+{
+    size_t start = out.size();
+    SnapshotWriter w(out);
+    w.bytes(MATCH_MAGIC, sizeof(MATCH_MAGIC));
+    w.u64(gameFingerprint(g));
+    w.u8(turn);
+    for (int i = 0; i < 2; i++)
+    {
+        const MatchSide& side = sides[i];
+        w.str(side.player != nullptr ? side.type : "");
+        saveBoard(g, *side.board, w);
+        if (side.player != nullptr && ! side.player->saveState(w))
+        {
+            out.resize(start);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool restoreMatch(const Game& g, const string& in, size_t pos, const string names[2],
+                  MatchSide sides[2], int& turn)
+{
+    SnapshotReader r(in, pos);
+    char magic[sizeof(MATCH_MAGIC)];
+    r.bytes(magic, sizeof(magic));
+    if (memcmp(magic, MATCH_MAGIC, sizeof(MATCH_MAGIC)) != 0 || r.u64() != gameFingerprint(g))
+        return false;
+    int t = int(r.u8());
+    Player* made[2] = { nullptr, nullptr };
+    bool ok = (t < 2);
+    for (int i = 0; i < 2 && ok; i++)
+    {
+        string type = r.str();
+        ok = restoreBoard(g, *sides[i].board, r);
+        if (ok && ! type.empty())
+        {
+            made[i] = createPlayer(type, names[i], g);
+            ok = (made[i] != nullptr && made[i]->restoreState(r));
+        }
+        sides[i].type = type;
+    }
+    if ( ! ok || ! r.ok())
+    {
+        delete made[0];
+        delete made[1];
+        return false;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        sides[i].player = made[i];
+    }
+    turn = t;
+    return true;
+}
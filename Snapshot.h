@@ -0,0 +1,83 @@
+#ifndef SNAPSHOT_INCLUDED
+#define SNAPSHOT_INCLUDED
+
+#include "globals.h"
+#include <cstdint>
+#include <string>
+
+class Board;
+class Game;
+class Player;
+
+  // Appends values to a byte string, each in a fixed number of bytes in
+  // the machine's own order, for snapshots read back on the same kind of
+  // machine
+class SnapshotWriter
+{
+  public:
+    SnapshotWriter(std::string& out);
+    void u8(unsigned v);
+    void u16(unsigned v);
+    void u32(std::uint32_t v);
+    void u64(std::uint64_t v);
+    void cells(const CellSet& s);         // in 13 bytes
+    void str(const std::string& s);       // at most 65535 bytes
+    void bytes(const void* p, std::size_t n);
+
+  private:
+    std::string& m_out;
+};
+
+  // Reads back what a SnapshotWriter wrote.  Reading past the end gives
+  // zeroes and leaves ok false, so a caller can read a whole record and
+  // check once.
+class SnapshotReader
+{
+  public:
+    SnapshotReader(const std::string& in, std::size_t pos = 0);
+    unsigned u8();
+    unsigned u16();
+    std::uint32_t u32();
+    std::uint64_t u64();
+    CellSet cells();
+    std::string str();
+    void bytes(void* p, std::size_t n);
+      // Note that what was read made no sense
+    void fail();
+    bool ok() const;
+    bool atEnd() const;
+
+  private:
+    const std::string& m_in;
+    std::size_t m_pos;
+    bool m_ok;
+};
+
+  // One side of a match under way: its fleet and, unless a client plays
+  // it, the computer player firing for it
+struct MatchSide
+{
+    std::string type;   // as for createPlayer; "" for a side no Player plays
+    Player* player;     // nullptr if type is ""
+    Board* board;
+};
+
+  // Append to out a snapshot of a match under way in g, taken between
+  // moves: each side's fleet and the shots at it, what each computer
+  // player has learned and decided, and which side fires next.  A match
+  // is a few hundred bytes to a couple of kilobytes, and saving or
+  // restoring one takes microseconds, so a server can spill idle matches
+  // to disk or hand them to another process.  Returns false if a side's
+  // player can't be saved (an external engine).
+bool saveMatch(const Game& g, const MatchSide sides[2], int turn, std::string& out);
+
+  // Restore into sides a match saved by saveMatch from in, starting at
+  // pos.  The boards must be made for g; the players are made with
+  // createPlayer, named names[i], and belong to the caller.  The match
+  // goes on as it would have had it never been saved.  Returns false,
+  // with no players made, if in isn't a match saved in a game set up as
+  // g is.
+bool restoreMatch(const Game& g, const std::string& in, std::size_t pos,
+                  const std::string names[2], MatchSide sides[2], int& turn);
+
+#endif // SNAPSHOT_INCLUDED
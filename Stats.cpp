@@ -0,0 +1,317 @@
+#include "Stats.h"
+#include "Game.h"
+#include "Player.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const double SKETCH_ACCURACY = 0.01;
+const double SKETCH_GAMMA = (1 + SKETCH_ACCURACY) / (1 - SKETCH_ACCURACY);
+const double QUANTILES[] = { 0.1, 0.5, 0.9, 0.99 };
+const char* const QUANTILE_NAMES[] = { "p10", "p50", "p90", "p99" };
+const int NQUANTILES = 4;
+
+//*********************************************************************
+//  WinRate
+//*********************************************************************
+
+WinRate::WinRate()
+ : m_wins(0), m_games(0)
+{}
+
+void WinRate::add(bool won)
+{
+    m_games++;
+    if (won)
+        m_wins++;
+}
+
+void WinRate::merge(const WinRate& w)
+{
+    m_wins += w.m_wins;
+    m_games += w.m_games;
+}
+
+long long WinRate::wins() const
+{
+    return m_wins;
+}
+
+long long WinRate::games() const
+{
+    return m_games;
+}
+
+double WinRate::rate() const
+{
+    return m_games > 0 ? double(m_wins) / m_games : 0;
+}
+
+void WinRate::interval(double z, double& lo, double& hi) const
+{
+    if (m_games == 0)
+    {
+        lo = 0;
+        hi = 1;
+        return;
+    }
+      // Unlike the usual p +/- z*sqrt(p(1-p)/n), this stays within 0 to 1
+      // and doesn't shrink to nothing when every game is won or lost
+    double n = double(m_games);
+    double p = rate();
+    double z2 = z * z;
+    double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+    double half = z * sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+    lo = max(0.0, center - half);
+    hi = min(1.0, center + half);
+}
+
+//*********************************************************************
+//  QuantileSketch
+//*********************************************************************
+
+QuantileSketch::QuantileSketch()
+ : m_count(0), m_sum(0), m_min(INT_MAX), m_max(0)
+{
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+void QuantileSketch::add(int value)
+{
+    value = std::min(std::max(value, 0), MAX_VALUE);
+    int i = 0;
+    if (value > 0)
+    {
+        static const double logGamma = log(SKETCH_GAMMA);
+        i = std::min(int(ceil(log(double(value)) / logGamma - 1e-9)) + 1, BUCKETS - 1);
+    }
+    m_counts[i]++;
+    m_count++;
+    m_sum += value;
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+}
+
+void QuantileSketch::merge(const QuantileSketch& s)
+{
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        m_counts[i] += s.m_counts[i];
+    }
+    m_count += s.m_count;
+    m_sum += s.m_sum;
+    m_min = std::min(m_min, s.m_min);
+    m_max = std::max(m_max, s.m_max);
+}
+
+long long QuantileSketch::count() const
+{
+    return m_count;
+}
+
+double QuantileSketch::mean() const
+{
+    return m_count > 0 ? double(m_sum) / m_count : 0;
+}
+
+int QuantileSketch::min() const
+{
+    return m_count > 0 ? m_min : 0;
+}
+
+int QuantileSketch::max() const
+{
+    return m_max;
+}
+
+int QuantileSketch::quantile(double q) const
+{
+    if (m_count == 0)
+        return 0;
+    long long rank = (long long)(q * (m_count - 1));
+    long long seen = 0;
+    int i = 0;
+    for ( ; i < BUCKETS - 1; i++)
+    {
+        seen += m_counts[i];
+        if (seen > rank)
+            break;
+    }
+    if (i == 0)
+        return 0;
+      // The point of bucket i's range (gamma^(i-2), gamma^(i-1)] from which
+      // no value in it is off by more than the accuracy, rounded to the
+      // count it most likely was; below 50, a bucket holds only one
+    double estimate = 2 * pow(SKETCH_GAMMA, i - 1) / (SKETCH_GAMMA + 1);
+    return std::min(std::max(int(lround(estimate)), m_min), m_max);
+}
+
+//*********************************************************************
+//  PlayStats
+//*********************************************************************
+
+PlayStats::PlayStats(int nShips)
+ : m_games(0), m_unplayed(0)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        m_sides[i].shotsToSink.resize(nShips);
+        m_sides[i].huntingShots = 0;
+        m_sides[i].targetingShots = 0;
+    }
+}
+
+void PlayStats::add(const Game& g, const Player* p1, const Player* p2, const Player* winner)
+{
+    const Player* sides[2] = { p1, p2 };
+    m_games++;
+    if (winner == nullptr)
+    {
+        m_unplayed++;
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        Side& side = m_sides[i];
+        side.wins.add(winner == sides[i]);
+        if (winner == sides[i])
+            side.shotsToWin.add(g.shots(sides[i]));
+        const vector<int>& sunk = g.sinkOrder(sides[i]);
+        const vector<int>& when = g.sinkShots(sides[i]);
+        for (size_t k = 0; k < sunk.size() && k < when.size(); k++)
+        {
+            if (sunk[k] >= 0 && sunk[k] < int(side.shotsToSink.size()))
+                side.shotsToSink[sunk[k]].add(when[k]);
+        }
+        const vector<int>& phases = g.phases(sides[i]);
+        for (size_t k = 0; k < phases.size(); k++)
+        {
+            if (k % 2 == 0)
+            {
+                side.hunting.add(phases[k]);
+                side.huntingShots += phases[k];
+            }
+            else
+            {
+                side.targeting.add(phases[k]);
+                side.targetingShots += phases[k];
+            }
+        }
+    }
+}
+
+void PlayStats::merge(const PlayStats& s)
+{
+    m_games += s.m_games;
+    m_unplayed += s.m_unplayed;
+    for (int i = 0; i < 2; i++)
+    {
+        Side& side = m_sides[i];
+        const Side& other = s.m_sides[i];
+        side.wins.merge(other.wins);
+        side.shotsToWin.merge(other.shotsToWin);
+        for (size_t k = 0; k < side.shotsToSink.size() && k < other.shotsToSink.size(); k++)
+        {
+            side.shotsToSink[k].merge(other.shotsToSink[k]);
+        }
+        side.hunting.merge(other.hunting);
+        side.targeting.merge(other.targeting);
+        side.huntingShots += other.huntingShots;
+        side.targetingShots += other.targetingShots;
+    }
+}
+
+long long PlayStats::games() const
+{
+    return m_games;
+}
+
+  // "mean 45.2, p10 38.0, ..." for s
+static void writeDistribution(ostream& os, const QuantileSketch& s)
+{
+    os << "mean " << s.mean();
+    for (int q = 0; q < NQUANTILES; q++)
+    {
+        os << ", " << QUANTILE_NAMES[q] << " " << s.quantile(QUANTILES[q]);
+    }
+    os << ", max " << s.max();
+}
+
+static void writeDistributionJson(ostream& os, const QuantileSketch& s)
+{
+    os << "{\"count\":" << s.count() << ",\"mean\":" << s.mean() << ",\"min\":" << s.min();
+    for (int q = 0; q < NQUANTILES; q++)
+    {
+        os << ",\"" << QUANTILE_NAMES[q] << "\":" << s.quantile(QUANTILES[q]);
+    }
+    os << ",\"max\":" << s.max() << "}";
+}
+
+void PlayStats::report(ostream& os, const string names[2], const Game& g) const
+{
+    os << fixed << setprecision(1);
+    for (int i = 0; i < 2; i++)
+    {
+        const Side& side = m_sides[i];
+        double lo;
+        double hi;
+        side.wins.interval(1.96, lo, hi);
+        os << names[i] << ": won " << side.wins.wins() << " of " << side.wins.games()
+           << ", " << 100 * side.wins.rate() << "% (95% interval " << 100 * lo
+           << "% to " << 100 * hi << "%)" << endl;
+        os << "  shots to win: ";
+        writeDistribution(os, side.shotsToWin);
+        os << endl;
+        long long shots = side.huntingShots + side.targetingShots;
+        os << "  hunting, " << (shots > 0 ? 100.0 * side.huntingShots / shots : 0.0)
+           << "% of shots, in runs of: ";
+        writeDistribution(os, side.hunting);
+        os << endl << "  targeting, in runs of: ";
+        writeDistribution(os, side.targeting);
+        os << endl;
+        for (size_t k = 0; k < side.shotsToSink.size(); k++)
+        {
+            os << "  shots to sink " << (int(k) < g.nShips() ? g.shipName(int(k)) : to_string(k + 1))
+               << ": ";
+            writeDistribution(os, side.shotsToSink[k]);
+            os << endl;
+        }
+    }
+    if (m_unplayed > 0)
+        os << m_unplayed << " games couldn't be played" << endl;
+}
+
+void PlayStats::writeJson(ostream& os) const
+{
+    os << "{\"games\":" << m_games << ",\"unplayed\":" << m_unplayed << ",\"sides\":[";
+    for (int i = 0; i < 2; i++)
+    {
+        const Side& side = m_sides[i];
+        double lo;
+        double hi;
+        side.wins.interval(1.96, lo, hi);
+        os << (i == 0 ? "" : ",") << "{\"wins\":" << side.wins.wins()
+           << ",\"winRate\":" << side.wins.rate() << ",\"interval95\":[" << lo << "," << hi << "]"
+           << ",\"shotsToWin\":";
+        writeDistributionJson(os, side.shotsToWin);
+        os << ",\"huntingShots\":" << side.huntingShots << ",\"hunting\":";
+        writeDistributionJson(os, side.hunting);
+        os << ",\"targetingShots\":" << side.targetingShots << ",\"targeting\":";
+        writeDistributionJson(os, side.targeting);
+        os << ",\"shotsToSink\":[";
+        for (size_t k = 0; k < side.shotsToSink.size(); k++)
+        {
+            os << (k == 0 ? "" : ",");
+            writeDistributionJson(os, side.shotsToSink[k]);
+        }
+        os << "]}";
+    }
+    os << "]}";
+}
@@ -0,0 +1,97 @@
+#ifndef STATS_INCLUDED
+#define STATS_INCLUDED
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class Game;
+class Player;
+
+  // How often something happened out of so many tries
+class WinRate
+{
+  public:
+    WinRate();
+    void add(bool won);
+    void merge(const WinRate& w);
+    long long wins() const;
+    long long games() const;
+    double rate() const;
+      // The Wilson score interval for the rate at z standard deviations
+      // (1.96 for 95%); 0 to 1 if there are no games
+    void interval(double z, double& lo, double& hi) const;
+
+  private:
+    long long m_wins;
+    long long m_games;
+};
+
+  // The distribution of a stream of counts, kept in buckets whose widths
+  // grow geometrically, so that any quantile comes back within 1% of a
+  // value that was added, in the same fixed space however many are
+  // added.  Two sketches merge by adding their buckets, so threads can
+  // each keep one and combine them at the end, or whenever they're asked.
+class QuantileSketch
+{
+  public:
+    static const int BUCKETS = 560;      // enough for counts up to 65535
+    static const int MAX_VALUE = 65535;  // larger counts are kept as this
+
+    QuantileSketch();
+    void add(int value);
+    void merge(const QuantileSketch& s);
+    long long count() const;
+    double mean() const;
+    int min() const;
+    int max() const;
+      // A value at rank q (0 to 1) of those added; 0 if none were
+    int quantile(double q) const;
+
+  private:
+    std::uint64_t m_counts[BUCKETS];  // bucket i > 0 holds values in
+                                      // (gamma^(i-2), gamma^(i-1)]; 0 holds 0
+    long long m_count;
+    long long m_sum;
+    int m_min;
+    int m_max;
+};
+
+  // Aggregates over any number of games between two sides, in the same
+  // space however many games there are: each side's win rate, the shots
+  // it took to win, the shots it had taken when it sank each of the other
+  // side's ships, and the lengths of its runs of hunting and of targeting.
+  // As with QuantileSketch, a thread can keep its own and merge it into
+  // another's.
+class PlayStats
+{
+  public:
+    PlayStats(int nShips);
+      // Count g's last game between side 1's player p1 and side 2's p2,
+      // whichever fired first; winner is what play returned
+    void add(const Game& g, const Player* p1, const Player* p2, const Player* winner);
+    void merge(const PlayStats& s);
+    long long games() const;
+      // Write a report headed by each side's name, to be read...
+    void report(std::ostream& os, const std::string names[2], const Game& g) const;
+      // ...or the same as a JSON object
+    void writeJson(std::ostream& os) const;
+
+  private:
+    struct Side
+    {
+        WinRate wins;
+        QuantileSketch shotsToWin;
+        std::vector<QuantileSketch> shotsToSink;  // per shipId
+        QuantileSketch hunting;    // runs of shots
+        QuantileSketch targeting;
+        long long huntingShots;
+        long long targetingShots;
+    };
+    Side m_sides[2];
+    long long m_games;
+    long long m_unplayed;  // games in which no one won
+};
+
+#endif // STATS_INCLUDED
@@ -0,0 +1,144 @@
+#include "TranspositionTable.h"
+#include "globals.h"
+#include <cstdint>
+
+using namespace std;
+
+  // Layout of an entry's data word
+const uint64_t VALID_BIT = 1ULL << 24;
+const int CELL_SHIFT = 0;       // 8 bits: cell index of the shot
+const int COST_SHIFT = 8;       // 8 bits
+const int GENERATION_SHIFT = 16;// 8 bits
+const int SCORE_SHIFT = 32;     // 32 bits, signed
+
+TranspositionTable::TranspositionTable(int megabytes)
+ : m_buckets(nullptr), m_nBuckets(0), m_generation(0), m_probes(0), m_hits(0), m_stores(0)
+{
+    resize(megabytes);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    delete [] m_buckets;
+}
+
+void TranspositionTable::resize(int megabytes)
+{
+    size_t bytes = size_t(megabytes < 1 ? 1 : megabytes) << 20;
+    size_t n = 1;
+    while (n * 2 * sizeof(Bucket) <= bytes) //largest power of 2 that fits
+    {
+        n *= 2;
+    }
+    delete [] m_buckets;
+    m_buckets = new Bucket[n];
+    m_nBuckets = n;
+    clear();
+}
+
+void TranspositionTable::clear()
+{
+    for (size_t b = 0; b < m_nBuckets; b++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            m_buckets[b].entries[i].check.store(0, memory_order_relaxed);
+            m_buckets[b].entries[i].data.store(0, memory_order_relaxed);
+        }
+    }
+    m_probes = 0;
+    m_hits = 0;
+    m_stores = 0;
+}
+
+void TranspositionTable::newGeneration()
+{
+    m_generation.fetch_add(1, memory_order_relaxed);
+}
+
+bool TranspositionTable::probe(uint64_t key, Point& shot, int& score)
+{
+    m_probes.fetch_add(1, memory_order_relaxed);
+    Bucket& bucket = m_buckets[key & (m_nBuckets - 1)];
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t data = bucket.entries[i].data.load(memory_order_relaxed);
+        uint64_t check = bucket.entries[i].check.load(memory_order_relaxed);
+        if ((data & VALID_BIT) != 0 && (check ^ data) == key)
+        {
+            shot = cellPoint(int((data >> CELL_SHIFT) & 0xFF));
+            score = int32_t(uint32_t(data >> SCORE_SHIFT));
+            m_hits.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, Point shot, int score, int cost)
+{
+    m_stores.fetch_add(1, memory_order_relaxed);
+    unsigned generation = m_generation.load(memory_order_relaxed) & 0xFF;
+    if (cost < 0)
+        cost = 0;
+    if (cost > 0xFF)
+        cost = 0xFF;
+    uint64_t data = VALID_BIT |
+                    (uint64_t(cellIndex(shot) & 0xFF) << CELL_SHIFT) |
+                    (uint64_t(cost) << COST_SHIFT) |
+                    (uint64_t(generation) << GENERATION_SHIFT) |
+                    (uint64_t(uint32_t(score)) << SCORE_SHIFT);
+
+      // Overwrite this key's entry if present; otherwise evict the entry
+      // worth least: stale ages first, then the cheapest to recompute
+    Bucket& bucket = m_buckets[key & (m_nBuckets - 1)];
+    int victim = 0;
+    int victimWorth = 1 << 30;
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t d = bucket.entries[i].data.load(memory_order_relaxed);
+        uint64_t c = bucket.entries[i].check.load(memory_order_relaxed);
+        if ((d & VALID_BIT) == 0 || (c ^ d) == key)
+        {
+            victim = i;
+            break;
+        }
+        int worth = int((d >> COST_SHIFT) & 0xFF);
+        if (((d >> GENERATION_SHIFT) & 0xFF) == generation)
+            worth += 256;
+        if (worth < victimWorth)
+        {
+            victim = i;
+            victimWorth = worth;
+        }
+    }
+    bucket.entries[victim].check.store(key ^ data, memory_order_relaxed);
+    bucket.entries[victim].data.store(data, memory_order_relaxed);
+}
+
+uint64_t TranspositionTable::probes() const
+{
+    return m_probes.load(memory_order_relaxed);
+}
+
+uint64_t TranspositionTable::hits() const
+{
+    return m_hits.load(memory_order_relaxed);
+}
+
+uint64_t TranspositionTable::stores() const
+{
+    return m_stores.load(memory_order_relaxed);
+}
+
+double TranspositionTable::hitRate() const
+{
+    uint64_t n = probes();
+    return n == 0 ? 0.0 : double(hits()) / n;
+}
+
+TranspositionTable& transpositionTable()
+{
+    static TranspositionTable table(16);
+    return table;
+}
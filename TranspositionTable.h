@@ -0,0 +1,58 @@
+#ifndef TRANSPOSITIONTABLE_INCLUDED
+#define TRANSPOSITIONTABLE_INCLUDED
+
+#include "globals.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+  // A fixed-size cache from attacker knowledge hashes (Knowledge::hash) to
+  // the shot an AI chose there, shared by every thread without locks.
+  // Each entry is two 64-bit words, the second holding the answer and the
+  // first the key xor'ed with it, so a reader that catches a half-written
+  // entry sees a key mismatch and treats it as a miss.
+class TranspositionTable
+{
+  public:
+    TranspositionTable(int megabytes);
+    ~TranspositionTable();
+      // Reallocate and empty the table; no other thread may be using it
+    void resize(int megabytes);
+    void clear();
+      // Start a new age; entries from older ages are replaced first
+    void newGeneration();
+    bool probe(std::uint64_t key, Point& shot, int& score);
+      // cost says how expensive the answer was; cheaper entries of the
+      // current age are evicted before dearer ones
+    void store(std::uint64_t key, Point shot, int score, int cost);
+
+    std::uint64_t probes() const;
+    std::uint64_t hits() const;
+    std::uint64_t stores() const;
+    double hitRate() const;
+      // We prevent a TranspositionTable object from being copied or assigned
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+  private:
+    struct Entry
+    {
+        std::atomic<std::uint64_t> check;  // key ^ data
+        std::atomic<std::uint64_t> data;
+    };
+    struct alignas(64) Bucket   // one cache line
+    {
+        Entry entries[4];
+    };
+    Bucket* m_buckets;
+    std::size_t m_nBuckets;            // a power of 2
+    std::atomic<unsigned> m_generation;
+    std::atomic<std::uint64_t> m_probes;
+    std::atomic<std::uint64_t> m_hits;
+    std::atomic<std::uint64_t> m_stores;
+};
+
+  // The table shared by all AI players in the process
+TranspositionTable& transpositionTable();
+
+#endif // TRANSPOSITIONTABLE_INCLUDED
@@ -1,6 +1,8 @@
 #ifndef GLOBALS_INCLUDED
 #define GLOBALS_INCLUDED
 
+#include <bitset>
+#include <chrono>
 #include <random>
 
 const int MAXROWS = 10;
@@ -19,15 +21,54 @@ class Point
     int c;
 };
 
-  // Return a uniformly distributed random int from 0 to limit-1
+  // A set of cells, one bit per cell; cell (r,c) is bit r*MAXCOLS+c
+typedef std::bitset<MAXROWS*MAXCOLS> CellSet;
+
+inline int cellIndex(Point p)
+{
+    return p.r * MAXCOLS + p.c;
+}
+
+inline Point cellPoint(int index)
+{
+    return Point(index / MAXCOLS, index % MAXCOLS);
+}
+
+  // The clock for move deadlines and search time budgets
+typedef std::chrono::steady_clock Clock;
+
+  // Each thread draws from its own generator so simulations can run in
+  // parallel.  It starts from a random seed.
+inline std::mt19937& randomGenerator()
+{
+    thread_local std::random_device rd;
+    thread_local std::mt19937 generator(rd());
+    return generator;
+}
+
+  // Restart this thread's random numbers from seed, so that whatever it
+  // does next makes the same random choices every time
+inline void seedRandom(unsigned seed)
+{
+    randomGenerator().seed(seed);
+}
+
+  // Return a uniformly distributed random int from 0 to limit-1.
 inline int randInt(int limit)
 {
-    static std::random_device rd;
-    static std::mt19937 generator(rd());
     if (limit < 1)
         limit = 1;
     std::uniform_int_distribution<> distro(0, limit-1);
-    return distro(generator);
+    return distro(randomGenerator());
+}
+
+  // The same for limits too big for an int
+inline long long randLong(long long limit)
+{
+    if (limit < 1)
+        limit = 1;
+    std::uniform_int_distribution<long long> distro(0, limit-1);
+    return distro(randomGenerator());
 }
 
 #endif // GLOBALS_INCLUDED
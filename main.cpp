@@ -1,5 +1,14 @@
+#include "Archive.h"
+#include "Batch.h"
+#include "Equilibrium.h"
 #include "Game.h"
+#include "OpeningBook.h"
+#include "OpponentModel.h"
 #include "Player.h"
+#include "PolicyNet.h"
+#include "Server.h"
+#include "Stats.h"
+#include <csignal>
 #include <iostream>
 #include <string>
 
@@ -14,16 +23,139 @@ bool addStandardShips(Game& g)
            g.addShip(2, 'P', "patrol boat");
 }
 
-int main()
+Server* theServer = nullptr;  // for the signal handler
+
+void stopServing(int)
+{
+    if (theServer != nullptr)
+        theServer->stop();
+}
+
+int main(int argc, char* argv[])
 {
     const int NTRIALS = 10;
 
+    if (argc == 3 && string(argv[1]) == "--make-book")
+    {
+        if ( ! writeOpeningBook(argv[2]))
+        {
+            cout << "Could not write the opening book " << argv[2] << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc == 3 && string(argv[1]) == "--make-net")
+    {
+        if ( ! writePolicyNet(argv[2]))
+        {
+            cout << "Could not write the policy network " << argv[2] << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc == 3 && string(argv[1]) == "--solve-placement")
+    {
+          // Find a mix of layouts for the standard game that no attacker
+          // does well against, for the density and neural players to
+          // place from
+        openingBook().open("opening.book");
+        policyNet().open("policy.net");
+        Game g(10, 10);
+        addStandardShips(g);
+        SolverConfig config;
+        config.attackers = { "mediocre", "good", "density", "neural" };
+        config.trials = 60;
+        config.iterations = 20000;
+        config.layoutsPerStyle = 512;
+        config.threads = 0;
+        config.seed = 1;
+        if ( ! solvePlacement(g, config, argv[2], cout))
+        {
+            cout << "Could not write the placement table " << argv[2] << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--batch")
+    {
+          // Play games with no prompts, for scripts and benchmarks.  The
+          // opponent file stays closed so that what the players learned
+          // in earlier runs can't change the results.
+        BatchConfig config;
+        string error;
+        if ( ! parseBatchArgs(argc - 2, argv + 2, config, error))
+        {
+            cerr << error << endl << "Usage: " << argv[0] << " --batch [options]" << endl
+                 << batchUsage();
+            return 2;
+        }
+        openingBook().open("opening.book");
+        policyNet().open("policy.net");
+        placementTable().open("placement.table");
+        return runBatch(config) ? 0 : 1;
+    }
+
+    if (argc >= 2 && string(argv[1]) == "--query")
+    {
+          // Find games in an archive made by --batch --archive
+        string path;
+        ArchiveQuery q;
+        bool countOnly;
+        long long limit;
+        string error;
+        if ( ! parseQueryArgs(argc - 2, argv + 2, path, q, countOnly, limit, error))
+        {
+            cerr << error << endl << "Usage: " << argv[0] << " --query ARCHIVE [options]" << endl
+                 << queryUsage();
+            return 2;
+        }
+        return runQuery(path, q, countOnly, limit) ? 0 : 1;
+    }
+
+      // AI players remember their opponents across runs in this file
+    opponentModel().open("opponents.dat");
+      // and open with the book made by --make-book, if there is one
+    openingBook().open("opening.book");
+      // The neural player's network, made by --make-net
+    policyNet().open("policy.net");
+      // and the layouts made by --solve-placement
+    placementTable().open("placement.table");
+
+    if (argc >= 2 && string(argv[1]) == "--serve")
+    {
+          // Host games for clients on a loopback TCP port, or at a Unix
+          // socket path, until interrupted
+        string where = (argc >= 3 ? argv[2] : "4040");
+        Game g(10, 10);
+        addStandardShips(g);
+        Server server(g);
+        bool isPort = ! where.empty() && where.size() <= 5 && where.find_first_not_of("0123456789") == string::npos;
+        if ( ! (isPort ? server.listenTcp(stoi(where)) : server.listenUnix(where)))
+        {
+            cout << "Could not listen on " << where << endl;
+            return 1;
+        }
+        theServer = &server;
+        signal(SIGINT, stopServing);
+        signal(SIGTERM, stopServing);
+        cout << "Serving games on " << where << endl;
+        bool ok = server.run();
+        theServer = nullptr;
+        cout << server.nGamesPlayed() << " games played" << endl;
+        return ok ? 0 : 1;
+    }
+
     cout << "Select one of these choices for an example of the game:" << endl;
     cout << "  1.  A mini-game between two mediocre players" << endl;
     cout << "  2.  A mediocre player against a human player" << endl;
     cout << "  3.  A " << NTRIALS
          << "-game match between a mediocre and a good player, with no pauses"
          << endl;
+    cout << "  4.  A salvo game between a good and a density player, with no pauses"
+         << endl;
     cout << "Enter your choice: ";
     string line;
     getline(cin,line);
@@ -46,6 +178,7 @@ int main()
     {
         Game g(10, 10);
         addStandardShips(g);
+        g.setMoveTimeLimit(1000); //keep the human waiting no more than a second
         Player* p1 = createPlayer("mediocre", "Mediocre Midori", g);
         Player* p2 = createPlayer("human", "Shuman the Human", g);
         g.play(p1, p2);
@@ -54,29 +187,39 @@ int main()
     }
     else if (line[0] == '3')
     {
-        int nGoodPlayerWins = 0;
+        Game g(10, 10);
+        addStandardShips(g);
+        PlayStats stats(g.nShips());
 
         for (int k = 1; k <= NTRIALS; k++)
         {
             cout << "============================= Game " << k
                  << " =============================" << endl;
-            Game g(10, 10);
-            addStandardShips(g);
             Player* p1 = createPlayer("mediocre", "Mediocre Player", g); //change param1 to one of those four types...
-            Player* p2 = createPlayer("good", "Good Player", g); //"human", "awful", "mediocre", "good"
+            Player* p2 = createPlayer("good", "Good Player", g); //"human", "awful", "mediocre", "good", "adaptive", "density"
             Player* winner = (k % 2 == 1 ?
                                 g.play(p1, p2, false) : g.play(p2, p1, false));
-            if (winner == p2)
-                nGoodPlayerWins++;
+            stats.add(g, p1, p2, winner);
             delete p1;
             delete p2;
         }
-        cout << "The good player won " << nGoodPlayerWins << " out of "
-             << NTRIALS << " games." << endl;
+        string names[2] = { "The mediocre player", "The good player" };
+        stats.report(cout, names, g);
           // We'd expect a mediocre player to win most of the games against
           // an awful player.  Similarly, a good player should outperform
           // a mediocre player.
     }
+    else if (line[0] == '4')
+    {
+        Game g(10, 10);
+        addStandardShips(g);
+        g.setSalvo(SALVO_SHIPS_AFLOAT); //one shot a turn for each ship still afloat
+        Player* p1 = createPlayer("good", "Good Player", g);
+        Player* p2 = createPlayer("density", "Density Player", g);
+        g.play(p1, p2, false);
+        delete p1;
+        delete p2;
+    }
     else
     {
        cout << "That's not one of the choices." << endl;